@@ -0,0 +1,39 @@
+/**
+ * @file bench.h
+ * @brief Timing helpers of host benchmarks.
+ *
+ * On x86, cycles are read from the time stamp counter, which ticks at
+ * a fixed reference rate close to the nominal core clock. Disable
+ * frequency scaling for stable figures. Elsewhere, nanoseconds are 
+ * used instead.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT "cycle"
+#else
+#define BENCH_UNIT "ns"
+#endif
+
+#define BENCH_REPS 9    /* Runs of each case. The fastest one is kept */
+
+static inline uint64_t Bench_Cycles(void){
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+/* Keeps <value>, and all it depends on, from being optimized out */
+static inline void Bench_Keep(uint64_t value){
+    __asm__ volatile("" : : "r"(value) : "memory");
+}
+
+#endif
@@ -0,0 +1,104 @@
+/**
+ * @file crc.c
+ * @brief Bytes per cycle of CRC-32 over frame sized buffers.
+ *
+ * Two implementations of the trailer CRC, which must agree:
+ * - device: MCTP_Crc32 without MCTP_USE_HW_CRC, slice-by-8 over the
+ *   constant table in flash. MCTP_HostCrc32 calls it.
+ * - bytewise: one table lookup per byte, as a reference
+ *
+ * Figures are for the host CPU. On the device, slice-by-8 trades 8 KB
+ * of flash for fewer dependent steps, and the CRC peripheral, used
+ * with MCTP_USE_HW_CRC, takes a word per write.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+#include "mctp_crc.h"
+#include "mctp_host.h"
+
+#define MAX_SIZE 4096
+#define BYTES_PER_REP (1 << 20)     /* Bytes hashed in each rep */
+
+typedef uint32_t (*CrcFunc)(const void *data, uint32_t size);
+
+static uint8_t data[MAX_SIZE];
+static uint32_t byteTable[256];
+
+static uint32_t Rand(uint32_t *state){
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static uint32_t Bytewise(const void *data, uint32_t size){
+    const uint8_t *p = data;
+    uint32_t crc = MCTP_CRC_INIT;
+
+    for(; size > 0; size--, p++){
+        crc = byteTable[(crc ^ *p) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void BytewiseInit(void){
+    for(uint32_t i = 0; i < 256; i++){
+        uint32_t c = i;
+        for(int k = 0; k < 8; k++){
+            c = (c & 1)? (c >> 1) ^ 0xEDB88320U : c >> 1;
+        }
+        byteTable[i] = c;
+    }
+}
+
+/*
+ * Returns bytes per cycle of <crc> over buffers of <size> bytes
+ */
+static double Run(CrcFunc crc, uint32_t size){
+    uint32_t runs = BYTES_PER_REP / size;
+    uint64_t best = UINT64_MAX;
+
+    for(int rep = 0; rep < BENCH_REPS; rep++){
+        uint64_t start = Bench_Cycles();
+        for(uint32_t i = 0; i < runs; i++){
+            Bench_Keep(crc(data, size));
+        }
+        uint64_t cycles = Bench_Cycles() - start;
+        if(cycles < best){
+            best = cycles;
+        }
+    }
+    return (double)runs * size / best;
+}
+
+int main(void){
+    static const uint32_t sizes[] = {16, 64, 256, 1024, MAX_SIZE};
+    uint32_t state = 0xC3C32;
+    int status = 0;
+
+    BytewiseInit();
+    MCTP_CrcInit();
+    for(uint32_t i = 0; i < MAX_SIZE; i++){
+        data[i] = Rand(&state);
+    }
+
+    printf("%6s  %14s  %14s   (bytes/%s)\n", "size", "device", "bytewise", BENCH_UNIT);
+    for(unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++){
+        uint32_t size = sizes[s];
+        /* Odd sizes too, for the bytes left after 8 byte steps */
+        uint32_t expected = Bytewise(data, size - 3);
+        if(MCTP_Crc32(data, size - 3) != expected || MCTP_HostCrc32(data, size - 3) != expected ||
+                MCTP_Crc32(data, size) != Bytewise(data, size)){
+            printf("%6u  mismatch\n", size);
+            status = 1;
+            continue;
+        }
+        printf("%6u  %14.2f  %14.2f\n", size, Run(MCTP_Crc32, size), Run(Bytewise, size));
+    }
+
+    return status;
+}
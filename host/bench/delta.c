@@ -0,0 +1,135 @@
+/**
+ * @file delta.c
+ * @brief Round trip of delta + zigzag varint coding over synthetic
+ * ADC traces.
+ *
+ * Each trace is a channel buffer of SAMPLES readings: a sine
+ * over the ADC range plus a few LSB of noise, as from a 12 bit ADC
+ * stored in 16 or 32 bit samples. Traces are encoded by the device
+ * encoder MCTP_EncodeDelta and decoded back by MCTP_HostDecodeDelta,
+ * which must give the same samples. Ratio is plain size over encoded
+ * size. Full scale noise shows the fallback to raw blocks.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "bench.h"
+#include "mctp_codec.h"
+#include "mctp_host.h"
+
+#define SAMPLES 1024
+#define RUNS 200            /* Encodes and decodes timed in each rep */
+
+typedef struct{
+    const char *name;
+    E_MCTP_DataType dataType;
+    double amplitude;       /* Sine amplitude, in LSB */
+    double period;          /* Sine period, in samples */
+    uint32_t noise;         /* Noise peak to peak, in LSB */
+} TraceCase;
+
+static uint8_t samples[SAMPLES * 4];
+static uint8_t decoded[SAMPLES * 4];
+static uint8_t encoded[DELTA_MAX_SIZE(SAMPLES, 4)];
+
+static uint32_t Rand(uint32_t *state){
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static uint64_t Nanoseconds(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/*
+ * Fills samples with the trace of <tc>, centered on 2048 LSB, or 0 for
+ * signed types.
+ */
+static void BuildTrace(const TraceCase *tc, uint8_t width){
+    uint32_t state = 0xADC0ADC;
+    bool is_signed = tc->dataType == DATATYPE_INT16 || tc->dataType == DATATYPE_INT32;
+
+    for(int i = 0; i < SAMPLES; i++){
+        int32_t value = (int32_t)lround(tc->amplitude * sin(2 * M_PI * i / tc->period));
+        value += (int32_t)(Rand(&state) % (tc->noise + 1)) - (int32_t)(tc->noise / 2);
+        if(!is_signed){
+            value += 2048;
+        }
+        memcpy(&samples[i * width], &value, width);
+    }
+}
+
+static int Run(const TraceCase *tc){
+    uint8_t width = MCTP_DeltaWidth(tc->dataType | DATATYPE_DELTA);
+    uint64_t best_enc = UINT64_MAX;
+    uint64_t best_dec = UINT64_MAX;
+    uint64_t best_dec_ns = UINT64_MAX;
+    uint32_t size = 0;
+
+    BuildTrace(tc, width);
+    for(int rep = 0; rep < BENCH_REPS; rep++){
+        uint64_t start = Bench_Cycles();
+        for(int i = 0; i < RUNS; i++){
+            size = MCTP_EncodeDelta(samples, encoded, SAMPLES, width);
+            Bench_Keep(encoded[size - 1]);
+        }
+        uint64_t cycles = Bench_Cycles() - start;
+        if(cycles < best_enc){
+            best_enc = cycles;
+        }
+
+        uint64_t start_ns = Nanoseconds();
+        start = Bench_Cycles();
+        for(int i = 0; i < RUNS; i++){
+            if(MCTP_HostDecodeDelta(encoded, size, tc->dataType | DATATYPE_DELTA, decoded, SAMPLES) != SAMPLES){
+                return -1;
+            }
+            Bench_Keep(decoded[0]);
+        }
+        cycles = Bench_Cycles() - start;
+        uint64_t ns = Nanoseconds() - start_ns;
+        if(cycles < best_dec){
+            best_dec = cycles;
+        }
+        if(ns < best_dec_ns){
+            best_dec_ns = ns;
+        }
+    }
+    if(memcmp(samples, decoded, SAMPLES * width) != 0){
+        return -1;
+    }
+
+    printf("%-26s ratio %4.2f  %5u bytes  encode %5.1f %ss/sample  decode %4.1f %ss/sample, %6.1f Msamples/s\n",
+        tc->name, (double)(SAMPLES * width) / size, size,
+        (double)best_enc / RUNS / SAMPLES, BENCH_UNIT,
+        (double)best_dec / RUNS / SAMPLES, BENCH_UNIT,
+        (double)RUNS * SAMPLES * 1000 / best_dec_ns);
+    return 0;
+}
+
+int main(void){
+    static const TraceCase cases[] = {
+        {"uint16, slow, 4 LSB noise", DATATYPE_UINT16, 1800, 4096, 4},
+        {"uint16, fast, 4 LSB noise", DATATYPE_UINT16, 1800, 64, 4},
+        {"int16, slow, 32 LSB noise", DATATYPE_INT16, 1800, 4096, 32},
+        {"int32, slow, 4 LSB noise", DATATYPE_INT32, 1800, 4096, 4},
+        {"uint16, full scale noise", DATATYPE_UINT16, 0, 1, 4095},
+    };
+    int status = 0;
+
+    for(unsigned c = 0; c < sizeof(cases) / sizeof(cases[0]); c++){
+        if(Run(&cases[c]) < 0){
+            printf("%s failed\n", cases[c].name);
+            status = 1;
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,177 @@
+/**
+ * @file parser.c
+ * @brief Bytes per cycle of frame delimiting, EOM scan against 
+ * length-driven parsing.
+ *
+ * EOM scan is the original receiver: every byte is appended to the 
+ * receive buffer and the last three bytes compared to EOM, and the
+ * buffer is cleared after each frame. It runs once per byte, as from
+ * the per byte interrupt.
+ *
+ * Length-driven parsing is MCTP_RecvIngest, fed one byte at a time 
+ * (RXMODE_IT), half a DMA ring at a time (RXMODE_DMA) and in large
+ * bursts. Frames are taken from the queue every POLL_BYTES, or after
+ * each larger call.
+ *
+ * Payloads hold no EOM, which EOM scan can't handle.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+#include "mctp_host.h"
+#include "mctp_recv.h"
+
+#define FRAMES 2000
+#define MAX_PAYLOAD 256
+#define POLL_BYTES 32       /* Frames are taken from the queue at least this often */
+
+typedef struct{
+    uint8_t buf[RECV_BUFFER_SIZE];
+    uint16_t index;
+    uint32_t frames;
+} EomScanner;
+
+static uint8_t stream[FRAMES * COBS_MAX_SIZE(HEADER_SIZE + MAX_PAYLOAD + EOM_SIZE)];
+static uint32_t streamSize;
+
+static uint32_t Rand(uint32_t *state){
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static void BuildStream(bool cobs){
+    uint32_t state = 0xBADC0DE;
+    uint8_t data[MAX_PAYLOAD];
+    uint8_t frame[HEADER_SIZE + MAX_PAYLOAD + EOM_SIZE];
+
+    streamSize = 0;
+    for(int i = 0; i < FRAMES; i++){
+        uint16_t size = Rand(&state) % MAX_PAYLOAD;
+        for(uint16_t j = 0; j < size; j++){
+            do{
+                data[j] = Rand(&state);
+            }while(data[j] == 0x24);
+        }
+        uint32_t frame_size = MCTP_HostBuildFrame(FRAMETYPE_DATA, data, size, frame, sizeof(frame));
+        if(cobs){
+            streamSize += MCTP_HostCobsEncode(frame, frame_size, &stream[streamSize], sizeof(stream) - streamSize);
+        }else{
+            memcpy(&stream[streamSize], frame, frame_size);
+            streamSize += frame_size;
+        }
+    }
+}
+
+/*
+ * Original per byte receive logic, the HAL call re-arming reception
+ * left out. <byte> was written by HAL at the buffer index.
+ */
+__attribute__((noinline)) static void EomScanByte(EomScanner *s, uint8_t byte){
+    s->buf[s->index] = byte;
+
+    if(s->index >= RECV_BUFFER_SIZE - 1){
+        s->index = 0;
+        return;
+    }
+
+    s->index++;
+
+    if(s->index >= HEADER_SIZE + EOM_SIZE){
+        uint8_t *EOMsection = &s->buf[s->index - 3];
+        if(EOMsection[0] == 0x24 && EOMsection[1] == 0x25 && EOMsection[2] == 0x26){
+            s->frames++;
+            memset(s->buf, 0, RECV_BUFFER_SIZE);
+            s->index = 0;
+        }
+    }
+}
+
+static uint64_t RunEomScan(uint32_t *frames){
+    static EomScanner s;
+    uint64_t best = UINT64_MAX;
+
+    for(int rep = 0; rep < BENCH_REPS; rep++){
+        memset(&s, 0, sizeof(s));
+        uint64_t start = Bench_Cycles();
+        for(uint32_t i = 0; i < streamSize; i++){
+            EomScanByte(&s, stream[i]);
+        }
+        uint64_t cycles = Bench_Cycles() - start;
+        if(cycles < best){
+            best = cycles;
+        }
+    }
+    *frames = s.frames;
+    return best;
+}
+
+static uint64_t RunIngest(bool cobs, uint32_t chunk, uint32_t *frames){
+    static MCTP_Receiver recv;
+    uint64_t best = UINT64_MAX;
+
+    for(int rep = 0; rep < BENCH_REPS; rep++){
+        MCTP_RecvInit(&recv, cobs);
+        *frames = 0;
+        uint64_t start = Bench_Cycles();
+        for(uint32_t i = 0; i < streamSize; i += chunk){
+            uint32_t n = streamSize - i < chunk? streamSize - i : chunk;
+            MCTP_RecvIngest(&recv, &stream[i], n);
+            if((i + n) % POLL_BYTES >= n && i + n != streamSize){
+                continue;
+            }
+
+            MCTP_View msg;
+            while(MCTP_RecvPeek(&recv, &msg) == 0){
+                (*frames)++;
+                MCTP_RecvRelease(&recv);
+            }
+        }
+        uint64_t cycles = Bench_Cycles() - start;
+        if(cycles < best){
+            best = cycles;
+        }
+    }
+    return best;
+}
+
+static void Report(const char *name, uint64_t cycles, uint32_t frames){
+    printf("%-28s %8.3f bytes/%s %8.1f %ss/frame  %u/%u frames\n", name,
+        (double)streamSize / cycles, BENCH_UNIT, (double)cycles / FRAMES, BENCH_UNIT, 
+        frames, FRAMES);
+}
+
+int main(void){
+    static const uint32_t chunks[] = {1, 32, 256};
+    static const char *names[] = {"per byte (RXMODE_IT)", "32 bytes (RXMODE_DMA)", "256 bytes"};
+    uint32_t frames;
+    int status = 0;
+
+    BuildStream(false);
+    printf("%u frames, %u bytes\n", FRAMES, streamSize);
+    uint64_t cycles = RunEomScan(&frames);
+    Report("eom scan, per byte", cycles, frames);
+    status |= frames != FRAMES;
+    for(int i = 0; i < 3; i++){
+        char name[64];
+        snprintf(name, sizeof(name), "length, %s", names[i]);
+        cycles = RunIngest(false, chunks[i], &frames);
+        Report(name, cycles, frames);
+        status |= frames != FRAMES;
+    }
+
+    BuildStream(true);
+    for(int i = 0; i < 3; i++){
+        char name[64];
+        snprintf(name, sizeof(name), "cobs, %s", names[i]);
+        cycles = RunIngest(true, chunks[i], &frames);
+        Report(name, cycles, frames);
+        status |= frames != FRAMES;
+    }
+
+    return status;
+}
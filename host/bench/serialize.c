@@ -0,0 +1,150 @@
+/**
+ * @file serialize.c
+ * @brief Cycles per DATA frame of MCTP_Serialize, which walks the
+ * frame plan, against the original scan of all MAX_CHANNELS slots.
+ *
+ * Slot scan is the original data section loop: every slot is tested
+ * for use and stored data, and datainfo is written field by field.
+ * It covers the data section only, with no header nor trailer, so it
+ * is a lower bound on the original cost.
+ *
+ * MCTP_Serialize is timed for whole frames, in full format (datainfo
+ * in every frame) and compact format (schema announced). Channel ids
+ * are spread over the slots, and each channel holds SAMPLES FLOAT32
+ * samples.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+#include "hal_sim.h"
+#include "mctp_api.h"
+#include "mctp_parser.h"
+
+#define FRAMES 2000
+#define SAMPLES 30
+
+typedef struct{
+    const char *name;
+    int (*serialize)(MCTP_Handle *hmctp, uint8_t *frame_buf, int frame_buf_size, uint16_t *frame_size);
+    bool compact;
+} SerializePath;
+
+static UART_HandleTypeDef huart;
+static MCTP_Handle hmctp;
+static uint8_t frameBuf[HEADER_SIZE + DATAHEAD_SIZE + MAX_CHANNELS * (DATAINFO_SIZE + SAMPLES * 4) + CRC_SIZE + EOM_SIZE];
+static float channelData[MAX_CHANNELS][SAMPLES];
+
+static void Signal(E_MCTP_Signal signal){
+}
+
+/*
+ * Original data section loop over all slots.
+ */
+static int SlotScan(MCTP_Handle *hmctp, uint8_t *frame_buf, int frame_buf_size, uint16_t *frame_size){
+    uint8_t *p = frame_buf + HEADER_SIZE + DATAHEAD_SIZE;
+    uint16_t total_data_size = DATAHEAD_SIZE;
+
+    for(int i = 0; i < MAX_CHANNELS; i++){
+        if(hmctp->channelList.map[i] && hmctp->channelList.channels[i].storedSize > 0){
+            uint8_t *data = hmctp->channelList.channels[i].dataBuf;
+            uint16_t data_size = hmctp->channelList.channels[i].storedSize;
+            E_MCTP_DataType data_type = hmctp->channelList.channels[i].dataType;
+
+            total_data_size += data_size + DATAINFO_SIZE;
+            if(HEADER_SIZE + total_data_size + EOM_SIZE > frame_buf_size){
+                return -1;
+            }
+            memcpy(p, &i, 1);
+            p += 1;
+            memcpy(p, &data_size, 2);
+            p += 2;
+            memcpy(p, &data_type, 1);
+            p += 1;
+            memcpy(p, data, data_size);
+            p += data_size;
+        }
+    }
+    *frame_size = HEADER_SIZE + total_data_size;
+    return 0;
+}
+
+static int Serialize(MCTP_Handle *hmctp, uint8_t *frame_buf, int frame_buf_size, uint16_t *frame_size){
+    return MCTP_Serialize(hmctp, FRAMETYPE_DATA, frame_buf, frame_buf_size, frame_size);
+}
+
+static int Setup(int channels){
+    memset(&hmctp, 0, sizeof(hmctp));
+    huart.Init.BaudRate = 921600;
+    HalSim_Init(&huart);
+
+    hmctp.huart = &huart;
+    hmctp.SignalCallback = Signal;
+    hmctp.totalChannels = MAX_CHANNELS;
+    hmctp.rxMode = RXMODE_IT;
+    if(MCTP_Init(&hmctp) < 0){
+        return -1;
+    }
+
+    for(int k = 0; k < channels; k++){
+        uint8_t ch = k * MAX_CHANNELS / channels;
+        for(int i = 0; i < SAMPLES; i++){
+            channelData[ch][i] = ch + i * 0.25f;
+        }
+        if(MCTP_EnableChannel(&hmctp, ch, (uint8_t *)channelData[ch], sizeof(channelData[ch]), DATATYPE_FLOAT32) < 0 ||
+                MCTP_WriteChannelData(&hmctp, ch, (uint8_t *)channelData[ch], sizeof(channelData[ch])) < 0){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int Run(const SerializePath *path, int channels){
+    uint64_t best = UINT64_MAX;
+    uint16_t frame_size = 0;
+
+    if(Setup(channels) < 0){
+        return -1;
+    }
+    hmctp.schemaAnnounced = hmctp.schemaId;
+    hmctp.schemaValid = path->compact;
+
+    for(int rep = 0; rep < BENCH_REPS; rep++){
+        uint64_t start = Bench_Cycles();
+        for(int frame = 0; frame < FRAMES; frame++){
+            if(path->serialize(&hmctp, frameBuf, sizeof(frameBuf), &frame_size) < 0){
+                return -1;
+            }
+            Bench_Keep(frameBuf[frame_size - 1]);
+        }
+        uint64_t cycles = Bench_Cycles() - start;
+        if(cycles < best){
+            best = cycles;
+        }
+    }
+
+    printf("%-16s %2d channels: %7.1f %ss/frame  %5u bytes/frame\n",
+        path->name, channels, (double)best / FRAMES, BENCH_UNIT, frame_size);
+    return 0;
+}
+
+int main(void){
+    static const SerializePath paths[] = {
+        {"slot scan", SlotScan, false},
+        {"plan, full", Serialize, false},
+        {"plan, compact", Serialize, true},
+    };
+    static const int cases[] = {1, 8, 32};
+    int status = 0;
+
+    for(unsigned c = 0; c < sizeof(cases) / sizeof(cases[0]); c++){
+        for(unsigned p = 0; p < sizeof(paths) / sizeof(paths[0]); p++){
+            if(Run(&paths[p], cases[c]) < 0){
+                printf("%s failed\n", paths[p].name);
+                status = 1;
+            }
+        }
+    }
+
+    return status;
+}
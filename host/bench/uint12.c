@@ -0,0 +1,260 @@
+/**
+ * @file uint12.c
+ * @brief Samples per second of 12 bit ADC readings over a simulated
+ * link, sent as DATATYPE_UINT12 against DATATYPE_UINT16.
+ *
+ * Device code runs on the simulated HAL, sending DATA frames with
+ * MCTP_SendAll_DMA as fast as the link takes them, for SIM_TIME of
+ * simulated time. Each frame holds CHANNELS channels of SAMPLES
+ * readings, packed with MCTP_WriteChannelUint12 or copied as they are.
+ * The peer finds every frame in the bytes received and unpacks its
+ * samples, which must match the readings.
+ *
+ * Full format carries datainfo in every frame. Compact format is sent
+ * once the schema is announced, and the peer reads it with the schema.
+ *
+ * Cycles per sample of the device packer and of the host unpacker are
+ * timed apart, on host.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+#include "hal_sim.h"
+#include "mctp_api.h"
+#include "mctp_codec.h"
+#include "mctp_host.h"
+#include "mctp_parser.h"
+
+#define CHANNELS 8
+#define SAMPLES 30
+#define SIM_TIME 1000000000ull      /* ns */
+#define RUNS 20000                  /* Packs and unpacks timed in each rep */
+
+typedef struct{
+    const char *name;
+    E_MCTP_DataType dataType;
+    bool compact;
+} LinkCase;
+
+static UART_HandleTypeDef huart;
+static DMA_HandleTypeDef hdmatx;
+static MCTP_Handle hmctp;
+static uint8_t txArena[2 * 1024];
+static uint8_t channelBuf[CHANNELS][SAMPLES * 2];
+static uint16_t readings[CHANNELS][SAMPLES];
+static uint8_t rxBuf[8192];
+
+static void Signal(E_MCTP_Signal signal){
+}
+
+static uint32_t Rand(uint32_t *state){
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static int Setup(const LinkCase *lc, uint32_t baud, MCTP_HostSchema *schema){
+    uint16_t size = lc->dataType == DATATYPE_UINT12? UINT12_SIZE(SAMPLES) : SAMPLES * 2;
+
+    memset(&hmctp, 0, sizeof(hmctp));
+    huart.Init.BaudRate = baud;
+    hdmatx.Init.Mode = DMA_NORMAL;
+    huart.hdmatx = &hdmatx;
+    HalSim_Init(&huart);
+
+    hmctp.huart = &huart;
+    hmctp.SignalCallback = Signal;
+    hmctp.totalChannels = MAX_CHANNELS;
+    hmctp.rxMode = RXMODE_IT;
+    hmctp.txArena = txArena;
+    hmctp.txArenaSize = sizeof(txArena);
+    if(MCTP_Init(&hmctp) < 0 || MCTP_Start(&hmctp) < 0){
+        return -1;
+    }
+
+    memset(schema, 0, sizeof(MCTP_HostSchema));
+    for(int ch = 0; ch < CHANNELS; ch++){
+        if(MCTP_EnableChannel(&hmctp, ch, channelBuf[ch], size, lc->dataType) < 0){
+            return -1;
+        }
+        schema->channels[ch].channelId = ch;
+        schema->channels[ch].size = size;
+        schema->channels[ch].dataType = lc->dataType;
+    }
+    schema->count = CHANNELS;
+    schema->id = hmctp.schemaId;
+    schema->valid = true;
+    if(lc->compact){
+        /* As after SCHEMA was sent */
+        hmctp.schemaAnnounced = hmctp.schemaId;
+        hmctp.schemaValid = true;
+    }
+    return 0;
+}
+
+static int WriteChannels(const LinkCase *lc, uint32_t *state){
+    for(int ch = 0; ch < CHANNELS; ch++){
+        for(int i = 0; i < SAMPLES; i++){
+            readings[ch][i] = Rand(state) & 0xFFF;
+        }
+        int ret = lc->dataType == DATATYPE_UINT12?
+            MCTP_WriteChannelUint12(&hmctp, ch, readings[ch], SAMPLES):
+            MCTP_WriteChannelData(&hmctp, ch, (uint8_t *)readings[ch], sizeof(readings[ch]));
+        if(ret < 0){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Reads DATA frames in rxBuf. Samples of each channel are checked
+ * against <expected>, which replays the readings written.
+ *
+ * Returns samples received, or -1 if any sample is wrong
+ */
+static int64_t Drain(uint32_t *len, const MCTP_HostSchema *schema, uint32_t *expected){
+    int64_t samples = 0;
+    uint32_t pos = 0;
+
+    while(1){
+        MCTP_HostFrame frame;
+        uint32_t skip = 0;
+        uint32_t size = MCTP_HostFindFrame(rxBuf + pos, *len - pos, &skip, &frame);
+        if(size == 0){
+            pos += skip;
+            break;
+        }
+        pos += skip + size;
+
+        MCTP_HostChannel channel;
+        uint32_t offset = 0;
+        int ret;
+        while((ret = MCTP_HostNextChannel(&frame, schema, &offset, &channel)) == 1){
+            uint16_t unpacked[SAMPLES];
+            int32_t n = SAMPLES;
+            if(channel.dataType == DATATYPE_UINT12){
+                n = MCTP_HostDecodeUint12(channel.samples, channel.size, unpacked, SAMPLES);
+            }else{
+                memcpy(unpacked, channel.samples, sizeof(unpacked));
+            }
+            if(n != SAMPLES){
+                return -1;
+            }
+            for(int i = 0; i < SAMPLES; i++){
+                if(unpacked[i] != (Rand(expected) & 0xFFF)){
+                    return -1;
+                }
+            }
+            samples += n;
+        }
+        if(ret < 0){
+            return -1;
+        }
+    }
+
+    memmove(rxBuf, rxBuf + pos, *len - pos);
+    *len -= pos;
+    return samples;
+}
+
+static int RunLink(const LinkCase *lc, uint32_t baud){
+    MCTP_HostSchema schema;
+    uint32_t state = 0x12B17;
+    uint32_t expected = state;
+    uint32_t len = 0;
+    int64_t samples = 0;
+
+    if(Setup(lc, baud, &schema) < 0 || WriteChannels(lc, &state) < 0){
+        return -1;
+    }
+
+    while(HalSim_Now() < SIM_TIME){
+        if(MCTP_SendAll_DMA(&hmctp) == 0){
+            if(WriteChannels(lc, &state) < 0){
+                return -1;
+            }
+        }else{
+            /* Both buffers in use */
+            HalSim_Run(20000);
+        }
+
+        uint32_t n = HalSim_Recv(rxBuf + len, sizeof(rxBuf) - len);
+        len += n;
+        int64_t got = Drain(&len, &schema, &expected);
+        if(got < 0){
+            return -1;
+        }
+        samples += got;
+    }
+
+    printf("%-14s @ %6u baud: %4u bytes/frame  %7.0f samples/s\n",
+        lc->name, baud, MCTP_DataFrameSize(&hmctp), (double)samples * 1e9 / SIM_TIME);
+    return 0;
+}
+
+static void RunCodec(void){
+    static uint16_t src[SAMPLES * CHANNELS];
+    static uint16_t dst[SAMPLES * CHANNELS];
+    static uint8_t packed[UINT12_SIZE(SAMPLES * CHANNELS)];
+    const uint32_t n = SAMPLES * CHANNELS;
+    uint64_t best_pack = UINT64_MAX;
+    uint64_t best_unpack = UINT64_MAX;
+    uint32_t state = 0xC0DEC;
+
+    for(uint32_t i = 0; i < n; i++){
+        src[i] = Rand(&state) & 0xFFF;
+    }
+    for(int rep = 0; rep < BENCH_REPS; rep++){
+        uint64_t start = Bench_Cycles();
+        for(int i = 0; i < RUNS; i++){
+            MCTP_EncodeUint12(src, packed, n);
+            Bench_Keep(packed[0]);
+        }
+        uint64_t cycles = Bench_Cycles() - start;
+        if(cycles < best_pack){
+            best_pack = cycles;
+        }
+
+        start = Bench_Cycles();
+        for(int i = 0; i < RUNS; i++){
+            MCTP_HostDecodeUint12(packed, sizeof(packed), dst, n);
+            Bench_Keep(dst[0]);
+        }
+        cycles = Bench_Cycles() - start;
+        if(cycles < best_unpack){
+            best_unpack = cycles;
+        }
+    }
+
+    printf("pack %.2f %ss/sample  unpack %.2f %ss/sample%s\n",
+        (double)best_pack / RUNS / n, BENCH_UNIT, (double)best_unpack / RUNS / n, BENCH_UNIT,
+        memcmp(src, dst, sizeof(src)) == 0? "" : "  MISMATCH");
+}
+
+int main(void){
+    static const LinkCase cases[] = {
+        {"uint16 full", DATATYPE_UINT16, false},
+        {"uint12 full", DATATYPE_UINT12, false},
+        {"uint16 compact", DATATYPE_UINT16, true},
+        {"uint12 compact", DATATYPE_UINT12, true},
+    };
+    static const uint32_t bauds[] = {115200, 921600};
+    int status = 0;
+
+    for(unsigned b = 0; b < sizeof(bauds) / sizeof(bauds[0]); b++){
+        for(unsigned c = 0; c < sizeof(cases) / sizeof(cases[0]); c++){
+            if(RunLink(&cases[c], bauds[b]) < 0){
+                printf("%s failed\n", cases[c].name);
+                status = 1;
+            }
+        }
+    }
+    RunCodec();
+
+    return status;
+}
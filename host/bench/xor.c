@@ -0,0 +1,110 @@
+/**
+ * @file xor.c
+ * @brief Compression ratio and cycles per sample of DATATYPE_FLOAT32_XOR
+ * on the waveforms of the tester function generator.
+ *
+ * Each case is a channel buffer of SAMPLES floats from FGen_simple,
+ * encoded by the device encoder MCTP_EncodeXor and decoded back by
+ * MCTP_HostDecodeXor, which must give the same bit patterns. Ratio is
+ * plain FLOAT32 size over encoded size. Random bit patterns show the
+ * bounded expansion of incompressible data.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+#include "fgen.h"
+#include "mctp_codec.h"
+#include "mctp_host.h"
+
+#define SAMPLES 1024
+#define RUNS 200            /* Encodes and decodes timed in each rep */
+
+typedef struct{
+    const char *name;
+    Wave wave;
+    double sampleRate;
+} WaveCase;
+
+static float samples[SAMPLES];
+static float decoded[SAMPLES];
+static uint8_t encoded[XOR_MAX_SIZE(SAMPLES)];
+
+static uint32_t Rand(uint32_t *state){
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static int Run(const char *name){
+    uint64_t best_enc = UINT64_MAX;
+    uint64_t best_dec = UINT64_MAX;
+    uint32_t size = 0;
+
+    for(int rep = 0; rep < BENCH_REPS; rep++){
+        uint64_t start = Bench_Cycles();
+        for(int i = 0; i < RUNS; i++){
+            size = MCTP_EncodeXor(samples, encoded, SAMPLES);
+            Bench_Keep(encoded[size - 1]);
+        }
+        uint64_t cycles = Bench_Cycles() - start;
+        if(cycles < best_enc){
+            best_enc = cycles;
+        }
+
+        start = Bench_Cycles();
+        for(int i = 0; i < RUNS; i++){
+            if(MCTP_HostDecodeXor(encoded, size, decoded, SAMPLES) != SAMPLES){
+                return -1;
+            }
+            Bench_Keep(decoded[SAMPLES - 1]);
+        }
+        cycles = Bench_Cycles() - start;
+        if(cycles < best_dec){
+            best_dec = cycles;
+        }
+    }
+    if(memcmp(samples, decoded, sizeof(samples)) != 0){
+        return -1;
+    }
+
+    printf("%-22s ratio %5.2f  %5u bytes  encode %6.1f %ss/sample  decode %5.1f %ss/sample\n",
+        name, (double)sizeof(samples) / size, size,
+        (double)best_enc / RUNS / SAMPLES, BENCH_UNIT,
+        (double)best_dec / RUNS / SAMPLES, BENCH_UNIT);
+    return 0;
+}
+
+int main(void){
+    static const WaveCase cases[] = {
+        {"sine 50 Hz @ 10 kHz", {WAV_SINE, 50, 10}, 10000},
+        {"sine 1 kHz @ 10 kHz", {WAV_SINE, 1000, 10}, 10000},
+        {"square 50 Hz @ 10 kHz", {WAV_SQUARE, 50, 10}, 10000},
+        {"trig 50 Hz @ 10 kHz", {WAV_TRIG, 50, 10}, 10000},
+        {"trig 1 kHz @ 10 kHz", {WAV_TRIG, 1000, 10}, 10000},
+    };
+    int status = 0;
+
+    for(unsigned c = 0; c < sizeof(cases) / sizeof(cases[0]); c++){
+        FGen_simple(samples, SAMPLES, cases[c].wave, cases[c].sampleRate);
+        if(Run(cases[c].name) < 0){
+            printf("%s failed\n", cases[c].name);
+            status = 1;
+        }
+    }
+
+    uint32_t state = 0xF10A7;
+    for(int i = 0; i < SAMPLES; i++){
+        uint32_t bits = Rand(&state) & 0xBFFFFFFF;    /* No NaN nor infinity */
+        memcpy(&samples[i], &bits, 4);
+    }
+    if(Run("random bits") < 0){
+        printf("random bits failed\n");
+        status = 1;
+    }
+
+    return status;
+}
@@ -0,0 +1,172 @@
+/**
+ * @file zerocopy.c
+ * @brief Cost per DATA frame of MCTP_SendAll_DMA, which copies channels
+ * data into the TX arena, against MCTP_SendAll_ZeroCopy, which sends 
+ * it in place as a chain of segments.
+ *
+ * Device code runs on the simulated HAL. Time is taken both in the 
+ * send call and in the TX interrupts it leads to, which start the 
+ * next segment or buffer. Bytes copied count every frame byte written
+ * by the library: the whole frame for the copy path, header, datainfo
+ * and EOM for the zero-copy path.
+ *
+ * Host memcpy is much faster per byte than on a Cortex-M4, so bytes 
+ * copied weigh more on the device than host cycles show, and so do
+ * interrupts, which cost entry and exit there. Clock overhead is taken
+ * out of each timed interrupt.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+#include "hal_sim.h"
+#include "mctp_api.h"
+
+#define FRAMES 2000
+
+typedef struct{
+    const char *name;
+    int (*send)(MCTP_Handle *hmctp);
+} SendPath;
+
+static UART_HandleTypeDef huart;
+static DMA_HandleTypeDef hdmatx;
+static MCTP_Handle hmctp;
+static uint8_t txArena[2 * (HEADER_SIZE + DATAHEAD_SIZE + MAX_CHANNELS * (DATAINFO_SIZE + 1024) + CRC_SIZE + EOM_SIZE)];
+static uint8_t channelData[MAX_CHANNELS][1024];
+
+static void Signal(E_MCTP_Signal signal){
+}
+
+/*
+ * Cycles taken by a timing of nothing.
+ */
+static uint64_t ClockOverhead(void){
+    uint64_t best = UINT64_MAX;
+
+    for(int i = 0; i < 1000; i++){
+        uint64_t start = Bench_Cycles();
+        uint64_t cycles = Bench_Cycles() - start;
+        if(cycles < best){
+            best = cycles;
+        }
+    }
+    return best;
+}
+
+static int Setup(int channels, uint16_t size){
+    memset(&hmctp, 0, sizeof(hmctp));
+    huart.Init.BaudRate = 921600;
+    hdmatx.Init.Mode = DMA_NORMAL;
+    huart.hdmatx = &hdmatx;
+    HalSim_Init(&huart);
+
+    hmctp.huart = &huart;
+    hmctp.SignalCallback = Signal;
+    hmctp.totalChannels = MAX_CHANNELS;
+    hmctp.rxMode = RXMODE_IT;
+    hmctp.txArena = txArena;
+    hmctp.txArenaSize = sizeof(txArena);
+    if(MCTP_Init(&hmctp) < 0 || MCTP_Start(&hmctp) < 0){
+        return -1;
+    }
+
+    for(int ch = 0; ch < channels; ch++){
+        for(uint16_t i = 0; i < size; i++){
+            channelData[ch][i] = ch * 31 + i;
+        }
+        if(MCTP_EnableChannel(&hmctp, ch, channelData[ch], size, DATATYPE_UINT8) < 0){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Bytes of the zero-copy frame written by the library, not sent in
+ * place from channels.
+ */
+static uint32_t ChainCopied(void){
+    const MCTP_TxChain *chain = &hmctp.txChain;
+    uint32_t copied = 0;
+
+    for(int i = 0; i < chain->count; i++){
+        const uint8_t *ptr = chain->segs[i].ptr;
+        if(ptr >= chain->meta && ptr < chain->meta + sizeof(chain->meta)){
+            copied += chain->segs[i].size;
+        }
+    }
+    return copied;
+}
+
+static int Run(const SendPath *path, int channels, uint16_t size, uint64_t overhead){
+    uint64_t best = UINT64_MAX;
+    uint32_t copied = 0;
+    uint32_t interrupts = 0;
+
+    for(int rep = 0; rep < BENCH_REPS; rep++){
+        if(Setup(channels, size) < 0){
+            return -1;
+        }
+        uint64_t cycles = 0;
+        copied = 0;
+
+        for(int frame = 0; frame < FRAMES; frame++){
+            for(int ch = 0; ch < channels; ch++){
+                MCTP_ClearChannelData(&hmctp, ch);
+                if(MCTP_WriteChannelData(&hmctp, ch, channelData[ch], size) < 0){
+                    return -1;
+                }
+            }
+
+            uint64_t start = Bench_Cycles();
+            int status = path->send(&hmctp);
+            cycles += Bench_Cycles() - start;
+            if(status < 0){
+                return -1;
+            }
+
+            copied += path->send == MCTP_SendAll_ZeroCopy? ChainCopied() : MCTP_DataFrameSize(&hmctp);
+            while(HalSim_TxBusy()){
+                HalSim_Run(100000);
+            }
+        }
+
+        const HalSim_Stats *stats = HalSim_GetStats();
+        interrupts = stats->txCallbacks;
+        cycles += stats->isrTime - (uint64_t)(interrupts + FRAMES) * overhead;
+        if(cycles < best){
+            best = cycles;
+        }
+    }
+
+    printf("%-10s %2d x %4u bytes: %8.1f %ss/frame  %6u bytes copied/frame  %4.1f interrupts/frame\n",
+        path->name, channels, size, (double)best / FRAMES, BENCH_UNIT,
+        copied / FRAMES, (double)interrupts / FRAMES);
+    return 0;
+}
+
+int main(void){
+    static const SendPath paths[] = {
+        {"copy", MCTP_SendAll_DMA},
+        {"zero-copy", MCTP_SendAll_ZeroCopy},
+    };
+    static const struct{
+        int channels;
+        uint16_t size;
+    } cases[] = {{1, 120}, {8, 120}, {8, 1024}, {32, 120}};
+    int status = 0;
+
+    uint64_t overhead = ClockOverhead();
+    HalSim_SetClock(Bench_Cycles);
+    for(unsigned c = 0; c < sizeof(cases) / sizeof(cases[0]); c++){
+        for(int p = 0; p < 2; p++){
+            if(Run(&paths[p], cases[c].channels, cases[c].size, overhead) < 0){
+                printf("%s failed\n", paths[p].name);
+                status = 1;
+            }
+        }
+    }
+
+    return status;
+}
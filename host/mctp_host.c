@@ -0,0 +1,866 @@
+/**
+ * @file mctp_host.c
+ * @brief Controller side decoding of MCTP frames.
+ */
+
+/*
+ * Received bytes are scanned for frames the same way the performer
+ * does: a frame starts on a valid frame type, its size comes from the
+ * header, and it must end with EOM. Anything else is skipped one byte
+ * at a time, which also drops the filler sent in streaming mode.
+ * Frames with HEADER_FLAG_CRC must also match their CRC trailer, so 
+ * a corrupted frame with an intact EOM is skipped the same way.
+ *
+ * With COBS framing, frames end at a delimiter, found with memchr. 
+ * The bytes before it are decoded in place and must be exactly one
+ * frame, so bytes of a broken frame are never scanned for another.
+ *
+ * CRC-32 is the device one, MCTP_Crc32, built without MCTP_USE_HW_CRC
+ * so its table is constant and shared by every thread.
+ *
+ * DATA frames may carry the device time their first samples were 
+ * captured. Sample times are rebuilt from it and the channel sample
+ * period, so they do not depend on when frames arrive.
+ *
+ * SEQUENCE of DATA frames wraps at 255, so it is compared as a signed
+ * distance to the next expected value. Frames ahead mean the ones in
+ * between are missing. Frames behind are either late (reordered) or
+ * repeated, told apart by a bitmap of sequences received.
+ */
+
+#include <string.h>
+#include "mctp_crc.h"
+#include "mctp_host.h"
+
+static const uint8_t eom[EOM_SIZE] = EOM_BYTES;
+
+/* Bit reader. MSB first, bits are taken from the top of <acc> */
+typedef struct{
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t acc;
+    uint32_t n;                 /* Bits in acc */
+} MCTP_BitReader;
+
+static void MCTP_BitFill(MCTP_BitReader *r);
+static bool MCTP_BitGet(MCTP_BitReader *r, uint32_t bits, uint32_t *value);
+static bool MCTP_SeqTest(const MCTP_SeqTracker *tracker, uint8_t sequence);
+static void MCTP_SeqMark(MCTP_SeqTracker *tracker, uint8_t sequence, bool seen);
+static uint32_t MCTP_HostScan(const uint8_t *buf, uint32_t len, uint32_t *skip, MCTP_HostFrame *frame, bool require_crc);
+static int32_t MCTP_HostCheck(const uint8_t *buf, uint32_t len, MCTP_HostFrame *frame, bool require_crc);
+static int32_t MCTP_HostCobsDecode(uint8_t *buf, uint32_t len);
+
+uint32_t MCTP_HostFindFrame(const uint8_t *buf, uint32_t len, uint32_t *skip, MCTP_HostFrame *frame){
+    return MCTP_HostScan(buf, len, skip, frame, false);
+}
+
+uint32_t MCTP_HostFindFrameCrc(const uint8_t *buf, uint32_t len, uint32_t *skip, MCTP_HostFrame *frame){
+    return MCTP_HostScan(buf, len, skip, frame, true);
+}
+
+/*
+ * After a broken frame, scanning goes on inside its bytes, where 
+ * samples may look like a header without HEADER_FLAG_CRC whose EOM
+ * lands on a real one. <require_crc> rejects those.
+ */
+static uint32_t MCTP_HostScan(const uint8_t *buf, uint32_t len, uint32_t *skip, MCTP_HostFrame *frame, bool require_crc){
+    uint32_t start = 0;
+
+    while(start < len){
+        int32_t frame_size = MCTP_HostCheck(&buf[start], len - start, frame, require_crc);
+        if(frame_size > 0){
+            *skip = start;
+            return frame_size;
+        }
+        if(frame_size == 0){
+            break;
+        }
+        /* Not a frame start */
+        start++;
+    }
+
+    *skip = start;
+    return 0;
+}
+
+/*
+ * Checks for a frame at the start of <len> bytes of <buf>, and sets
+ * <frame> if there is one. Returns its size, 0 if more bytes are 
+ * needed, or -1 if no frame starts there.
+ */
+static int32_t MCTP_HostCheck(const uint8_t *buf, uint32_t len, MCTP_HostFrame *frame, bool require_crc){
+    if(buf[0] == FRAMETYPE_NONE || buf[0] >= FRAMETYPE_END){
+        return -1;
+    }
+    if(len < HEADER_SIZE){
+        return 0;
+    }
+
+    uint16_t data_size;
+    memcpy(&data_size, &buf[1], 2);
+    bool crc = buf[3] != HEADER_FILLER && (buf[3] & HEADER_FLAG_CRC);
+    if(require_crc && !crc){
+        return -1;
+    }
+    uint32_t body_size = HEADER_SIZE + data_size;
+    uint32_t frame_size = body_size + (crc? CRC_SIZE : 0) + EOM_SIZE;
+    if(len < frame_size){
+        return 0;
+    }
+    if(memcmp(&buf[frame_size - EOM_SIZE], eom, EOM_SIZE) != 0){
+        return -1;
+    }
+    if(crc){
+        uint32_t expected;
+        memcpy(&expected, &buf[body_size], CRC_SIZE);
+        if(MCTP_HostCrc32(buf, body_size) != expected){
+            /* Corrupted, or not a frame start */
+            return -1;
+        }
+    }
+
+    frame->type = buf[0];
+    frame->flags = buf[3] != HEADER_FILLER? buf[3] : 0;
+    frame->timestamp = 0;
+    if(frame->flags & HEADER_FLAG_TIMESTAMP){
+        memcpy(&frame->timestamp, &buf[4], 4);
+    }
+    frame->dataSize = data_size;
+    frame->data = &buf[HEADER_SIZE];
+    return frame_size;
+}
+
+/*
+ * Frames broken or not decoded whole are counted on <skip> along with
+ * their delimiter.
+ */
+uint32_t MCTP_HostFindFrameCobs(uint8_t *buf, uint32_t len, uint32_t *skip, MCTP_HostFrame *frame){
+    uint32_t start = 0;
+
+    while(start < len){
+        uint8_t *delimiter = memchr(&buf[start], COBS_DELIMITER, len - start);
+        if(!delimiter){
+            break;
+        }
+
+        uint32_t size = delimiter - &buf[start] + 1;
+        int32_t decoded = MCTP_HostCobsDecode(&buf[start], size - 1);
+        if(decoded > 0 && MCTP_HostCheck(&buf[start], decoded, frame, false) == decoded){
+            *skip = start;
+            return size;
+        }
+        start += size;
+    }
+
+    *skip = start;
+    return 0;
+}
+
+/*
+ * Decodes in place <len> bytes of <buf>, up to a delimiter left out.
+ * Returns decoded size, or -1 if a code byte points past the end.
+ */
+static int32_t MCTP_HostCobsDecode(uint8_t *buf, uint32_t len){
+    uint32_t in = 0;
+    uint32_t out = 0;
+
+    while(in < len){
+        uint8_t code = buf[in++];
+        if(len - in < (uint32_t)code - 1){
+            return -1;
+        }
+        memmove(&buf[out], &buf[in], code - 1);
+        out += code - 1;
+        in += code - 1;
+        if(code != 0xFF && in < len){
+            buf[out++] = 0;
+        }
+    }
+
+    return out;
+}
+
+uint32_t MCTP_HostCobsEncode(const uint8_t *frame, uint32_t size, uint8_t *buf, uint32_t buf_size){
+    const uint8_t *end = frame + size;
+    uint8_t *p = buf;
+
+    if(buf_size < COBS_MAX_SIZE(size)){
+        return 0;
+    }
+
+    for(;;){
+        uint32_t left = end - frame;
+        uint32_t run = left < COBS_BLOCK_SIZE? left : COBS_BLOCK_SIZE;
+        const uint8_t *zero = memchr(frame, COBS_DELIMITER, run);
+        if(zero){
+            run = zero - frame;
+        }
+
+        *p = run + 1;
+        memcpy(p + 1, frame, run);
+        p += run + 1;
+        frame += run;
+
+        if(zero){
+            frame++;
+        }else if(run < COBS_BLOCK_SIZE || frame == end){
+            break;
+        }
+    }
+    *p++ = COBS_DELIMITER;
+
+    return p - buf;
+}
+
+uint32_t MCTP_HostCrc32(const void *data, uint32_t size){
+    return MCTP_Crc32(data, size);
+}
+
+uint32_t MCTP_HostBuildFrame(E_MCTP_FrameType frame_type, const uint8_t *data, uint16_t data_size, uint8_t *buf, uint32_t buf_size){
+    uint32_t frame_size = HEADER_SIZE + data_size + EOM_SIZE;
+
+    if(buf_size < frame_size){
+        return 0;
+    }
+
+    buf[0] = frame_type;
+    memcpy(&buf[1], &data_size, 2);
+    memset(&buf[3], HEADER_FILLER, HEADER_SIZE - 3);
+    memcpy(&buf[HEADER_SIZE], data, data_size);
+    memcpy(&buf[HEADER_SIZE + data_size], eom, EOM_SIZE);
+
+    return frame_size;
+}
+
+uint32_t MCTP_HostAddCrc(uint8_t *buf, uint32_t size, uint32_t buf_size){
+    if(size < MIN_FRAME_SIZE){
+        return 0;
+    }
+    if(buf[3] != HEADER_FILLER && (buf[3] & HEADER_FLAG_CRC)){
+        return size;
+    }
+    if(buf_size < size + CRC_SIZE){
+        return 0;
+    }
+
+    uint32_t body_size = size - EOM_SIZE;
+    buf[3] = (buf[3] == HEADER_FILLER? 0 : buf[3]) | HEADER_FLAG_CRC;
+    uint32_t crc = MCTP_HostCrc32(buf, body_size);
+    memcpy(&buf[body_size], &crc, CRC_SIZE);
+    memcpy(&buf[body_size + CRC_SIZE], eom, EOM_SIZE);
+
+    return size + CRC_SIZE;
+}
+
+uint32_t MCTP_HostBuildSync(const uint32_t *rates, uint8_t count, uint8_t *buf, uint32_t buf_size){
+    uint8_t data[1 + 4 * MAX_BAUD_RATES];
+
+    if(count > MAX_BAUD_RATES){
+        return 0;
+    }
+
+    /* Empty SYNC if no rate is offered, as legacy controllers send */
+    data[0] = count;
+    if(count){
+        memcpy(&data[1], rates, 4 * count);
+    }
+    return MCTP_HostBuildFrame(FRAMETYPE_SYNC, data, count? 1 + 4 * count : 0, buf, buf_size);
+}
+
+uint32_t MCTP_HostBuildCredit(E_MCTP_FrameType frame_type, uint16_t frames, uint32_t bytes, uint8_t *buf, uint32_t buf_size){
+    uint8_t data[CREDIT_SIZE];
+
+    memcpy(&data[0], &frames, 2);
+    memcpy(&data[2], &bytes, 4);
+    return MCTP_HostBuildFrame(frame_type, data, CREDIT_SIZE, buf, buf_size);
+}
+
+uint32_t MCTP_HostBuildReliable(uint8_t window, uint16_t frames, uint32_t bytes, uint8_t *buf, uint32_t buf_size){
+    uint8_t data[REQUEST_RELIABLE_SIZE];
+
+    if(window == 0 || window > RELIABLE_MAX_WINDOW){
+        return 0;
+    }
+
+    memcpy(&data[0], &frames, 2);
+    memcpy(&data[2], &bytes, 4);
+    data[CREDIT_SIZE] = window;
+    return MCTP_HostBuildFrame(FRAMETYPE_REQUEST, data, REQUEST_RELIABLE_SIZE, buf, buf_size);
+}
+
+int MCTP_HostSyncResp(const MCTP_HostFrame *frame, uint8_t *n_channels, uint32_t *baud_rate){
+    if(frame->type != FRAMETYPE_SYNC_RESP || frame->dataSize < 1){
+        return -1;
+    }
+
+    *n_channels = frame->data[0];
+    *baud_rate = 0;
+    if(frame->dataSize >= 5){
+        memcpy(baud_rate, &frame->data[1], 4);
+    }
+    return 0;
+}
+
+bool MCTP_HostProbeValid(const MCTP_HostFrame *frame){
+    static const uint8_t pattern[PROBE_SIZE] = PROBE_BYTES;
+
+    return frame->type == FRAMETYPE_PROBE && frame->dataSize == PROBE_SIZE &&
+        memcmp(frame->data, pattern, PROBE_SIZE) == 0;
+}
+
+int MCTP_HostDataSequence(const MCTP_HostFrame *frame, uint8_t *sequence){
+    int status = 0;
+
+    if(frame->type != FRAMETYPE_DATA || frame->dataSize < DATAHEAD_SIZE){
+        status = -1;
+        goto exit;
+    }
+    *sequence = frame->data[0];
+
+exit:
+    return status;
+}
+
+int MCTP_HostSchemaUpdate(MCTP_HostSchema *schema, const MCTP_HostFrame *frame){
+    int status = 0;
+
+    if(frame->type != FRAMETYPE_SCHEMA || frame->dataSize < 2){
+        status = -1;
+        goto exit;
+    }
+
+    /* Channels are overwritten while parsing */
+    schema->valid = false;
+    uint32_t offset = 2;
+    uint8_t count = frame->data[1];
+    for(int i = 0; i < count; i++){
+        MCTP_HostChannel *channel = &schema->channels[i];
+        if(frame->dataSize - offset < DATAINFO_SIZE){
+            status = -1;
+            goto exit;
+        }
+        const uint8_t *info = &frame->data[offset];
+        channel->channelId = info[0];
+        memcpy(&channel->size, &info[1], 2);
+        channel->dataType = info[3];
+        channel->scale = 1.0f;
+        channel->offset = 0.0f;
+        channel->samples = NULL;
+        offset += DATAINFO_SIZE;
+
+        if(DATATYPE_IS_SCALED(channel->dataType)){
+            if(frame->dataSize - offset < SCALEINFO_SIZE){
+                status = -1;
+                goto exit;
+            }
+            memcpy(&channel->scale, &frame->data[offset], 4);
+            memcpy(&channel->offset, &frame->data[offset + 4], 4);
+            offset += SCALEINFO_SIZE;
+        }
+    }
+    if(offset != frame->dataSize){
+        status = -1;
+        goto exit;
+    }
+
+    schema->id = frame->data[0];
+    schema->count = count;
+    schema->valid = true;
+
+exit:
+    return status;
+}
+
+/*
+ * Records are walked by size, so channels with no data, which the
+ * performer leaves out, need no special care. Frames following schema 
+ * hold samples of every schema channel back to back.
+ */
+int MCTP_HostNextChannel(const MCTP_HostFrame *frame, const MCTP_HostSchema *schema, uint32_t *offset, MCTP_HostChannel *channel){
+    if(frame->type != FRAMETYPE_DATA || frame->dataSize < DATAHEAD_SIZE){
+        return -1;
+    }
+    if(*offset < DATAHEAD_SIZE){
+        *offset = DATAHEAD_SIZE;
+    }
+    if(*offset == frame->dataSize){
+        return 0;
+    }
+
+    if(frame->flags & HEADER_FLAG_SCHEMA){
+        if(!schema || !schema->valid || schema->id != frame->data[1]){
+            return -1;
+        }
+        uint32_t start = DATAHEAD_SIZE;
+        for(int i = 0; i < schema->count; i++){
+            if(schema->channels[i].size == 0){
+                /* Never in frame */
+                continue;
+            }
+            if(start == *offset){
+                if(frame->dataSize - start < schema->channels[i].size){
+                    return -1;
+                }
+                *channel = schema->channels[i];
+                channel->samples = &frame->data[start];
+                *offset += channel->size;
+                return 1;
+            }
+            start += schema->channels[i].size;
+        }
+        return -1;
+    }
+
+    if(frame->dataSize - *offset < DATAINFO_SIZE){
+        return -1;
+    }
+
+    const uint8_t *info = &frame->data[*offset];
+    channel->channelId = info[0];
+    memcpy(&channel->size, &info[1], 2);
+    channel->dataType = info[3];
+    channel->scale = 1.0f;
+    channel->offset = 0.0f;
+    if(frame->dataSize - *offset - DATAINFO_SIZE < channel->size){
+        return -1;
+    }
+    if(schema && schema->valid && DATATYPE_IS_SCALED(channel->dataType)){
+        for(int i = 0; i < schema->count; i++){
+            if(schema->channels[i].channelId == channel->channelId){
+                channel->scale = schema->channels[i].scale;
+                channel->offset = schema->channels[i].offset;
+                break;
+            }
+        }
+    }
+    channel->samples = info + DATAINFO_SIZE;
+    *offset += DATAINFO_SIZE + channel->size;
+
+    return 1;
+}
+
+/*
+ * Half precision bits shifted into place are a float 2^112 times too
+ * small, subnormals included, so a multiply rebiases the exponent. 
+ * Infinity and NaN only need their exponent saturated. The loop has 
+ * no branches, and is vectorized by gcc -O3.
+ */
+void MCTP_HostDecodeFloat16(const uint8_t *restrict src, float *restrict dst, uint32_t n){
+    const float rebias = 0x1p112f;
+
+    for(size_t i = 0; i < n; i++){
+        uint32_t h = src[2 * i] | (uint32_t)src[2 * i + 1] << 8;
+        uint32_t bits = (h & 0x7FFF) << 13;
+        float f;
+
+        memcpy(&f, &bits, 4);
+        f *= rebias;
+        memcpy(&bits, &f, 4);
+        bits |= (h & 0x7C00) == 0x7C00? 255u << 23 : 0;
+        bits |= (h & 0x8000) << 16;
+        memcpy(&dst[i], &bits, 4);
+    }
+}
+
+void MCTP_HostDecodeQ15(const uint8_t *restrict src, float *restrict dst, uint32_t n, float scale, float offset){
+    float gain = scale / 32768.0f;
+
+    for(size_t i = 0; i < n; i++){
+        int16_t q = (int16_t)(src[2 * i] | src[2 * i + 1] << 8);
+        dst[i] = q * gain + offset;
+    }
+}
+
+void MCTP_HostDecodeQ7(const uint8_t *restrict src, float *restrict dst, uint32_t n, float scale, float offset){
+    float gain = scale / 128.0f;
+
+    for(size_t i = 0; i < n; i++){
+        dst[i] = (int8_t)src[i] * gain + offset;
+    }
+}
+
+/*
+ * Bit reader is refilled once per sample, since a sample takes at 
+ * most 44 bits.
+ */
+int32_t MCTP_HostDecodeXor(const uint8_t *src, uint32_t size, float *dst, uint32_t max){
+    uint32_t count = 0;
+    uint32_t prev = 0;
+    uint32_t offset = 0;
+
+    while(offset < size){
+        uint8_t head = src[offset++];
+        uint32_t n = (head & ~XOR_BLOCK_RAW) + 1;
+        if(max - count < n){
+            return -1;
+        }
+
+        if(head & XOR_BLOCK_RAW){
+            if(size - offset < 4 * n){
+                return -1;
+            }
+            memcpy(&dst[count], &src[offset], 4 * n);
+            memcpy(&prev, &src[offset + 4 * (n - 1)], 4);
+            offset += 4 * n;
+            count += n;
+            continue;
+        }
+
+        MCTP_BitReader r = {&src[offset], &src[size], 0, 0};
+        uint32_t lead = 0;
+        uint32_t len = 0;           /* 0 for no window */
+        for(uint32_t i = 0; i < n; i++){
+            uint32_t ctrl, x = 0;
+            MCTP_BitFill(&r);
+            if(!MCTP_BitGet(&r, 1, &ctrl)){
+                return -1;
+            }
+            if(ctrl){
+                if(!MCTP_BitGet(&r, 1, &ctrl)){
+                    return -1;
+                }
+                if(ctrl){
+                    uint32_t window;
+                    if(!MCTP_BitGet(&r, 10, &window)){
+                        return -1;
+                    }
+                    lead = window >> 5;
+                    len = (window & 0x1F) + 1;
+                    if(lead + len > 32){
+                        return -1;
+                    }
+                }else if(len == 0){
+                    return -1;
+                }
+                if(!MCTP_BitGet(&r, len, &x)){
+                    return -1;
+                }
+                x <<= 32 - lead - len;
+            }
+            prev ^= x;
+            memcpy(&dst[count++], &prev, 4);
+        }
+        /* Whole bytes left in reader belong to next block. Less is padding */
+        offset = (r.p - src) - r.n / 8;
+    }
+
+    return count;
+}
+
+/*
+ * Tops up <r> to at least 57 bits, or to the end of its bytes.
+ */
+static void MCTP_BitFill(MCTP_BitReader *r){
+    while(r->n <= 56 && r->p < r->end){
+        r->acc |= (uint64_t)*r->p++ << (56 - r->n);
+        r->n += 8;
+    }
+}
+
+/*
+ * Takes <bits>, 1 to 32, from <r>.
+ */
+static bool MCTP_BitGet(MCTP_BitReader *r, uint32_t bits, uint32_t *value){
+    if(r->n < bits){
+        return false;
+    }
+    *value = r->acc >> (64 - bits);
+    r->acc <<= bits;
+    r->n -= bits;
+    return true;
+}
+
+/*
+ * Most deltas are a single varint byte, which is the first test of 
+ * the loop.
+ */
+int32_t MCTP_HostDecodeDelta(const uint8_t *src, uint32_t size, E_MCTP_DataType data_type, uint8_t *dst, uint32_t max){
+    uint32_t width;
+    uint32_t count = 0;
+    uint32_t offset = 0;
+
+    if(!(data_type & DATATYPE_DELTA)){
+        return -1;
+    }
+    switch(DATATYPE_BASE(data_type)){
+        case DATATYPE_INT16:
+        case DATATYPE_UINT16:
+            width = 2;
+            break;
+        case DATATYPE_INT32:
+        case DATATYPE_UINT32:
+            width = 4;
+            break;
+        default:
+            return -1;
+    }
+    uint32_t mask = width == 4? 0xFFFFFFFF : 0xFFFF;
+
+    while(offset < size){
+        uint8_t head = src[offset++];
+        uint32_t n = (head & ~DELTA_BLOCK_RAW) + 1;
+        if(max - count < n || size - offset < width){
+            return -1;
+        }
+        uint8_t *out = &dst[count * width];
+
+        if(head & DELTA_BLOCK_RAW){
+            if(size - offset < n * width){
+                return -1;
+            }
+            memcpy(out, &src[offset], n * width);
+            offset += n * width;
+            count += n;
+            continue;
+        }
+
+        uint32_t x = 0;
+        memcpy(&x, &src[offset], width);
+        memcpy(out, &x, width);
+        offset += width;
+        for(uint32_t i = 1; i < n; i++){
+            uint32_t z;
+            if(offset < size && src[offset] < 0x80){
+                z = src[offset++];
+            }else{
+                z = 0;
+                for(uint32_t s = 0; ; s += 7){
+                    if(offset == size || s > 28){
+                        return -1;
+                    }
+                    uint8_t b = src[offset++];
+                    z |= (uint32_t)(b & 0x7F) << s;
+                    if(b < 0x80){
+                        break;
+                    }
+                }
+            }
+            x = (x + ((z >> 1) ^ (0 - (z & 1)))) & mask;
+            memcpy(&out[i * width], &x, width);
+        }
+        count += n;
+    }
+
+    return count;
+}
+
+/*
+ * Pairs are unpacked with no dependency between them, which compilers
+ * vectorize.
+ */
+int32_t MCTP_HostDecodeUint12(const uint8_t *restrict src, uint32_t size, uint16_t *restrict dst, uint32_t max){
+    size_t pairs = size / 3;
+    uint32_t n = 2 * pairs + (size % 3 == 2);
+
+    if(size % 3 == 1 || n > max){
+        return -1;
+    }
+
+    for(size_t i = 0; i < pairs; i++){
+        uint32_t b0 = src[3 * i];
+        uint32_t b1 = src[3 * i + 1];
+        uint32_t b2 = src[3 * i + 2];
+        dst[2 * i] = b0 | (b1 & 0xF) << 8;
+        dst[2 * i + 1] = b1 >> 4 | b2 << 4;
+    }
+    if(size % 3 == 2){
+        dst[n - 1] = src[3 * pairs] | (src[3 * pairs + 1] & 0xF) << 8;
+    }
+
+    return n;
+}
+
+void MCTP_HostClockInit(MCTP_HostClock *clock){
+    memset(clock, 0, sizeof(MCTP_HostClock));
+}
+
+/*
+ * Timestamps are extended by their signed distance to the latest one,
+ * which handles both counter wrap and frames arriving late.
+ */
+int MCTP_HostSampleTime(MCTP_HostClock *clock, const MCTP_HostFrame *frame, uint32_t index, double period_us, double *time_us){
+    int status = 0;
+
+    if(!(frame->flags & HEADER_FLAG_TIMESTAMP)){
+        status = -1;
+        goto exit;
+    }
+
+    int64_t timestamp = frame->timestamp;
+    if(clock->started){
+        timestamp = clock->last + (int32_t)(frame->timestamp - (uint32_t)clock->last);
+    }
+    if(!clock->started || timestamp > clock->last){
+        clock->last = timestamp;
+    }
+    clock->started = true;
+
+    *time_us = (double)timestamp + index * period_us;
+
+exit:
+    return status;
+}
+
+void MCTP_HostReassemblyInit(MCTP_HostReassembler *r, uint8_t *buf, uint32_t capacity){
+    memset(r, 0, sizeof(MCTP_HostReassembler));
+    r->buf = buf;
+    r->capacity = capacity;
+}
+
+/*
+ * Fragment 0 always starts a new frame, dropping any frame in progress.
+ */
+int MCTP_HostReassemble(MCTP_HostReassembler *r, const MCTP_HostFrame *fragment, MCTP_HostFrame *frame){
+    int status = 0;
+
+    if(!(fragment->flags & HEADER_FLAG_FRAGMENT) || fragment->dataSize < FRAGHEAD_SIZE){
+        status = -1;
+        goto exit;
+    }
+
+    const uint8_t *p = fragment->data;
+    uint16_t index = p[0] | (p[1] << 8);
+    uint16_t count = p[2] | (p[3] << 8);
+    uint32_t piece_size = fragment->dataSize - FRAGHEAD_SIZE;
+
+    if(index == 0){
+        if(r->active){
+            r->dropped++;
+        }
+        r->active = true;
+        r->size = 0;
+        r->next = 0;
+        r->count = count;
+        r->type = fragment->type;
+        r->flags = fragment->flags & ~HEADER_FLAG_FRAGMENT;
+        r->timestamp = fragment->timestamp;
+    }
+
+    if(!r->active){
+        /* Rest of a frame already dropped */
+        status = -1;
+        goto exit;
+    }
+    if(index != r->next || count != r->count || fragment->type != r->type ||
+            index >= count || r->capacity - r->size < piece_size){
+        r->active = false;
+        r->dropped++;
+        status = -1;
+        goto exit;
+    }
+
+    memcpy(&r->buf[r->size], &p[FRAGHEAD_SIZE], piece_size);
+    r->size += piece_size;
+    r->next++;
+
+    if(r->next == r->count){
+        r->active = false;
+        frame->type = r->type;
+        frame->flags = r->flags;
+        frame->timestamp = r->timestamp;
+        frame->dataSize = r->size;
+        frame->data = r->buf;
+        status = 1;
+    }
+
+exit:
+    return status;
+}
+
+void MCTP_HostReliableInit(MCTP_HostReliable *r){
+    memset(r, 0, sizeof(MCTP_HostReliable));
+}
+
+/*
+ * Window is at most RELIABLE_MAX_WINDOW frames, so SEQUENCE behind 
+ * <next> by up to half the SEQUENCE space is a retransmission of a 
+ * frame already acknowledged.
+ */
+int MCTP_HostReliableReceive(MCTP_HostReliable *r, uint8_t sequence){
+    uint8_t offset = sequence - r->next;
+
+    if(offset == 0){
+        /* Slide window past every frame received in a row */
+        r->next++;
+        while(r->sack & 1){
+            r->next++;
+            r->sack >>= 1;
+        }
+        r->sack >>= 1;
+        r->received++;
+        return 1;
+    }
+
+    if(offset <= RELIABLE_MAX_WINDOW){
+        uint32_t bit = 1UL << (offset - 1);
+        if(r->sack & bit){
+            r->duplicated++;
+            return 0;
+        }
+        r->sack |= bit;
+        r->received++;
+        return 1;
+    }
+
+    if(offset >= 128){
+        r->duplicated++;
+        return 0;
+    }
+    return -1;
+}
+
+uint32_t MCTP_HostBuildDataAck(const MCTP_HostReliable *r, uint8_t *buf, uint32_t buf_size){
+    uint8_t data[DATAACK_SIZE];
+
+    data[0] = r->next;
+    memcpy(&data[1], &r->sack, 4);
+    return MCTP_HostBuildFrame(FRAMETYPE_DATA_ACK, data, DATAACK_SIZE, buf, buf_size);
+}
+
+void MCTP_SeqInit(MCTP_SeqTracker *tracker){
+    memset(tracker, 0, sizeof(MCTP_SeqTracker));
+}
+
+void MCTP_SeqUpdate(MCTP_SeqTracker *tracker, uint8_t sequence){
+    tracker->received++;
+
+    if(!tracker->started){
+        /* Anything before first frame counts as already seen */
+        memset(tracker->seen, 0xFF, sizeof(tracker->seen));
+        tracker->started = true;
+        tracker->expected = sequence + 1;
+        return;
+    }
+
+    uint8_t ahead = sequence - tracker->expected;
+    if(ahead < 128){
+        /* In order, or after a gap */
+        for(uint8_t s = tracker->expected; s != sequence; s++){
+            MCTP_SeqMark(tracker, s, false);
+        }
+        tracker->lost += ahead;
+        MCTP_SeqMark(tracker, sequence, true);
+        tracker->expected = sequence + 1;
+
+    }else if(MCTP_SeqTest(tracker, sequence)){
+        tracker->duplicated++;
+
+    }else{
+        /* Late frame, counted lost when skipped */
+        tracker->lost--;
+        tracker->reordered++;
+        MCTP_SeqMark(tracker, sequence, true);
+    }
+}
+
+static bool MCTP_SeqTest(const MCTP_SeqTracker *tracker, uint8_t sequence){
+    return tracker->seen[sequence / 8] & (1 << (sequence % 8));
+}
+
+static void MCTP_SeqMark(MCTP_SeqTracker *tracker, uint8_t sequence, bool seen){
+    if(seen){
+        tracker->seen[sequence / 8] |= 1 << (sequence % 8);
+    }else{
+        tracker->seen[sequence / 8] &= ~(1 << (sequence % 8));
+    }
+}
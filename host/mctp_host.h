@@ -0,0 +1,387 @@
+/**
+ * @file mctp_host.h
+ * @brief Controller side decoding of MCTP frames.
+ *
+ * Baud rate negotiation, from the controller:
+ * 1. Send SYNC built by MCTP_HostBuildSync with the rates the port 
+ *    supports, at the initial rate.
+ * 2. On SYNC_RESP, read the agreed rate with MCTP_HostSyncResp. Wait
+ *    for SCHEMA, then send ACK. If the rate is the current one, the
+ *    session is connected.
+ * 3. Otherwise, once ACK is sent, switch the port and send PROBE 
+ *    frames until one comes back valid (MCTP_HostProbeValid), then 
+ *    send ACK again.
+ * 4. If no PROBE comes back within BAUD_PROBE_TIMEOUT, switch back to
+ *    the initial rate and start over with SYNC, leaving out the rate 
+ *    that failed. The performer falls back on its own.
+ * DROP returns both sides to the initial rate.
+ *
+ * Flow control: REQUEST built by MCTP_HostBuildCredit grants the 
+ * performer a number of DATA frames and bytes. Granting one more 
+ * frame (CREDIT) per DATA frame consumed keeps at most that many
+ * frames, plus one held, between performer and controller, however
+ * slow the controller is.
+ *
+ * Reliable mode: REQUEST built by MCTP_HostBuildReliable asks the 
+ * performer to keep up to WINDOW DATA frames until acknowledged. SEQUENCE
+ * restarts at 0. Feed each DATA frame SEQUENCE to MCTP_HostReliableReceive,
+ * with the receiver reset by MCTP_HostReliableInit, and answer with the 
+ * DATA_ACK built by MCTP_HostBuildDataAck. Frames lost are sent again, 
+ * so DATA frames may come out of SEQUENCE order, never twice. Only 
+ * performers with crcEnabled offer it, and they ignore every frame 
+ * without CRC meanwhile (see MCTP_HostAddCrc).
+ *
+ * Integrity: performers with crcEnabled send every frame with a CRC-32
+ * trailer and HEADER_FLAG_CRC. Once SYNC_RESP shows the flag, look for
+ * frames with MCTP_HostFindFrameCrc, and add the trailer with 
+ * MCTP_HostAddCrc to every frame built, which the performer then 
+ * checks. CRC covers each direction only if that side adds it: frames
+ * sent without it are only checked by size and EOM. Until receivers
+ * checked it, CRC was one-way, performer to controller only, and such
+ * performers drop frames with a trailer as too long.
+ *
+ * COBS framing: performers with cobsEnabled send and expect frames COBS
+ * encoded and delimited by COBS_DELIMITER. Encode every frame built 
+ * with MCTP_HostCobsEncode, and look for frames with 
+ * MCTP_HostFindFrameCobs.
+ *
+ * Plain C, with no HAL dependency. Build with the MCTP include 
+ * directory in the include path:
+ *
+ * cc -I../stm32/stm32f3/include -c mctp_host.c
+ */
+#ifndef MCTP_HOST_H
+#define MCTP_HOST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mctp_protocol.h"
+
+/*
+ * Frame found in a received byte stream. <data> points to DATA section
+ * inside the caller buffer.
+ */
+typedef struct{
+    E_MCTP_FrameType type;
+    uint8_t flags;              /* HEADER_FLAG_ bits. 0 for legacy filler */
+    uint32_t timestamp;         /* Valid if HEADER_FLAG_TIMESTAMP is set */
+    uint32_t dataSize;
+    const uint8_t *data;
+} MCTP_HostFrame;
+
+/*
+ * Channel record of a DATA frame. <samples> points inside the frame.
+ * <scale> and <offset> of fixed point channels come from the schema,
+ * and are 1 and 0 if it is unknown.
+ */
+typedef struct{
+    uint8_t channelId;
+    uint16_t size;
+    E_MCTP_DataType dataType;
+    float scale;
+    float offset;
+    const uint8_t *samples;
+} MCTP_HostChannel;
+
+/*
+ * Channel list announced by the performer in its last SCHEMA frame.
+ * Needed to read DATA frames with HEADER_FLAG_SCHEMA, which carry no
+ * datainfo. Channels <size> is their full buffer size.
+ */
+typedef struct{
+    bool valid;
+    uint8_t id;
+    uint8_t count;
+    MCTP_HostChannel channels[256];
+} MCTP_HostSchema;
+
+/*
+ * DATA frames SEQUENCE accounting over one session. A frame missing 
+ * is counted lost until it shows up later, then it is counted 
+ * reordered instead. Frames seen twice are counted duplicated.
+ * Only frames up to 128 sequences late are told apart.
+ */
+typedef struct{
+    bool started;
+    uint8_t expected;           /* SEQUENCE of next frame in order */
+    uint8_t seen[32];           /* Bit per SEQUENCE, set when received */
+    uint32_t received;
+    uint32_t lost;
+    uint32_t duplicated;
+    uint32_t reordered;
+} MCTP_SeqTracker;
+
+/*
+ * Device clock, extended to 64 bits. Device timestamps wrap every 
+ * 71 minutes. Successive timestamps must be less than half that apart.
+ */
+typedef struct{
+    bool started;
+    int64_t last;               /* Latest timestamp, extended */
+} MCTP_HostClock;
+
+/*
+ * Frame being rebuilt from its fragments into caller <buf>. Fragments
+ * out of order, missing or beyond <capacity> drop the frame, counted 
+ * on <dropped>.
+ */
+typedef struct{
+    uint8_t *buf;
+    uint32_t capacity;
+    uint32_t size;
+    bool active;
+    uint16_t next;              /* FRAGMENT_INDEX expected */
+    uint16_t count;
+    E_MCTP_FrameType type;
+    uint8_t flags;
+    uint32_t timestamp;
+    uint32_t dropped;
+} MCTP_HostReassembler;
+
+/*
+ * Receive window of reliable mode. Bit i of <sack> is set when 
+ * SEQUENCE <next> + 1 + i was received.
+ */
+typedef struct{
+    uint8_t next;               /* SEQUENCE of first frame missing */
+    uint32_t sack;
+    uint32_t received;
+    uint32_t duplicated;
+} MCTP_HostReliable;
+
+/*
+ * Looks for the first whole frame in <len> bytes of <buf>. Bytes 
+ * before it (filler, noise or broken frames) are counted on <skip>
+ * and may be discarded. <frame> is set when a frame is found.
+ * Frames with HEADER_FLAG_CRC are only found if their CRC matches.
+ *
+ * Returns frame size, starting at <buf> + <skip>, or 0 if more bytes
+ * are needed
+ */
+uint32_t MCTP_HostFindFrame(const uint8_t *buf, uint32_t len, uint32_t *skip, MCTP_HostFrame *frame);
+
+/*
+ * Same as MCTP_HostFindFrame, but only finds frames with a valid CRC.
+ * For performers known to send CRC, once SYNC_RESP came with 
+ * HEADER_FLAG_CRC, so no corrupted frame is ever returned.
+ */
+uint32_t MCTP_HostFindFrameCrc(const uint8_t *buf, uint32_t len, uint32_t *skip, MCTP_HostFrame *frame);
+
+/*
+ * Looks for the first whole COBS encoded frame in <len> bytes of 
+ * <buf>, and decodes it in place, so <frame> data points inside <buf>.
+ * Bytes before it (empty or broken frames) are counted on <skip> and 
+ * may be discarded. A broken frame only costs the bytes up to its 
+ * delimiter.
+ *
+ * Returns size of the encoded frame and its delimiter, starting at 
+ * <buf> + <skip>, or 0 if more bytes are needed
+ */
+uint32_t MCTP_HostFindFrameCobs(uint8_t *buf, uint32_t len, uint32_t *skip, MCTP_HostFrame *frame);
+
+/*
+ * COBS encodes the <size> bytes <frame> into <buf>, followed by the 
+ * delimiter, to send it to a performer with cobsEnabled. <buf> must
+ * hold COBS_MAX_SIZE(<size>) bytes.
+ *
+ * Returns encoded size, or 0 if <buf> is too small
+ */
+uint32_t MCTP_HostCobsEncode(const uint8_t *frame, uint32_t size, uint8_t *buf, uint32_t buf_size);
+
+/*
+ * CRC-32 of <size> bytes of <data>, as in the trailer of frames with
+ * HEADER_FLAG_CRC (zlib crc32). Same as MCTP_Crc32 of the device,
+ * whose mctp_crc.c must be built along, without MCTP_USE_HW_CRC.
+ */
+uint32_t MCTP_HostCrc32(const void *data, uint32_t size);
+
+/*
+ * Writes a frame of <frame_type> with <data_size> bytes of <data> as
+ * DATA section to <buf>.
+ *
+ * Returns frame size, or 0 if it doesn't fit <buf_size>
+ */
+uint32_t MCTP_HostBuildFrame(E_MCTP_FrameType frame_type, const uint8_t *data, uint16_t data_size, uint8_t *buf, uint32_t buf_size);
+
+/*
+ * Adds a CRC-32 trailer to the frame of <size> bytes in <buf>, as 
+ * built by the MCTP_HostBuild functions, and sets HEADER_FLAG_CRC.
+ * Frames which already have it are left as they are.
+ *
+ * Returns new frame size, or 0 if it doesn't fit <buf_size>
+ */
+uint32_t MCTP_HostAddCrc(uint8_t *buf, uint32_t size, uint32_t buf_size);
+
+/*
+ * Writes a SYNC frame offering <count> baud <rates> to <buf>. With no
+ * rates, the current rate is kept.
+ *
+ * Returns frame size, or 0 if it doesn't fit <buf_size> or <count> is
+ * above MAX_BAUD_RATES
+ */
+uint32_t MCTP_HostBuildSync(const uint32_t *rates, uint8_t count, uint8_t *buf, uint32_t buf_size);
+
+/*
+ * Writes a REQUEST or CREDIT frame, of <frame_type>, granting <frames>
+ * DATA frames and <bytes> to <buf>. CREDIT_FRAMES_UNLIMITED and 
+ * CREDIT_BYTES_UNLIMITED lift a limit.
+ *
+ * Returns frame size, or 0 if it doesn't fit <buf_size>
+ */
+uint32_t MCTP_HostBuildCredit(E_MCTP_FrameType frame_type, uint16_t frames, uint32_t bytes, uint8_t *buf, uint32_t buf_size);
+
+/*
+ * Writes a REQUEST frame enabling reliable mode with a window of 
+ * <window> DATA frames, up to RELIABLE_MAX_WINDOW, and granting credit
+ * as MCTP_HostBuildCredit to <buf>.
+ *
+ * Returns frame size, or 0 if it doesn't fit <buf_size> or <window> is
+ * not valid
+ */
+uint32_t MCTP_HostBuildReliable(uint8_t window, uint16_t frames, uint32_t bytes, uint8_t *buf, uint32_t buf_size);
+
+/*
+ * Reads SYNC_RESP <frame>. <baud_rate> is the rate agreed by the 
+ * performer, or 0 if it is a legacy performer that never changes it.
+ *
+ * Returns 0 on success and -1 if frame is not a valid SYNC_RESP
+ */
+int MCTP_HostSyncResp(const MCTP_HostFrame *frame, uint8_t *n_channels, uint32_t *baud_rate);
+
+/*
+ * Returns true if <frame> is a PROBE frame received intact.
+ */
+bool MCTP_HostProbeValid(const MCTP_HostFrame *frame);
+
+/*
+ * SEQUENCE of DATA <frame>.
+ *
+ * Returns 0 on success and -1 if <frame> is not a DATA frame
+ */
+int MCTP_HostDataSequence(const MCTP_HostFrame *frame, uint8_t *sequence);
+
+/*
+ * Stores channel list of SCHEMA <frame> in <schema>. Must be called
+ * for every SCHEMA frame received.
+ *
+ * Returns 0 on success and -1 if frame is not a valid SCHEMA frame. 
+ * <schema> is left invalid if the frame is malformed
+ */
+int MCTP_HostSchemaUpdate(MCTP_HostSchema *schema, const MCTP_HostFrame *frame);
+
+/*
+ * Reads channel record at <offset> of DATA <frame> section into 
+ * <channel>, and moves <offset> to the next one. <offset> must be 0
+ * for the first record. Frames following a schema are read with 
+ * <schema>, which may be NULL otherwise. Scale and offset of fixed 
+ * point channels are only known with <schema>.
+ *
+ * Returns 1 if a record was read, 0 after the last one and -1 if 
+ * frame is malformed or its schema is unknown
+ */
+int MCTP_HostNextChannel(const MCTP_HostFrame *frame, const MCTP_HostSchema *schema, uint32_t *offset, MCTP_HostChannel *channel);
+
+/*
+ * Decodes <n> DATATYPE_FLOAT16 samples of <src>, as found in channel
+ * records, to floats on <dst>.
+ */
+void MCTP_HostDecodeFloat16(const uint8_t *restrict src, float *restrict dst, uint32_t n);
+
+/*
+ * Decodes <n> DATATYPE_Q15 or DATATYPE_Q7 samples of <src> to floats
+ * on <dst>, with <scale> and <offset> of their channel.
+ */
+void MCTP_HostDecodeQ15(const uint8_t *restrict src, float *restrict dst, uint32_t n, float scale, float offset);
+void MCTP_HostDecodeQ7(const uint8_t *restrict src, float *restrict dst, uint32_t n, float scale, float offset);
+
+/*
+ * Decodes DATATYPE_FLOAT32_XOR samples of <size> bytes at <src> to 
+ * floats on <dst>, which holds up to <max> samples.
+ *
+ * Returns number of samples decoded, or -1 if samples are malformed
+ * or more than <max>
+ */
+int32_t MCTP_HostDecodeXor(const uint8_t *src, uint32_t size, float *dst, uint32_t max);
+
+/*
+ * Decodes delta coded samples (DATATYPE_DELTA set in <data_type>) of 
+ * <size> bytes at <src> to plain little-endian samples on <dst>, 
+ * which holds up to <max> samples.
+ *
+ * Returns number of samples decoded, or -1 if samples are malformed
+ * or more than <max>
+ */
+int32_t MCTP_HostDecodeDelta(const uint8_t *src, uint32_t size, E_MCTP_DataType data_type, uint8_t *dst, uint32_t max);
+
+/*
+ * Unpacks DATATYPE_UINT12 samples of <size> bytes at <src> to <dst>,
+ * which holds up to <max> samples.
+ *
+ * Returns number of samples unpacked, or -1 if size is not valid or
+ * samples are more than <max>
+ */
+int32_t MCTP_HostDecodeUint12(const uint8_t *restrict src, uint32_t size, uint16_t *restrict dst, uint32_t max);
+
+/*
+ * Resets <clock> for a new session.
+ */
+void MCTP_HostClockInit(MCTP_HostClock *clock);
+
+/*
+ * Resets <r> to rebuild frames into <capacity> bytes of <buf>.
+ */
+void MCTP_HostReassemblyInit(MCTP_HostReassembler *r, uint8_t *buf, uint32_t capacity);
+
+/*
+ * Adds <fragment> (frame with HEADER_FLAG_FRAGMENT) to <r>. Once the 
+ * last fragment is in, <frame> is set to the whole frame, with <data>
+ * inside <r> buffer, valid until next call. Flags and timestamp are 
+ * those of the first fragment. 
+ * The DATA section of BURST frames is CHANNEL_ID, DATA_FORMAT, then
+ * samples.
+ *
+ * Returns 1 if <frame> is complete, 0 if more fragments are needed
+ * and -1 if frame was dropped
+ */
+int MCTP_HostReassemble(MCTP_HostReassembler *r, const MCTP_HostFrame *fragment, MCTP_HostFrame *frame);
+
+/*
+ * Resets <r> for reliable mode, on REQUEST.
+ */
+void MCTP_HostReliableInit(MCTP_HostReliable *r);
+
+/*
+ * Adds DATA frame <sequence> to <r>.
+ *
+ * Returns 1 if frame is new, 0 if it was already received and must be
+ * discarded, and -1 if it is beyond the window
+ */
+int MCTP_HostReliableReceive(MCTP_HostReliable *r, uint8_t sequence);
+
+/*
+ * Writes the DATA_ACK frame for the current state of <r> to <buf>.
+ *
+ * Returns frame size, or 0 if it doesn't fit <buf_size>
+ */
+uint32_t MCTP_HostBuildDataAck(const MCTP_HostReliable *r, uint8_t *buf, uint32_t buf_size);
+
+/*
+ * Device time, in us, of sample <index> of a channel in <frame>, for
+ * a channel sampled every <period_us>. First sample is at frame 
+ * timestamp. Timestamps must be fed in order of arrival.
+ *
+ * Returns 0 on success and -1 if frame has no timestamp
+ */
+int MCTP_HostSampleTime(MCTP_HostClock *clock, const MCTP_HostFrame *frame, uint32_t index, double period_us, double *time_us);
+
+/*
+ * Resets <tracker> for a new session, after SYNC.
+ */
+void MCTP_SeqInit(MCTP_SeqTracker *tracker);
+
+/*
+ * Accounts DATA frame of <sequence> on <tracker>.
+ */
+void MCTP_SeqUpdate(MCTP_SeqTracker *tracker, uint8_t sequence);
+
+#endif
@@ -0,0 +1,455 @@
+/**
+ * @file hal_sim.c
+ * @brief Simulated UART behind the host HAL.
+ */
+
+/*
+ * The simulation is event driven. Pending events are the arrival of
+ * the next byte sent by the peer, the end of the next byte transmitted
+ * by the device, and the idle line detection after the last byte 
+ * received. HalSim_Run takes them in time order until its target time.
+ *
+ * Device reception follows the HAL: RXMODE_IT style reception of one
+ * byte, re-armed from RxCpltCallback, or reception to idle on a DMA
+ * ring, with RxEventCallback on half transfer, transfer complete and
+ * idle line. Transmission raises TxHalfCpltCallback, for DMA, and 
+ * TxCpltCallback, and starts over with circular DMA.
+ *
+ * Errors are reported as the HAL does, with ErrorCode, gState and 
+ * RxState set before ErrorCallback. A framing error aborts reception
+ * to idle, but not single byte reception, whose byte still comes. A 
+ * DMA error aborts transmission.
+ */
+
+#include <string.h>
+#include "hal_sim.h"
+
+#define LINE_MASK (HALSIM_LINE_SIZE - 1)
+
+/* Runs interrupt handler <call>, timed if a clock is set */
+#define HALSIM_ISR(call) do{ \
+        uint64_t start = sim.clock? sim.clock() : 0; \
+        call; \
+        if(sim.clock){ \
+            sim.stats.isrTime += sim.clock() - start; \
+        } \
+    }while(0)
+
+typedef enum{
+    RX_OFF,
+    RX_IT,
+    RX_DMA,
+} E_RxMode;
+
+typedef struct{
+    /* Peer to device */
+    uint8_t inBytes[HALSIM_LINE_SIZE];
+    uint64_t inTime[HALSIM_LINE_SIZE];
+    uint32_t inBaud[HALSIM_LINE_SIZE];
+    uint32_t inHead;
+    uint32_t inTail;
+    uint64_t inLineFree;
+
+    /* Device reception */
+    E_RxMode rxMode;
+    uint8_t *rxBuf;
+    uint16_t rxSize;
+    uint16_t rxPos;
+    bool idlePending;
+    uint64_t idleTime;
+
+    /* Device transmission */
+    bool txActive;
+    bool txDma;
+    const uint8_t *txBuf;
+    uint16_t txSize;
+    uint16_t txSent;
+    uint64_t txNext;
+
+    /* Device to peer */
+    uint8_t outBytes[HALSIM_LINE_SIZE];
+    uint32_t outHead;
+    uint32_t outTail;
+    uint32_t peerBaud;
+    uint32_t lineLimit;
+    uint32_t noiseRate;
+    uint32_t peerNoiseRate;
+
+    UART_HandleTypeDef *huart;
+    uint64_t now;
+    bool inIsr;
+    uint32_t noise;
+    uint64_t (*clock)(void);
+    HalSim_Stats stats;
+} HalSim;
+
+uint32_t g_HalSimPrimask;
+
+static HalSim sim;
+
+static uint64_t HalSim_CharTime(uint32_t baud);
+static uint32_t HalSim_Noise(void);
+static uint8_t HalSim_Garble(uint8_t byte, bool *framing_error);
+static void HalSim_RxByte(uint64_t time);
+static void HalSim_RxIdle(void);
+static void HalSim_TxByte(void);
+static void HalSim_TxStart(const uint8_t *data, uint16_t size, bool dma);
+
+void HalSim_Init(UART_HandleTypeDef *huart){
+    uint64_t (*clock)(void) = sim.clock;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.clock = clock;
+    sim.huart = huart;
+    sim.peerBaud = huart->Init.BaudRate;
+    sim.noise = 0x2545F491;
+    huart->gState = HAL_UART_STATE_READY;
+    huart->RxState = HAL_UART_STATE_READY;
+    huart->ErrorCode = HAL_UART_ERROR_NONE;
+    g_HalSimPrimask = 0;
+}
+
+uint64_t HalSim_Now(void){
+    return sim.now;
+}
+
+void HalSim_Run(uint64_t ns){
+    uint64_t target = sim.now + ns;
+
+    while(!g_HalSimPrimask && !sim.inIsr){
+        uint64_t next = UINT64_MAX;
+        int event = -1;
+
+        if(sim.inHead != sim.inTail){
+            next = sim.inTime[sim.inTail & LINE_MASK];
+            event = 0;
+        }
+        if(sim.txActive && sim.txNext < next){
+            next = sim.txNext;
+            event = 1;
+        }
+        if(sim.idlePending && sim.idleTime < next){
+            next = sim.idleTime;
+            event = 2;
+        }
+        if(event < 0 || next > target){
+            break;
+        }
+
+        if(next > sim.now){
+            sim.now = next;
+        }
+        sim.inIsr = true;
+        switch(event){
+            case 0:
+                HalSim_RxByte(next);
+                break;
+            case 1:
+                HalSim_TxByte();
+                break;
+            default:
+                HalSim_RxIdle();
+                break;
+        }
+        sim.inIsr = false;
+    }
+
+    if(target > sim.now){
+        sim.now = target;
+    }
+}
+
+void HalSim_Send(const uint8_t *data, uint32_t size, uint32_t baud){
+    uint64_t char_time = HalSim_CharTime(baud);
+    uint64_t time = sim.inLineFree > sim.now? sim.inLineFree : sim.now;
+
+    for(uint32_t i = 0; i < size && sim.inHead - sim.inTail < HALSIM_LINE_SIZE; i++){
+        time += char_time;
+        sim.inBytes[sim.inHead & LINE_MASK] = data[i];
+        sim.inTime[sim.inHead & LINE_MASK] = time;
+        sim.inBaud[sim.inHead & LINE_MASK] = baud;
+        sim.inHead++;
+    }
+    sim.inLineFree = time;
+}
+
+uint64_t HalSim_SendDone(void){
+    return sim.inLineFree;
+}
+
+void HalSim_SetPeerBaud(uint32_t baud){
+    sim.peerBaud = baud;
+}
+
+void HalSim_SetLineLimit(uint32_t baud){
+    sim.lineLimit = baud;
+}
+
+void HalSim_SetNoise(uint32_t one_in){
+    sim.noiseRate = one_in;
+}
+
+void HalSim_SetPeerNoise(uint32_t one_in){
+    sim.peerNoiseRate = one_in;
+}
+
+uint32_t HalSim_Recv(uint8_t *buf, uint32_t max){
+    uint32_t n = 0;
+
+    while(n < max && sim.outTail != sim.outHead){
+        buf[n++] = sim.outBytes[sim.outTail++ & LINE_MASK];
+    }
+    return n;
+}
+
+bool HalSim_TxBusy(void){
+    return sim.txActive;
+}
+
+bool HalSim_TxError(void){
+    if(!sim.txActive){
+        return false;
+    }
+    sim.txActive = false;
+    sim.huart->gState = HAL_UART_STATE_READY;
+    sim.huart->ErrorCode |= HAL_UART_ERROR_DMA;
+    sim.stats.txCallbacks++;
+    HALSIM_ISR(HAL_UART_ErrorCallback(sim.huart));
+    return true;
+}
+
+const HalSim_Stats *HalSim_GetStats(void){
+    return &sim.stats;
+}
+
+void HalSim_SetClock(uint64_t (*clock)(void)){
+    sim.clock = clock;
+}
+
+static uint64_t HalSim_CharTime(uint32_t baud){
+    return 10ull * 1000000000ull / baud;
+}
+
+static uint32_t HalSim_Noise(void){
+    sim.noise ^= sim.noise << 13;
+    sim.noise ^= sim.noise >> 17;
+    sim.noise ^= sim.noise << 5;
+    return sim.noise;
+}
+
+/*
+ * A byte sampled at the wrong baud rate. One in four raises a framing
+ * error.
+ */
+static uint8_t HalSim_Garble(uint8_t byte, bool *framing_error){
+    uint32_t noise = HalSim_Noise();
+    *framing_error = (noise & 3) == 0;
+    return byte ^ (uint8_t)(noise >> 8) ^ 0x80;
+}
+
+static void HalSim_RxByte(uint64_t time){
+    uint32_t i = sim.inTail++ & LINE_MASK;
+    uint8_t byte = sim.inBytes[i];
+    bool framing_error = false;
+
+    sim.stats.rxBytes++;
+    if(sim.inBaud[i] != sim.huart->Init.BaudRate || (sim.lineLimit && sim.inBaud[i] > sim.lineLimit) ||
+            (sim.peerNoiseRate && HalSim_Noise() % sim.peerNoiseRate == 0)){
+        sim.stats.rxGarbled++;
+        byte = HalSim_Garble(byte, &framing_error);
+    }
+
+    if(sim.rxMode == RX_OFF){
+        sim.stats.rxLost++;
+        return;
+    }
+    if(framing_error && sim.rxMode == RX_DMA){
+        /* Blocking error with DMA: reception is aborted */
+        sim.rxMode = RX_OFF;
+        sim.huart->RxState = HAL_UART_STATE_READY;
+        sim.huart->ErrorCode |= HAL_UART_ERROR_FE;
+        sim.idlePending = false;
+        sim.stats.rxCallbacks++;
+        HALSIM_ISR(HAL_UART_ErrorCallback(sim.huart));
+        return;
+    }
+
+    if(sim.rxMode == RX_IT){
+        sim.rxBuf[0] = byte;
+        sim.rxMode = RX_OFF;
+        sim.huart->RxState = HAL_UART_STATE_READY;
+        sim.stats.rxCallbacks++;
+        HALSIM_ISR(HAL_UART_RxCpltCallback(sim.huart));
+        if(framing_error){
+            /* Not blocking: byte is received, then the error reported */
+            sim.huart->ErrorCode |= HAL_UART_ERROR_FE;
+            sim.stats.rxCallbacks++;
+            HALSIM_ISR(HAL_UART_ErrorCallback(sim.huart));
+            sim.huart->ErrorCode = HAL_UART_ERROR_NONE;
+        }
+        return;
+    }
+
+    sim.rxBuf[sim.rxPos++] = byte;
+    sim.idlePending = true;
+    sim.idleTime = time + HalSim_CharTime(sim.huart->Init.BaudRate);
+    if(sim.rxPos == sim.rxSize / 2){
+        sim.stats.rxCallbacks++;
+        HALSIM_ISR(HAL_UARTEx_RxEventCallback(sim.huart, sim.rxPos));
+    }else if(sim.rxPos == sim.rxSize){
+        sim.rxPos = 0;
+        sim.stats.rxCallbacks++;
+        HALSIM_ISR(HAL_UARTEx_RxEventCallback(sim.huart, sim.rxSize));
+    }
+}
+
+static void HalSim_RxIdle(void){
+    sim.idlePending = false;
+    if(sim.rxMode != RX_DMA){
+        return;
+    }
+    sim.stats.rxCallbacks++;
+    HALSIM_ISR(HAL_UARTEx_RxEventCallback(sim.huart, sim.rxPos));
+}
+
+static void HalSim_TxByte(void){
+    uint8_t byte = sim.txBuf[sim.txSent++];
+
+    uint32_t baud = sim.huart->Init.BaudRate;
+    if(sim.peerBaud != baud || (sim.lineLimit && baud > sim.lineLimit) ||
+            (sim.noiseRate && HalSim_Noise() % sim.noiseRate == 0)){
+        bool framing_error;
+        byte = HalSim_Garble(byte, &framing_error);
+        sim.stats.txGarbled++;
+    }
+    if(sim.outHead - sim.outTail < HALSIM_LINE_SIZE){
+        sim.outBytes[sim.outHead++ & LINE_MASK] = byte;
+    }
+    sim.stats.txBytes++;
+    sim.txNext += HalSim_CharTime(sim.huart->Init.BaudRate);
+
+    if(sim.txDma && sim.txSent == sim.txSize / 2){
+        sim.stats.txCallbacks++;
+        HALSIM_ISR(HAL_UART_TxHalfCpltCallback(sim.huart));
+    }else if(sim.txSent == sim.txSize){
+        if(sim.txDma && sim.huart->hdmatx->Init.Mode == DMA_CIRCULAR){
+            sim.txSent = 0;
+        }else{
+            sim.txActive = false;
+            sim.huart->gState = HAL_UART_STATE_READY;
+        }
+        sim.stats.txCallbacks++;
+        HALSIM_ISR(HAL_UART_TxCpltCallback(sim.huart));
+    }
+}
+
+static void HalSim_TxStart(const uint8_t *data, uint16_t size, bool dma){
+    sim.txActive = true;
+    sim.huart->gState = HAL_UART_STATE_BUSY_TX;
+    sim.huart->ErrorCode = HAL_UART_ERROR_NONE;
+    sim.txDma = dma;
+    sim.txBuf = data;
+    sim.txSize = size;
+    sim.txSent = 0;
+    sim.txNext = sim.now + HalSim_CharTime(sim.huart->Init.BaudRate);
+}
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart){
+    return HAL_OK;
+}
+
+/*
+ * Bytes leave at once. Time moves on by their transmission time, 
+ * running interrupts, as the caller is blocked meanwhile.
+ */
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size, uint32_t Timeout){
+    if(sim.txActive){
+        return HAL_BUSY;
+    }
+    for(uint16_t i = 0; i < Size; i++){
+        if(sim.outHead - sim.outTail < HALSIM_LINE_SIZE){
+            sim.outBytes[sim.outHead++ & LINE_MASK] = pData[i];
+        }
+    }
+    sim.stats.txBytes += Size;
+    HalSim_Run(Size * HalSim_CharTime(huart->Init.BaudRate));
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_IT(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size){
+    if(sim.txActive || Size == 0){
+        return HAL_BUSY;
+    }
+    HalSim_TxStart(pData, Size, false);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size){
+    if(sim.txActive || Size == 0 || !huart->hdmatx){
+        return HAL_BUSY;
+    }
+    HalSim_TxStart(pData, Size, true);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef *huart){
+    sim.txActive = false;
+    huart->gState = HAL_UART_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Receive_IT(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size){
+    if(sim.rxMode != RX_OFF){
+        return HAL_BUSY;
+    }
+    sim.rxMode = RX_IT;
+    sim.rxBuf = pData;
+    huart->RxState = HAL_UART_STATE_BUSY_RX;
+    huart->ErrorCode = HAL_UART_ERROR_NONE;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size){
+    if(sim.rxMode != RX_OFF){
+        return HAL_BUSY;
+    }
+    sim.rxMode = RX_DMA;
+    sim.rxBuf = pData;
+    huart->RxState = HAL_UART_STATE_BUSY_RX;
+    huart->ErrorCode = HAL_UART_ERROR_NONE;
+    sim.rxSize = Size;
+    sim.rxPos = 0;
+    sim.idlePending = false;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef *huart){
+    sim.rxMode = RX_OFF;
+    huart->RxState = HAL_UART_STATE_READY;
+    sim.idlePending = false;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma){
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma){
+    return HAL_OK;
+}
+
+/*
+ * Every call takes HALSIM_TICK_COST, so loops waiting on the tick 
+ * see interrupts run and time pass.
+ */
+uint32_t HAL_GetTick(void){
+    HalSim_Run(HALSIM_TICK_COST);
+    return (uint32_t)(sim.now / 1000000);
+}
+
+/* Overridden by device code, as with the real HAL */
+__attribute__((weak)) void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart){}
+__attribute__((weak)) void HAL_UART_TxHalfCpltCallback(UART_HandleTypeDef *huart){}
+__attribute__((weak)) void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart){}
+__attribute__((weak)) void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size){}
+__attribute__((weak)) void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart){}
@@ -0,0 +1,122 @@
+/**
+ * @file hal_sim.h
+ * @brief Simulated UART behind the host HAL.
+ *
+ * A single UART, the device one, is simulated with bit timing. Its
+ * peer (the controller, played by the test) sends bytes with 
+ * HalSim_Send and reads what the device transmitted with HalSim_Recv.
+ * Simulated time only moves through HalSim_Run and HAL_GetTick.
+ *
+ * Bytes take 10 bit times on the line. A byte is garbled if sender 
+ * and receiver baud rates differ, or if the rate is above the line
+ * limit, and may then raise a framing error, which aborts reception
+ * as the real HAL does. Bytes either way may also be garbled at 
+ * random, as noise.
+ *
+ * Interrupts are callbacks run from HalSim_Run, in time order. They 
+ * are held while PRIMASK is set, and run late once it is cleared, 
+ * never nested.
+ */
+#ifndef HAL_SIM_H
+#define HAL_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "stm32f3xx_hal.h"
+
+#define HALSIM_LINE_SIZE (1 << 18)  /* Bytes in flight each way. Power of 2 */
+#define HALSIM_TICK_COST 1000       /* ns taken by each HAL_GetTick call */
+
+typedef struct{
+    uint32_t rxBytes;           /* Bytes arrived at the device */
+    uint32_t rxLost;            /* Bytes arrived with reception not armed */
+    uint32_t rxGarbled;         /* Bytes arrived at the wrong baud rate,
+                                   or garbled by noise */
+    uint32_t rxCallbacks;       /* RX interrupts run */
+    uint32_t txBytes;           /* Bytes transmitted by the device */
+    uint32_t txGarbled;         /* Bytes garbled on the way to the peer */
+    uint32_t txCallbacks;       /* TX interrupts run */
+    uint64_t isrTime;           /* Time spent in interrupts, read from the
+                                   clock set with HalSim_SetClock */
+} HalSim_Stats;
+
+/*
+ * Resets simulation to time 0, with <huart> as the device UART. The
+ * peer listens at <huart> current baud rate.
+ */
+void HalSim_Init(UART_HandleTypeDef *huart);
+
+/*
+ * Current simulated time in ns.
+ */
+uint64_t HalSim_Now(void);
+
+/*
+ * Moves simulated time <ns> forward, running every interrupt due.
+ */
+void HalSim_Run(uint64_t ns);
+
+/*
+ * Sends <size> bytes of <data> from the peer at <baud>, after the
+ * bytes already on the line.
+ */
+void HalSim_Send(const uint8_t *data, uint32_t size, uint32_t baud);
+
+/*
+ * Time in ns when the last byte sent by the peer will have arrived.
+ */
+uint64_t HalSim_SendDone(void);
+
+/*
+ * Sets the baud rate the peer listens at.
+ */
+void HalSim_SetPeerBaud(uint32_t baud);
+
+/*
+ * Garbles bytes sent either way above <baud>, as a line too long or
+ * too noisy for faster rates. 0, the default, for no limit.
+ */
+void HalSim_SetLineLimit(uint32_t baud);
+
+/*
+ * Garbles one in <one_in> bytes sent by the device, at random, as 
+ * noise on the line. 0, the default, for none.
+ */
+void HalSim_SetNoise(uint32_t one_in);
+
+/*
+ * Same as HalSim_SetNoise, for bytes sent by the peer. Garbled bytes
+ * may raise a framing error.
+ */
+void HalSim_SetPeerNoise(uint32_t one_in);
+
+/*
+ * Moves up to <max> bytes transmitted by the device so far to <buf>.
+ *
+ * Returns number of bytes moved
+ */
+uint32_t HalSim_Recv(uint8_t *buf, uint32_t max);
+
+/*
+ * Returns true while the device transmits.
+ */
+bool HalSim_TxBusy(void);
+
+/*
+ * Aborts the transfer the device is transmitting, as a DMA error 
+ * would, and raises the error interrupt. Bytes already sent stay on
+ * the line.
+ *
+ * Returns false if nothing was being transmitted
+ */
+bool HalSim_TxError(void);
+
+const HalSim_Stats *HalSim_GetStats(void);
+
+/*
+ * Sets <clock> to measure the time interrupts take on the host, in 
+ * isrTime. None by default. Kept by HalSim_Init.
+ */
+void HalSim_SetClock(uint64_t (*clock)(void));
+
+#endif
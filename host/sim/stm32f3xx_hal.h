@@ -0,0 +1,85 @@
+/**
+ * @file stm32f3xx_hal.h
+ * @brief Simulated STM32 HAL, for host builds of device code.
+ *
+ * Only the UART, DMA and tick parts MCTP uses are provided, backed by
+ * the simulated UART of hal_sim.c. Interrupt masking is modelled, so
+ * callbacks never run inside a critical section.
+ */
+#ifndef STM32F3XX_HAL_H
+#define STM32F3XX_HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum{
+    HAL_OK,
+    HAL_ERROR,
+    HAL_BUSY,
+    HAL_TIMEOUT,
+} HAL_StatusTypeDef;
+
+typedef struct{
+    uint32_t Mode;
+} DMA_InitTypeDef;
+
+typedef struct __DMA_HandleTypeDef{
+    DMA_InitTypeDef Init;
+    void *Parent;
+} DMA_HandleTypeDef;
+
+typedef struct{
+    uint32_t BaudRate;
+} UART_InitTypeDef;
+
+typedef struct __UART_HandleTypeDef{
+    UART_InitTypeDef Init;
+    DMA_HandleTypeDef *hdmatx;
+    DMA_HandleTypeDef *hdmarx;
+    volatile uint32_t gState;           /* TX side */
+    volatile uint32_t RxState;
+    volatile uint32_t ErrorCode;
+} UART_HandleTypeDef;
+
+#define HAL_UART_STATE_READY 0x20U
+#define HAL_UART_STATE_BUSY_TX 0x21U
+#define HAL_UART_STATE_BUSY_RX 0x22U
+
+#define HAL_UART_ERROR_NONE 0x00U
+#define HAL_UART_ERROR_PE 0x01U
+#define HAL_UART_ERROR_NE 0x02U
+#define HAL_UART_ERROR_FE 0x04U
+#define HAL_UART_ERROR_ORE 0x08U
+#define HAL_UART_ERROR_DMA 0x10U
+
+#define HAL_MAX_DELAY 0xFFFFFFFFU
+#define DMA_NORMAL 0x00U
+#define DMA_CIRCULAR 0x20U
+
+extern uint32_t g_HalSimPrimask;
+
+#define __get_PRIMASK() (g_HalSimPrimask)
+#define __set_PRIMASK(x) (g_HalSimPrimask = (x))
+#define __disable_irq() (g_HalSimPrimask = 1)
+#define __enable_irq() (g_HalSimPrimask = 0)
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_UART_Transmit_IT(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_Receive_IT(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma);
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma);
+uint32_t HAL_GetTick(void);
+
+/* Implemented by device code */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+void HAL_UART_TxHalfCpltCallback(UART_HandleTypeDef *huart);
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart);
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size);
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart);
+
+#endif
@@ -0,0 +1,245 @@
+/**
+ * @file host_state.c
+ * @brief Controller state kept across frames: device clock and schema.
+ *
+ * MCTP_HostSampleTime extends 32-bit device timestamps in us, which
+ * wrap every 71 minutes, to a 64-bit clock. Times must come out
+ * exact and in order across any number of wraps, also for frames
+ * arriving late, before or after a wrap, which must neither move the
+ * clock back nor be taken a wrap ahead.
+ *
+ * MCTP_HostSchemaUpdate keeps the channel list of the last SCHEMA
+ * frame, with scale and offset of fixed point channels, which DATA
+ * frames with HEADER_FLAG_SCHEMA are read with. Malformed SCHEMA
+ * frames must leave it invalid, so such DATA frames are refused
+ * rather than misread.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "mctp_host.h"
+
+#define WRAP 4294967296.0           /* us, 2^32 */
+#define PERIOD 1000.0               /* us between samples */
+
+static MCTP_HostFrame Stamped(uint32_t timestamp){
+    MCTP_HostFrame frame = {
+        .type = FRAMETYPE_DATA,
+        .flags = HEADER_FLAG_TIMESTAMP,
+        .timestamp = timestamp,
+    };
+    return frame;
+}
+
+/*
+ * Checks <clock> takes device time <time> us, given as its 32-bit
+ * timestamp, as <time> exactly.
+ */
+static bool TimeIs(MCTP_HostClock *clock, int64_t time){
+    MCTP_HostFrame frame = Stamped((uint32_t)time);
+    double t = 0;
+
+    return MCTP_HostSampleTime(clock, &frame, 0, PERIOD, &t) == 0 && t == (double)time;
+}
+
+/*
+ * Frames every 10 ms from 0.5 s before the first wrap to 0.5 s after.
+ */
+static int Wrap(void){
+    MCTP_HostClock clock;
+    int64_t start = (int64_t)WRAP - 500000;
+
+    MCTP_HostClockInit(&clock);
+    for(int64_t t = start; t < start + 1000000; t += 10000){
+        if(!TimeIs(&clock, t)){
+            return -1;
+        }
+    }
+    return clock.last > (int64_t)WRAP? 0 : -1;
+}
+
+/*
+ * Steps just below half the wrap period, through 20 wraps.
+ */
+static int ManyWraps(void){
+    MCTP_HostClock clock;
+    const int64_t step = (1LL << 31) - 12345;
+    int64_t t = 777;
+
+    MCTP_HostClockInit(&clock);
+    for(int i = 0; i < 40; i++, t += step){
+        if(!TimeIs(&clock, t)){
+            return -1;
+        }
+    }
+    return clock.last == t - step? 0 : -1;
+}
+
+/*
+ * Every other frame arrives after the next one, around a wrap. Late
+ * frames keep their own time, and the clock never moves back.
+ */
+static int Late(void){
+    MCTP_HostClock clock;
+    int64_t start = (int64_t)WRAP - 35000;
+    int64_t latest = 0;
+
+    MCTP_HostClockInit(&clock);
+    for(int i = 0; i < 20; i += 2){
+        int64_t early = start + (i + 1) * 5000;
+        int64_t late = start + i * 5000;
+        if(!TimeIs(&clock, early) || !TimeIs(&clock, late) || clock.last != early ||
+                clock.last < latest){
+            return -1;
+        }
+        latest = clock.last;
+    }
+
+    /* Far behind, still less than half the wrap period */
+    return TimeIs(&clock, latest - (1LL << 30)) && clock.last == latest? 0 : -1;
+}
+
+/*
+ * Samples after the first are PERIOD apart, and frames without
+ * timestamp leave the clock as is.
+ */
+static int Samples(void){
+    MCTP_HostClock clock;
+    MCTP_HostFrame frame = Stamped(0xFFFFFF00);
+    MCTP_HostFrame plain = {.type = FRAMETYPE_DATA};
+    double t = 0;
+
+    MCTP_HostClockInit(&clock);
+    for(uint32_t i = 0; i < 1000; i++){
+        if(MCTP_HostSampleTime(&clock, &frame, i, PERIOD, &t) < 0 || t != 0xFFFFFF00 + i * PERIOD){
+            return -1;
+        }
+    }
+    if(MCTP_HostSampleTime(&clock, &plain, 0, PERIOD, &t) == 0 || clock.last != 0xFFFFFF00){
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Writes a SCHEMA DATA section announcing <id>: an UINT16 channel 0,
+ * a Q15 channel 3, with scale and offset, and a disabled channel 5.
+ *
+ * Returns section size
+ */
+static uint32_t SchemaSection(uint8_t id, uint8_t *data){
+    static const float scale = 0.5f;
+    static const float offset = -3.25f;
+    uint8_t *p = data;
+
+    *p++ = id;
+    *p++ = 3;
+    *p++ = 0; *p++ = 8; *p++ = 0; *p++ = DATATYPE_UINT16;
+    *p++ = 3; *p++ = 4; *p++ = 0; *p++ = DATATYPE_Q15;
+    memcpy(p, &scale, 4);
+    memcpy(p + 4, &offset, 4);
+    p += SCALEINFO_SIZE;
+    *p++ = 5; *p++ = 0; *p++ = 0; *p++ = DATATYPE_UINT8;
+    return p - data;
+}
+
+/*
+ * SCHEMA is stored, and a DATA frame following it is read with it.
+ */
+static int Schema(void){
+    static MCTP_HostSchema schema;
+    uint8_t section[64];
+    uint8_t samples[DATAHEAD_SIZE + 12] = {0, 7};
+    MCTP_HostFrame frame = {.type = FRAMETYPE_SCHEMA, .data = section};
+    MCTP_HostFrame data = {.type = FRAMETYPE_DATA, .flags = HEADER_FLAG_SCHEMA,
+        .dataSize = sizeof(samples), .data = samples};
+    MCTP_HostChannel channel;
+    uint32_t offset = 0;
+
+    frame.dataSize = SchemaSection(7, section);
+    if(MCTP_HostSchemaUpdate(&schema, &frame) < 0 || !schema.valid || schema.id != 7 ||
+            schema.count != 3){
+        return -1;
+    }
+    const MCTP_HostChannel *q15 = &schema.channels[1];
+    if(schema.channels[0].size != 8 || schema.channels[0].scale != 1.0f ||
+            q15->channelId != 3 || q15->dataType != DATATYPE_Q15 || q15->size != 4 ||
+            q15->scale != 0.5f || q15->offset != -3.25f || schema.channels[2].size != 0){
+        return -1;
+    }
+
+    /* Channels with data in schema order, disabled one left out */
+    if(MCTP_HostNextChannel(&data, &schema, &offset, &channel) != 1 || channel.channelId != 0 ||
+            channel.samples != &samples[DATAHEAD_SIZE] ||
+            MCTP_HostNextChannel(&data, &schema, &offset, &channel) != 1 || channel.channelId != 3 ||
+            channel.scale != 0.5f || channel.samples != &samples[DATAHEAD_SIZE + 8] ||
+            MCTP_HostNextChannel(&data, &schema, &offset, &channel) != 0){
+        return -1;
+    }
+
+    /* DATA frame from another schema */
+    samples[1] = 8;
+    offset = 0;
+    return MCTP_HostNextChannel(&data, &schema, &offset, &channel) < 0? 0 : -1;
+}
+
+/*
+ * Truncated, overlong or mistyped SCHEMA frames are refused. Once
+ * truncated or overlong, schema is invalid until the next good one.
+ */
+static int SchemaMalformed(void){
+    static MCTP_HostSchema schema;
+    uint8_t section[64];
+    uint8_t samples[DATAHEAD_SIZE + 12] = {0, 7};
+    MCTP_HostFrame frame = {.type = FRAMETYPE_SCHEMA, .data = section};
+    MCTP_HostFrame data = {.type = FRAMETYPE_DATA, .flags = HEADER_FLAG_SCHEMA,
+        .dataSize = sizeof(samples), .data = samples};
+    MCTP_HostChannel channel;
+    uint32_t size = SchemaSection(7, section);
+
+    for(uint32_t cut = 0; cut <= size + 1; cut++){
+        uint32_t offset = 0;
+        frame.dataSize = size;
+        if(MCTP_HostSchemaUpdate(&schema, &frame) < 0){
+            return -1;
+        }
+        /* One byte past the section is an extra byte */
+        frame.dataSize = cut == size? size + 1 : cut;
+        if(cut == size + 1){
+            frame.type = FRAMETYPE_DATA;
+            frame.dataSize = size;
+        }
+        if(MCTP_HostSchemaUpdate(&schema, &frame) == 0){
+            return -1;
+        }
+        frame.type = FRAMETYPE_SCHEMA;
+        bool kept = cut == size + 1 || cut < 2;
+        if(schema.valid != kept || (!kept && MCTP_HostNextChannel(&data, &schema, &offset, &channel) >= 0)){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(void){
+    static const struct{
+        const char *name;
+        int (*run)(void);
+    } cases[] = {
+        {"clock across wrap", Wrap},
+        {"clock across many wraps", ManyWraps},
+        {"late frames around wrap", Late},
+        {"sample times", Samples},
+        {"schema read", Schema},
+        {"malformed schema refused", SchemaMalformed},
+    };
+    int status = 0;
+
+    for(unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+        int ret = cases[i].run();
+        printf("%-40s %s\n", cases[i].name, ret == 0? "ok" : "FAIL");
+        status |= ret;
+    }
+
+    return status? 1 : 0;
+}
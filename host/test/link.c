@@ -0,0 +1,209 @@
+/**
+ * @file link.c
+ * @brief Controller end of a simulated link to the device library.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "link.h"
+
+#define LINK_RX_SIZE 65536
+#define LINK_SIGNALS (SIGNAL_TX_CPLT + 1)
+
+typedef struct{
+    MCTP_Handle hmctp;
+    UART_HandleTypeDef huart;
+    DMA_HandleTypeDef hdmatx;
+    uint8_t txArena[LINK_ARENA_SIZE];
+    uint32_t baud;
+    void (*app)(MCTP_Handle *hmctp);
+    uint64_t nextPoll;
+    /* Bytes received from the device, not yet taken as frames */
+    uint8_t rx[LINK_RX_SIZE];
+    uint32_t rxLen;
+    uint8_t frame[COBS_MAX_SIZE(MAX_FRAME_SIZE)];
+    uint32_t frameSize;             /* Bytes of last frame on the wire */
+    uint32_t signals[LINK_SIGNALS];
+} Link;
+
+static Link link;
+static bool linkCobs;               /* Framing of the cases being run */
+
+static void Link_Signal(E_MCTP_Signal signal){
+    if(signal < LINK_SIGNALS){
+        link.signals[signal]++;
+    }
+}
+
+MCTP_Handle *Link_Setup(uint32_t baud){
+    memset(&link, 0, sizeof(link));
+    link.huart.Init.BaudRate = baud;
+    link.hdmatx.Init.Mode = DMA_NORMAL;
+    link.huart.hdmatx = &link.hdmatx;
+    link.baud = baud;
+    HalSim_Init(&link.huart);
+
+    link.hmctp.huart = &link.huart;
+    link.hmctp.SignalCallback = Link_Signal;
+    link.hmctp.totalChannels = MAX_CHANNELS;
+    link.hmctp.rxMode = RXMODE_IT;
+    link.hmctp.txArena = link.txArena;
+    link.hmctp.txArenaSize = sizeof(link.txArena);
+    link.hmctp.cobsEnabled = linkCobs;
+    return &link.hmctp;
+}
+
+int Link_Start(void){
+    if(MCTP_Init(&link.hmctp) < 0 || MCTP_Start(&link.hmctp) < 0){
+        return -1;
+    }
+    return 0;
+}
+
+void Link_SetApp(void (*app)(MCTP_Handle *hmctp)){
+    link.app = app;
+}
+
+void Link_SetBaud(uint32_t baud){
+    link.baud = baud;
+    HalSim_SetPeerBaud(baud);
+    Link_Discard();
+}
+
+void Link_Discard(void){
+    link.rxLen = 0;
+    while(HalSim_Recv(link.rx, sizeof(link.rx))){
+    }
+}
+
+void Link_SendRaw(const uint8_t *frame, uint32_t size){
+    uint8_t encoded[COBS_MAX_SIZE(MAX_FRAME_SIZE + CRC_SIZE)];
+    uint8_t checked[MAX_FRAME_SIZE + CRC_SIZE];
+
+    if(link.hmctp.crcEnabled && size + CRC_SIZE <= sizeof(checked)){
+        memcpy(checked, frame, size);
+        size = MCTP_HostAddCrc(checked, size, sizeof(checked));
+        frame = checked;
+    }
+    if(link.hmctp.cobsEnabled){
+        size = MCTP_HostCobsEncode(frame, size, encoded, sizeof(encoded));
+        frame = encoded;
+    }
+    HalSim_Send(frame, size, link.baud);
+}
+
+void Link_Send(E_MCTP_FrameType frame_type, const uint8_t *data, uint16_t data_size){
+    uint8_t frame[MAX_FRAME_SIZE];
+
+    uint32_t size = MCTP_HostBuildFrame(frame_type, data, data_size, frame, sizeof(frame));
+    Link_SendRaw(frame, size);
+}
+
+void Link_Run(uint64_t ns){
+    uint64_t target = HalSim_Now() + ns;
+
+    while(HalSim_Now() < target){
+        if(HalSim_Now() >= link.nextPoll){
+            MCTP_Poll(&link.hmctp);
+            if(link.app){
+                link.app(&link.hmctp);
+            }
+            link.nextPoll = HalSim_Now() + LINK_POLL_PERIOD;
+        }
+        uint64_t step = link.nextPoll < target? link.nextPoll : target;
+        if(step > HalSim_Now()){
+            HalSim_Run(step - HalSim_Now());
+        }
+    }
+    link.rxLen += HalSim_Recv(link.rx + link.rxLen, sizeof(link.rx) - link.rxLen);
+}
+
+void Link_Flush(void){
+    if(HalSim_SendDone() > HalSim_Now()){
+        Link_Run(HalSim_SendDone() - HalSim_Now());
+    }
+}
+
+/*
+ * Moves the first whole frame of the bytes received to link.frame.
+ */
+static bool Link_Take(MCTP_HostFrame *frame){
+    uint32_t skip = 0;
+    uint32_t size;
+
+    if(link.hmctp.cobsEnabled){
+        size = MCTP_HostFindFrameCobs(link.rx, link.rxLen, &skip, frame);
+    }else if(link.hmctp.crcEnabled){
+        size = MCTP_HostFindFrameCrc(link.rx, link.rxLen, &skip, frame);
+    }else{
+        size = MCTP_HostFindFrame(link.rx, link.rxLen, &skip, frame);
+    }
+    if(size){
+        memcpy(link.frame, link.rx + skip, size);
+        link.frameSize = size;
+        frame->data = link.frame + (frame->data - (link.rx + skip));
+        skip += size;
+    }
+    memmove(link.rx, link.rx + skip, link.rxLen - skip);
+    link.rxLen -= skip;
+    return size != 0;
+}
+
+bool Link_Next(MCTP_HostFrame *frame, uint64_t timeout){
+    uint64_t end = HalSim_Now() + timeout;
+    uint64_t idle = 0;
+
+    while(!Link_Take(frame)){
+        if(HalSim_Now() >= end){
+            return false;
+        }
+        uint32_t len = link.rxLen;
+        Link_Run(LINK_POLL_PERIOD);
+        idle = link.rxLen == len? idle + LINK_POLL_PERIOD : 0;
+        if(link.rxLen && idle >= LINK_IDLE_TIMEOUT){
+            /* Size of the frame waited for may be garbled */
+            memmove(link.rx, link.rx + 1, --link.rxLen);
+            idle = 0;
+        }
+    }
+    return true;
+}
+
+bool Link_Wait(E_MCTP_FrameType frame_type, MCTP_HostFrame *frame, uint64_t timeout){
+    uint64_t end = HalSim_Now() + timeout;
+
+    while(HalSim_Now() < end){
+        if(Link_Next(frame, end - HalSim_Now()) && frame->type == frame_type){
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t Link_FrameSize(void){
+    return link.frameSize;
+}
+
+uint32_t Link_Signals(E_MCTP_Signal signal){
+    return signal < LINK_SIGNALS? link.signals[signal] : 0;
+}
+
+int Link_Report(const char *name, int status){
+    printf("%-40s %s\n", name, status == 0? "ok" : "FAIL");
+    return status;
+}
+
+int Link_RunCases(const Link_Case *cases, unsigned n){
+    int status = 0;
+
+    for(int c = 0; c < 2; c++){
+        linkCobs = c;
+        for(unsigned i = 0; i < n; i++){
+            char name[64];
+            snprintf(name, sizeof(name), "%s %s", linkCobs? "cobs" : "eom ", cases[i].name);
+            status |= Link_Report(name, cases[i].run());
+        }
+    }
+
+    return status? 1 : 0;
+}
@@ -0,0 +1,138 @@
+/**
+ * @file link.h
+ * @brief Controller end of a simulated link to the device library.
+ *
+ * The whole device library runs on the simulated HAL, with its UART
+ * in DMA mode. The test plays the controller: it sends frames with
+ * Link_Send at the controller baud rate, and reads the frames the
+ * device sent with Link_Next. Time only moves forward in Link_Run and
+ * Link_Next, which call MCTP_Poll, then the application hook, every
+ * LINK_POLL_PERIOD, as the device main loop would.
+ *
+ * There is a single link, since the simulated HAL has a single UART.
+ */
+#ifndef LINK_H
+#define LINK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal_sim.h"
+#include "mctp_api.h"
+#include "mctp_host.h"
+
+#define LINK_POLL_PERIOD 100000ull  /* ns between MCTP_Poll calls */
+#define LINK_ARENA_SIZE 2048        /* TX arena of the device */
+#define LINK_MS 1000000ull          /* ns */
+#define LINK_IDLE_TIMEOUT (5 * LINK_MS) /* Line idle before a frame 
+                                           waited for is given up */
+
+/*
+ * Test case, returning 0 on success and -1 on failure.
+ */
+typedef struct{
+    const char *name;
+    int (*run)(void);
+} Link_Case;
+
+/*
+ * Resets simulation and device handle, with both ends at <baud>, and
+ * the framing of the cases being run. Device handle is returned for 
+ * the test to set optional fields, then the device is started with 
+ * Link_Start.
+ */
+MCTP_Handle *Link_Setup(uint32_t baud);
+
+/*
+ * Initializes and starts the device.
+ *
+ * Returns 0 on success and -1 on error
+ */
+int Link_Start(void);
+
+/*
+ * Sets <app> to be called after every MCTP_Poll, as the application
+ * main loop. NULL for none. Reset by Link_Setup.
+ */
+void Link_SetApp(void (*app)(MCTP_Handle *hmctp));
+
+/*
+ * Switches the controller end to <baud>, for the bytes it sends from
+ * now on and those it receives. Bytes received and not taken yet are
+ * discarded, as when a port is reconfigured.
+ */
+void Link_SetBaud(uint32_t baud);
+
+/*
+ * Discards bytes received and not taken yet, as when the input buffer
+ * of a port is reset.
+ */
+void Link_Discard(void);
+
+/*
+ * Sends <size> bytes of <frame> built by the mctp_host helpers, with
+ * a CRC trailer if the device has crcEnabled, and COBS encoded if it
+ * expects it.
+ */
+void Link_SendRaw(const uint8_t *frame, uint32_t size);
+
+/*
+ * Builds and sends a <frame_type> frame with <data_size> bytes of
+ * <data> as DATA section.
+ */
+void Link_Send(E_MCTP_FrameType frame_type, const uint8_t *data, uint16_t data_size);
+
+/*
+ * Runs the device for <ns>.
+ */
+void Link_Run(uint64_t ns);
+
+/*
+ * Runs until all bytes sent by the controller arrived.
+ */
+void Link_Flush(void);
+
+/*
+ * Takes the next frame sent by the device, waiting up to <timeout> ns.
+ * <frame> data stays valid until the next call.
+ * Frames must carry a valid CRC if the device has crcEnabled. If the
+ * line stays idle for LINK_IDLE_TIMEOUT short of a whole frame, its 
+ * header is taken as broken, and the search goes on past it.
+ *
+ * Returns true if a frame was taken
+ */
+bool Link_Next(MCTP_HostFrame *frame, uint64_t timeout);
+
+/*
+ * Takes frames until one of <frame_type>, waiting up to <timeout> ns.
+ * Other frames are dropped.
+ *
+ * Returns true if a frame of <frame_type> was taken
+ */
+bool Link_Wait(E_MCTP_FrameType frame_type, MCTP_HostFrame *frame, uint64_t timeout);
+
+/*
+ * Bytes the last frame taken by Link_Next took on the wire, COBS 
+ * encoded if enabled.
+ */
+uint32_t Link_FrameSize(void);
+
+/*
+ * Signals received by the device application since Link_Setup, per
+ * E_MCTP_Signal value.
+ */
+uint32_t Link_Signals(E_MCTP_Signal signal);
+
+/*
+ * Prints the result of case <name> and returns <status>.
+ */
+int Link_Report(const char *name, int status);
+
+/*
+ * Runs <n> <cases> with EOM framing, then again with COBS, reporting
+ * each one.
+ *
+ * Returns 0 if all passed and 1 otherwise, as exit status
+ */
+int Link_RunCases(const Link_Case *cases, unsigned n);
+
+#endif
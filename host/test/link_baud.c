@@ -0,0 +1,229 @@
+/**
+ * @file link_baud.c
+ * @brief Baud rate negotiation over a simulated link, with the
+ * controller procedure of mctp_host.h.
+ *
+ * Bit time follows each end's baud rate, so bytes sent at a rate the
+ * other end does not listen at arrive garbled. A line limit garbles
+ * every byte above a rate, so the agreed rate fails its PROBE check,
+ * and both ends must fall back to the initial rate on their own.
+ */
+
+#include <string.h>
+#include "link.h"
+
+#define INITIAL_BAUD 115200
+#define PROBE_PERIOD (20 * LINK_MS)
+#define CHANNEL_SIZE 16
+
+static const uint32_t deviceRates[] = {115200, 460800, 921600};
+static uint8_t channelData[2][CHANNEL_SIZE];
+
+static void App(MCTP_Handle *hmctp){
+    if(hmctp->state == STATE_TRANS){
+        for(int ch = 0; ch < 2; ch++){
+            MCTP_WriteChannelData(hmctp, ch, channelData[ch], CHANNEL_SIZE);
+        }
+        MCTP_SendAll_DMA(hmctp);
+    }
+}
+
+static MCTP_Handle *Setup(void){
+    MCTP_Handle *hmctp = Link_Setup(INITIAL_BAUD);
+
+    hmctp->baudRates = deviceRates;
+    hmctp->baudRatesCount = sizeof(deviceRates) / sizeof(deviceRates[0]);
+    if(Link_Start() < 0){
+        return NULL;
+    }
+    for(int ch = 0; ch < 2; ch++){
+        if(MCTP_EnableChannel(hmctp, ch, channelData[ch], CHANNEL_SIZE, DATATYPE_UINT8) < 0){
+            return NULL;
+        }
+    }
+    Link_SetApp(App);
+    return hmctp;
+}
+
+/*
+ * Steps 1 and 2: SYNC offering <count> <rates>, then SYNC_RESP and
+ * SCHEMA, then ACK. Bytes left from the last session are discarded 
+ * first: sent at another rate, they hold no delimiter with COBS, and 
+ * would take SYNC_RESP down with them.
+ *
+ * Returns the agreed rate, or 0 on error
+ */
+static uint32_t Sync(const uint32_t *rates, uint8_t count){
+    uint8_t frame[MAX_FRAME_SIZE];
+    MCTP_HostFrame resp;
+    uint8_t n_channels = 0;
+    uint32_t baud = 0;
+
+    Link_Discard();
+    Link_SendRaw(frame, MCTP_HostBuildSync(rates, count, frame, sizeof(frame)));
+    if(!Link_Wait(FRAMETYPE_SYNC_RESP, &resp, 50 * LINK_MS) ||
+            MCTP_HostSyncResp(&resp, &n_channels, &baud) < 0 ||
+            !Link_Wait(FRAMETYPE_SCHEMA, &resp, 50 * LINK_MS)){
+        return 0;
+    }
+    Link_Send(FRAMETYPE_ACK, NULL, 0);
+    return baud;
+}
+
+/*
+ * Step 3: once ACK is sent, switch to <baud> and send PROBE until one
+ * comes back valid, then ACK again. Step 4 on failure: back to the
+ * initial rate.
+ *
+ * Returns true if <baud> was confirmed
+ */
+static bool Probe(uint32_t baud){
+    const uint8_t pattern[PROBE_SIZE] = PROBE_BYTES;
+    uint64_t start = HalSim_Now();
+    MCTP_HostFrame frame;
+
+    Link_Flush();
+    Link_SetBaud(baud);
+    while(HalSim_Now() - start < BAUD_PROBE_TIMEOUT * LINK_MS){
+        Link_Send(FRAMETYPE_PROBE, pattern, PROBE_SIZE);
+        if(Link_Wait(FRAMETYPE_PROBE, &frame, PROBE_PERIOD) && MCTP_HostProbeValid(&frame)){
+            Link_Send(FRAMETYPE_ACK, NULL, 0);
+            Link_Flush();
+            Link_Run(LINK_MS);
+            return true;
+        }
+    }
+    Link_SetBaud(INITIAL_BAUD);
+    return false;
+}
+
+/*
+ * Starts transmission and checks DATA frames come through.
+ */
+static int Transmit(MCTP_Handle *hmctp){
+    MCTP_HostFrame frame;
+
+    Link_Send(FRAMETYPE_REQUEST, NULL, 0);
+    for(int i = 0; i < 10; i++){
+        if(!Link_Wait(FRAMETYPE_DATA, &frame, 20 * LINK_MS)){
+            return -1;
+        }
+    }
+    return hmctp->state == STATE_TRANS? 0 : -1;
+}
+
+static int Negotiate(void){
+    static const uint32_t offered[] = {230400, 921600};
+    MCTP_Handle *hmctp = Setup();
+
+    if(!hmctp || Sync(offered, 2) != 921600 || !Probe(921600)){
+        return -1;
+    }
+    if(hmctp->state != STATE_CONN || hmctp->huart->Init.BaudRate != 921600){
+        return -1;
+    }
+    return Transmit(hmctp);
+}
+
+static int NoCommonRate(void){
+    static const uint32_t offered[] = {57600};
+    MCTP_Handle *hmctp = Setup();
+
+    if(!hmctp || Sync(offered, 1) != INITIAL_BAUD){
+        return -1;
+    }
+    Link_Flush();
+    Link_Run(LINK_MS);
+    if(hmctp->state != STATE_CONN || hmctp->huart->Init.BaudRate != INITIAL_BAUD){
+        return -1;
+    }
+    return Transmit(hmctp);
+}
+
+static int EmptySync(void){
+    MCTP_Handle *hmctp = Setup();
+
+    if(!hmctp || Sync(NULL, 0) != INITIAL_BAUD){
+        return -1;
+    }
+    Link_Flush();
+    Link_Run(LINK_MS);
+    if(hmctp->state != STATE_CONN || hmctp->huart->Init.BaudRate != INITIAL_BAUD){
+        return -1;
+    }
+    return Transmit(hmctp);
+}
+
+/*
+ * Line only carries up to 460800. 921600 is agreed, fails its PROBE,
+ * and both ends fall back. Controller starts over leaving it out.
+ */
+static int ProbeFallback(void){
+    static const uint32_t offered[] = {460800, 921600};
+    MCTP_Handle *hmctp = Setup();
+
+    if(!hmctp){
+        return -1;
+    }
+    HalSim_SetLineLimit(460800);
+    if(Sync(offered, 2) != 921600 || Probe(921600)){
+        return -1;
+    }
+
+    /* Performer is back at the initial rate, on its own */
+    Link_Run(10 * LINK_MS);
+    if(hmctp->state != STATE_IDLE || hmctp->huart->Init.BaudRate != INITIAL_BAUD){
+        return -1;
+    }
+
+    if(Sync(offered, 1) != 460800 || !Probe(460800)){
+        return -1;
+    }
+    if(hmctp->state != STATE_CONN || hmctp->huart->Init.BaudRate != 460800){
+        return -1;
+    }
+    return Transmit(hmctp);
+}
+
+/*
+ * DROP at the agreed rate is answered at that rate, then both ends
+ * return to the initial rate.
+ */
+static int DropFallback(void){
+    static const uint32_t offered[] = {921600};
+    MCTP_Handle *hmctp = Setup();
+    MCTP_HostFrame frame;
+
+    if(!hmctp || Sync(offered, 1) != 921600 || !Probe(921600) || Transmit(hmctp) < 0){
+        return -1;
+    }
+
+    Link_Send(FRAMETYPE_DROP, NULL, 0);
+    if(!Link_Wait(FRAMETYPE_DROP, &frame, 50 * LINK_MS)){
+        return -1;
+    }
+    Link_SetBaud(INITIAL_BAUD);
+    Link_Run(10 * LINK_MS);
+    if(hmctp->state != STATE_IDLE || hmctp->huart->Init.BaudRate != INITIAL_BAUD ||
+            Link_Signals(SIGNAL_STOP) != 1){
+        return -1;
+    }
+
+    /* New session at the initial rate */
+    if(Sync(NULL, 0) != INITIAL_BAUD){
+        return -1;
+    }
+    return 0;
+}
+
+static const Link_Case cases[] = {
+    {"negotiate 921600", Negotiate},
+    {"no common rate keeps initial rate", NoCommonRate},
+    {"empty SYNC keeps initial rate", EmptySync},
+    {"PROBE fails, fall back and retry", ProbeFallback},
+    {"DROP returns to initial rate", DropFallback},
+};
+
+int main(void){
+    return Link_RunCases(cases, sizeof(cases) / sizeof(cases[0]));
+}
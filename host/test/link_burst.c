@@ -0,0 +1,241 @@
+/**
+ * @file link_burst.c
+ * @brief Bursts over a simulated link.
+ *
+ * The application sends blocks larger than a frame with MCTP_SendBurst,
+ * which returns at once, and the controller rebuilds them from their
+ * fragments with MCTP_HostReassemble. Blocks must come out whole, even
+ * above 64 KB. A missing fragment must drop the block, never yield a
+ * wrong one. The device must keep handling the controller during a
+ * burst, with control frames sent between fragments, and stop the
+ * burst when the session ends.
+ */
+
+#include <string.h>
+#include "link.h"
+
+#define BAUD 921600
+#define CHANNEL_SIZE 16
+#define BURST_SIZE 70000
+#define SMALL_BURST_SIZE 4000
+#define LOST_FRAGMENT 5
+
+static uint8_t channelData[2][CHANNEL_SIZE];
+static uint8_t burst[BURST_SIZE];
+static uint8_t reassembly[BURSTHEAD_SIZE + BURST_SIZE];
+
+/*
+ * Starts a session, with one channel enabled, and fills the block.
+ */
+static MCTP_Handle *Setup(void){
+    MCTP_Handle *hmctp = Link_Setup(BAUD);
+    uint8_t frame[MAX_FRAME_SIZE];
+    MCTP_HostFrame resp;
+
+    if(Link_Start() < 0 ||
+            MCTP_EnableChannel(hmctp, 0, channelData[0], CHANNEL_SIZE, DATATYPE_UINT8) < 0){
+        return NULL;
+    }
+    for(uint32_t i = 0; i < BURST_SIZE; i++){
+        burst[i] = i * 7 + (i >> 8);
+    }
+
+    Link_SendRaw(frame, MCTP_HostBuildSync(NULL, 0, frame, sizeof(frame)));
+    if(!Link_Wait(FRAMETYPE_SYNC_RESP, &resp, 50 * LINK_MS) ||
+            !Link_Wait(FRAMETYPE_SCHEMA, &resp, 50 * LINK_MS)){
+        return NULL;
+    }
+    Link_Send(FRAMETYPE_ACK, NULL, 0);
+    Link_Send(FRAMETYPE_REQUEST, NULL, 0);
+    Link_Flush();
+    Link_Run(LINK_MS);
+    return hmctp->state == STATE_TRANS? hmctp : NULL;
+}
+
+/*
+ * Checks the rebuilt <frame> holds the first <size> bytes of the block.
+ */
+static bool BurstValid(const MCTP_HostFrame *frame, uint32_t size){
+    return frame->type == FRAMETYPE_BURST && frame->dataSize == BURSTHEAD_SIZE + size &&
+        frame->data[0] == 0 && frame->data[1] == DATATYPE_UINT8 &&
+        memcmp(&frame->data[BURSTHEAD_SIZE], burst, size) == 0;
+}
+
+/*
+ * Takes fragments until the block is rebuilt in <frame>.
+ *
+ * Returns number of fragments taken, or -1 on timeout or if one is
+ * dropped
+ */
+static int Reassemble(MCTP_HostReassembler *r, MCTP_HostFrame *frame){
+    MCTP_HostFrame fragment;
+    int count = 0;
+
+    for(;;){
+        if(!Link_Wait(FRAMETYPE_BURST, &fragment, 50 * LINK_MS)){
+            return -1;
+        }
+        count++;
+        int ret = MCTP_HostReassemble(r, &fragment, frame);
+        if(ret != 0){
+            return ret == 1? count : -1;
+        }
+    }
+}
+
+/*
+ * Block above 64 KB, more than fits a frame, comes out whole.
+ * MCTP_SendBurst returns long before the burst is on the wire.
+ */
+static int Large(void){
+    MCTP_Handle *hmctp = Setup();
+    MCTP_HostReassembler r;
+    MCTP_HostFrame frame;
+
+    if(!hmctp){
+        return -1;
+    }
+    MCTP_HostReassemblyInit(&r, reassembly, sizeof(reassembly));
+    if(MCTP_SendBurst(hmctp, 0, DATATYPE_UINT8, burst, BURST_SIZE) < 0 || !MCTP_BurstBusy(hmctp)){
+        return -1;
+    }
+    /* One burst at a time, and no DATA frame meanwhile */
+    if(MCTP_SendBurst(hmctp, 0, DATATYPE_UINT8, burst, 1) == 0 || MCTP_SendAll_DMA(hmctp) == 0){
+        return -1;
+    }
+    if(Reassemble(&r, &frame) <= 0 || !BurstValid(&frame, BURST_SIZE)){
+        return -1;
+    }
+    return !MCTP_BurstBusy(hmctp) && r.dropped == 0? 0 : -1;
+}
+
+/*
+ * One fragment lost on the way. The block is dropped, and the next one
+ * comes out whole.
+ */
+static int LostFragment(void){
+    MCTP_Handle *hmctp = Setup();
+    MCTP_HostReassembler r;
+    MCTP_HostFrame fragment;
+    MCTP_HostFrame frame;
+    int index = 0;
+
+    if(!hmctp){
+        return -1;
+    }
+    MCTP_HostReassemblyInit(&r, reassembly, sizeof(reassembly));
+    if(MCTP_SendBurst(hmctp, 0, DATATYPE_UINT8, burst, SMALL_BURST_SIZE) < 0){
+        return -1;
+    }
+    /* Burst is over once no fragment comes for a while */
+    while(Link_Wait(FRAMETYPE_BURST, &fragment, 20 * LINK_MS)){
+        if(index++ != LOST_FRAGMENT && MCTP_HostReassemble(&r, &fragment, &frame) == 1){
+            return -1;
+        }
+    }
+    if(MCTP_BurstBusy(hmctp) || index <= LOST_FRAGMENT + 1){
+        return -1;
+    }
+    if(r.dropped != 1){
+        return -1;
+    }
+
+    if(MCTP_SendBurst(hmctp, 0, DATATYPE_UINT8, burst, SMALL_BURST_SIZE) < 0 ||
+            Reassemble(&r, &frame) <= 0 || !BurstValid(&frame, SMALL_BURST_SIZE)){
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * STOP from the controller is handled mid-burst, and SCHEMA, for a
+ * channel enabled then, goes out between fragments. The block still
+ * comes out whole.
+ */
+static int ControlBetween(void){
+    MCTP_Handle *hmctp = Setup();
+    MCTP_HostReassembler r;
+    MCTP_HostFrame next;
+    MCTP_HostFrame frame;
+    int fragments = 0;
+    bool schema = false;
+
+    if(!hmctp){
+        return -1;
+    }
+    MCTP_HostReassemblyInit(&r, reassembly, sizeof(reassembly));
+    if(MCTP_SendBurst(hmctp, 0, DATATYPE_UINT8, burst, BURST_SIZE) < 0){
+        return -1;
+    }
+    for(;;){
+        if(!Link_Next(&next, 50 * LINK_MS)){
+            return -1;
+        }
+        if(next.type == FRAMETYPE_SCHEMA){
+            /* Fragments on both sides */
+            schema = fragments > 10 && MCTP_BurstBusy(hmctp);
+            continue;
+        }
+        if(next.type != FRAMETYPE_BURST){
+            continue;
+        }
+        if(++fragments == 10){
+            Link_Send(FRAMETYPE_STOP, NULL, 0);
+            Link_Flush();
+            if(MCTP_EnableChannel(hmctp, 1, channelData[1], CHANNEL_SIZE, DATATYPE_UINT8) < 0){
+                return -1;
+            }
+        }
+        int ret = MCTP_HostReassemble(&r, &next, &frame);
+        if(ret < 0){
+            return -1;
+        }
+        if(ret == 1){
+            break;
+        }
+    }
+    if(!schema || Link_Signals(SIGNAL_STOP) != 1 || !BurstValid(&frame, BURST_SIZE)){
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * DROP ends the session, and the burst with it. Only fragments already
+ * queued may follow the DROP answer.
+ */
+static int DropStops(void){
+    MCTP_Handle *hmctp = Setup();
+    MCTP_HostFrame frame;
+    int fragments = 0;
+    int after = 0;
+    bool dropped = false;
+
+    if(!hmctp){
+        return -1;
+    }
+    if(MCTP_SendBurst(hmctp, 0, DATATYPE_UINT8, burst, BURST_SIZE) < 0){
+        return -1;
+    }
+    while(Link_Next(&frame, 20 * LINK_MS)){
+        if(frame.type == FRAMETYPE_DROP){
+            dropped = true;
+        }else if(frame.type == FRAMETYPE_BURST && dropped){
+            after++;
+        }else if(frame.type == FRAMETYPE_BURST && ++fragments == 10){
+            Link_Send(FRAMETYPE_DROP, NULL, 0);
+        }
+    }
+    return dropped && after <= 2 && !MCTP_BurstBusy(hmctp) && hmctp->state == STATE_IDLE? 0 : -1;
+}
+
+static const Link_Case cases[] = {
+    {"block above 64 KB", Large},
+    {"lost fragment drops block", LostFragment},
+    {"control frames between fragments", ControlBetween},
+    {"DROP stops burst", DropStops},
+};
+
+int main(void){
+    return Link_RunCases(cases, sizeof(cases) / sizeof(cases[0]));
+}
@@ -0,0 +1,277 @@
+/**
+ * @file link_error.c
+ * @brief UART errors over a simulated link.
+ *
+ * DMA errors abort the transfer the device is transmitting, whose
+ * complete interrupt then never comes. The error interrupt must free
+ * what was in flight and start the next frame, so transmission never
+ * stalls. A control frame cut short is sent again whole. DATA frames
+ * keep their order, and in reliable mode each one still comes through
+ * exactly once. A burst cut short never yields a wrong block, and the
+ * next one comes out whole.
+ */
+
+#include <string.h>
+#include "link.h"
+
+#define BAUD 921600
+#define CHANNEL_SIZE 16
+#define STEP (LINK_MS / 100)        /* Well below a frame on the wire */
+#define DATA_FRAMES 40
+#define RELIABLE_FRAMES 60
+#define BURST_SIZE 20000
+
+static uint8_t channelData[2][CHANNEL_SIZE];
+static uint8_t reliableBuf[RELIABLE_MAX_WINDOW * LINK_ARENA_SIZE / 2];
+static uint8_t burst[BURST_SIZE];
+static uint8_t reassembly[BURSTHEAD_SIZE + BURST_SIZE];
+static uint32_t appLimit;
+static uint32_t appSent;
+
+/*
+ * Sends DATA frames until appLimit, as fast as buffers allow.
+ */
+static void App(MCTP_Handle *hmctp){
+    if(hmctp->state == STATE_TRANS && appSent < appLimit){
+        for(int ch = 0; ch < 2; ch++){
+            memcpy(channelData[ch], &appSent, sizeof(appSent));
+            MCTP_WriteChannelData(hmctp, ch, channelData[ch], CHANNEL_SIZE);
+        }
+        if(MCTP_SendAll_DMA(hmctp) == 0){
+            appSent++;
+        }
+    }
+}
+
+/*
+ * Starts the device, with two channels enabled, the application
+ * sending <limit> DATA frames once a session starts.
+ */
+static MCTP_Handle *Setup(bool reliable, uint32_t limit){
+    MCTP_Handle *hmctp = Link_Setup(BAUD);
+
+    if(reliable){
+        hmctp->crcEnabled = true;
+        hmctp->reliableBuf = reliableBuf;
+        hmctp->reliableBufSize = sizeof(reliableBuf);
+    }
+    if(Link_Start() < 0){
+        return NULL;
+    }
+    for(int ch = 0; ch < 2; ch++){
+        if(MCTP_EnableChannel(hmctp, ch, channelData[ch], CHANNEL_SIZE, DATATYPE_UINT8) < 0){
+            return NULL;
+        }
+    }
+    appLimit = limit;
+    appSent = 0;
+    Link_SetApp(App);
+    return hmctp;
+}
+
+/*
+ * SYNC, then ACK once SCHEMA is in, and REQUEST with <window> for
+ * reliable mode, 0 for none.
+ */
+static int Session(uint8_t window){
+    uint8_t frame[MAX_FRAME_SIZE];
+    MCTP_HostFrame resp;
+
+    Link_SendRaw(frame, MCTP_HostBuildSync(NULL, 0, frame, sizeof(frame)));
+    if(!Link_Wait(FRAMETYPE_SYNC_RESP, &resp, 50 * LINK_MS) ||
+            !Link_Wait(FRAMETYPE_SCHEMA, &resp, 50 * LINK_MS)){
+        return -1;
+    }
+    Link_Send(FRAMETYPE_ACK, NULL, 0);
+    if(window){
+        Link_SendRaw(frame, MCTP_HostBuildReliable(window, CREDIT_FRAMES_UNLIMITED,
+                    CREDIT_BYTES_UNLIMITED, frame, sizeof(frame)));
+    }else{
+        Link_Send(FRAMETYPE_REQUEST, NULL, 0);
+    }
+    return 0;
+}
+
+/*
+ * Runs until <busy> is set, with the UART transmitting, and aborts
+ * the transfer.
+ */
+static bool AbortDuring(volatile bool *busy){
+    for(int i = 0; i < 10000; i++){
+        if(*busy && HalSim_TxBusy()){
+            return HalSim_TxError();
+        }
+        Link_Run(STEP);
+    }
+    return false;
+}
+
+/*
+ * SYNC_RESP cut short is sent again, and SCHEMA follows.
+ */
+static int ControlAgain(void){
+    MCTP_Handle *hmctp = Setup(false, 0);
+    uint8_t frame[MAX_FRAME_SIZE];
+    MCTP_HostFrame resp;
+
+    if(!hmctp){
+        return -1;
+    }
+    Link_SendRaw(frame, MCTP_HostBuildSync(NULL, 0, frame, sizeof(frame)));
+    if(!AbortDuring(&hmctp->txCtrl.busy) ||
+            !Link_Wait(FRAMETYPE_SYNC_RESP, &resp, 50 * LINK_MS) ||
+            !Link_Wait(FRAMETYPE_SCHEMA, &resp, 50 * LINK_MS)){
+        return -1;
+    }
+    return hmctp->txStats.aborted == 1? 0 : -1;
+}
+
+/*
+ * DATA frame cut short is sent again or dropped, and the rest follow
+ * in order: SEQUENCE skips at most the frame lost.
+ */
+static int DataFlows(void){
+    MCTP_Handle *hmctp = Setup(false, DATA_FRAMES);
+    MCTP_HostFrame frame;
+    uint8_t expected = 0;
+    int taken = 0;
+    int skipped = 0;
+
+    if(!hmctp || Session(0) < 0 || !Link_Wait(FRAMETYPE_DATA, &frame, 20 * LINK_MS) ||
+            !AbortDuring(&hmctp->txPingPong.busy)){
+        return -1;
+    }
+    Link_Discard();
+    while(Link_Wait(FRAMETYPE_DATA, &frame, 20 * LINK_MS)){
+        uint8_t seq = 0;
+        if(MCTP_HostDataSequence(&frame, &seq) < 0){
+            return -1;
+        }
+        if(taken++ > 0){
+            if((uint8_t)(seq - expected) > 1){
+                return -1;
+            }
+            skipped += seq != expected;
+        }
+        expected = seq + 1;
+    }
+    /* Frames from the one after the abort to the last */
+    return expected == DATA_FRAMES && taken >= DATA_FRAMES / 2 && skipped <= 1 &&
+        hmctp->txStats.aborted == 1? 0 : -1;
+}
+
+static void Ack(const MCTP_HostReliable *r){
+    uint8_t frame[MAX_FRAME_SIZE];
+
+    Link_SendRaw(frame, MCTP_HostBuildDataAck(r, frame, sizeof(frame)));
+}
+
+/*
+ * In reliable mode, a new DATA frame cut short is sent again at once,
+ * and a retransmission cut short is queued again. Each frame comes 
+ * through.
+ */
+static int ReliableOnce(void){
+    MCTP_Handle *hmctp = Setup(true, RELIABLE_FRAMES);
+    MCTP_HostReliable r;
+    MCTP_HostFrame frame;
+    uint8_t seq = 0;
+    bool lost = false;
+    int aborts = 0;
+
+    MCTP_HostReliableInit(&r);
+    if(!hmctp || Session(8) < 0){
+        return -1;
+    }
+    while(r.received < RELIABLE_FRAMES){
+        if(r.received == 10 && aborts == 0){
+            if(!AbortDuring(&hmctp->txPingPong.busy)){
+                return -1;
+            }
+            aborts++;
+        }
+        if(!Link_Wait(FRAMETYPE_DATA, &frame, 4 * RELIABLE_RTO * LINK_MS) ||
+                MCTP_HostDataSequence(&frame, &seq) < 0){
+            return -1;
+        }
+        if(r.received == 30 && !lost){
+            lost = true;
+            continue;
+        }
+        if(MCTP_HostReliableReceive(&r, seq) < 0){
+            return -1;
+        }
+        Ack(&r);
+        if(lost && aborts == 1){
+            /* SACK reveals the frame lost, which is sent again */
+            if(!AbortDuring(&hmctp->txReliable.busy)){
+                return -1;
+            }
+            aborts++;
+        }
+    }
+    return r.next == RELIABLE_FRAMES && hmctp->txStats.aborted == 2? 0 : -1;
+}
+
+/*
+ * Burst cut short never comes out wrong, and the next one comes out
+ * whole.
+ */
+static int BurstAfter(void){
+    MCTP_Handle *hmctp = Setup(false, 0);
+    MCTP_HostReassembler r;
+    MCTP_HostFrame fragment;
+    MCTP_HostFrame frame;
+
+    if(!hmctp || Session(0) < 0){
+        return -1;
+    }
+    for(uint32_t i = 0; i < BURST_SIZE; i++){
+        burst[i] = i * 13 + (i >> 8);
+    }
+    MCTP_HostReassemblyInit(&r, reassembly, sizeof(reassembly));
+
+    for(int round = 0; round < 2; round++){
+        if(MCTP_SendBurst(hmctp, 0, DATATYPE_UINT8, burst, BURST_SIZE) < 0){
+            return -1;
+        }
+        if(round == 0){
+            for(int i = 0; i < 5; i++){
+                if(!Link_Wait(FRAMETYPE_BURST, &fragment, 20 * LINK_MS)){
+                    return -1;
+                }
+                MCTP_HostReassemble(&r, &fragment, &frame);
+            }
+            if(!AbortDuring(&hmctp->txPingPong.busy)){
+                return -1;
+            }
+        }
+        bool whole = false;
+        while(Link_Wait(FRAMETYPE_BURST, &fragment, 20 * LINK_MS)){
+            if(MCTP_HostReassemble(&r, &fragment, &frame) == 1){
+                if(frame.dataSize != BURSTHEAD_SIZE + BURST_SIZE ||
+                        memcmp(&frame.data[BURSTHEAD_SIZE], burst, BURST_SIZE) != 0){
+                    return -1;
+                }
+                whole = true;
+            }
+        }
+        if(MCTP_BurstBusy(hmctp) || (round == 1 && !whole)){
+            return -1;
+        }
+        /* Line is quiet. Bytes of the fragment cut short are dropped */
+        Link_Discard();
+    }
+    return 0;
+}
+
+static const Link_Case cases[] = {
+    {"control frame sent again", ControlAgain},
+    {"DATA frames flow on in order", DataFlows},
+    {"reliable frames come through once", ReliableOnce},
+    {"burst after aborted burst", BurstAfter},
+};
+
+int main(void){
+    return Link_RunCases(cases, sizeof(cases) / sizeof(cases[0]));
+}
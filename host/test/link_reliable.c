@@ -0,0 +1,282 @@
+/**
+ * @file link_reliable.c
+ * @brief Reliable mode over a simulated link.
+ *
+ * The controller asks for reliable mode in REQUEST and answers every
+ * DATA frame with DATA_ACK, as mctp_host.h describes. Frames are lost
+ * either by the controller, which ignores chosen SEQUENCE numbers, or
+ * by noise on the line, which breaks their CRC. Noise hits DATA_ACK 
+ * frames too, which the device must then drop rather than free frames
+ * never received. Every frame must come through exactly once, lost 
+ * ones sent again as soon as a later frame is acknowledged past them
+ * (SACK), or after RELIABLE_RTO when none is. No more than WINDOW 
+ * frames may be in flight.
+ */
+
+#include <string.h>
+#include "link.h"
+
+#define BAUD 921600
+#define CHANNEL_SIZE 16
+#define NOISE_FRAMES 300
+#define NOISE_RATE 400          /* One garbled byte in */
+#define HEAVY_NOISE_RATE 50
+
+static uint8_t channelData[2][CHANNEL_SIZE];
+static uint8_t reliableBuf[RELIABLE_MAX_WINDOW * LINK_ARENA_SIZE / 2];
+static uint32_t appLimit;
+static uint32_t appSent;
+static MCTP_HostSchema schema;
+static bool delivered[NOISE_FRAMES];
+
+/*
+ * Sends DATA frames until appLimit, as fast as the window allows.
+ */
+static void App(MCTP_Handle *hmctp){
+    if(hmctp->state == STATE_TRANS && appSent < appLimit){
+        for(int ch = 0; ch < 2; ch++){
+            memcpy(channelData[ch], &appSent, sizeof(appSent));
+            MCTP_WriteChannelData(hmctp, ch, channelData[ch], CHANNEL_SIZE);
+        }
+        if(MCTP_SendAll_DMA(hmctp) == 0){
+            appSent++;
+        }
+    }
+}
+
+/*
+ * Starts a session in reliable mode with <window>, the application
+ * sending <limit> DATA frames.
+ */
+static MCTP_Handle *Setup(uint8_t window, uint32_t limit){
+    MCTP_Handle *hmctp = Link_Setup(BAUD);
+    uint8_t frame[MAX_FRAME_SIZE];
+    MCTP_HostFrame resp;
+
+    hmctp->crcEnabled = true;
+    hmctp->reliableBuf = reliableBuf;
+    hmctp->reliableBufSize = sizeof(reliableBuf);
+    if(Link_Start() < 0){
+        return NULL;
+    }
+    for(int ch = 0; ch < 2; ch++){
+        if(MCTP_EnableChannel(hmctp, ch, channelData[ch], CHANNEL_SIZE, DATATYPE_UINT8) < 0){
+            return NULL;
+        }
+    }
+    appLimit = limit;
+    appSent = 0;
+    Link_SetApp(App);
+
+    Link_SendRaw(frame, MCTP_HostBuildSync(NULL, 0, frame, sizeof(frame)));
+    if(!Link_Wait(FRAMETYPE_SYNC_RESP, &resp, 50 * LINK_MS) ||
+            !Link_Wait(FRAMETYPE_SCHEMA, &resp, 50 * LINK_MS) || 
+            MCTP_HostSchemaUpdate(&schema, &resp) < 0){
+        return NULL;
+    }
+    Link_Send(FRAMETYPE_ACK, NULL, 0);
+    Link_SendRaw(frame, MCTP_HostBuildReliable(window, CREDIT_FRAMES_UNLIMITED,
+                CREDIT_BYTES_UNLIMITED, frame, sizeof(frame)));
+    return hmctp;
+}
+
+static void Ack(const MCTP_HostReliable *r){
+    uint8_t frame[MAX_FRAME_SIZE];
+
+    Link_SendRaw(frame, MCTP_HostBuildDataAck(r, frame, sizeof(frame)));
+}
+
+/*
+ * Takes the next DATA frame within <timeout> ns, and its SEQUENCE.
+ */
+static bool NextData(uint8_t *sequence, uint64_t timeout){
+    MCTP_HostFrame frame;
+
+    return Link_Wait(FRAMETYPE_DATA, &frame, timeout) && MCTP_HostDataSequence(&frame, sequence) == 0;
+}
+
+/*
+ * Takes the next DATA frame within <timeout> ns, its SEQUENCE and the
+ * application count it carries.
+ */
+static bool NextCount(uint8_t *sequence, uint32_t *count, uint64_t timeout){
+    MCTP_HostFrame frame;
+    MCTP_HostChannel channel;
+    uint32_t offset = 0;
+
+    if(!Link_Wait(FRAMETYPE_DATA, &frame, timeout) || MCTP_HostDataSequence(&frame, sequence) < 0 ||
+            MCTP_HostNextChannel(&frame, &schema, &offset, &channel) != 1 || channel.size < sizeof(*count)){
+        return false;
+    }
+    memcpy(count, channel.samples, sizeof(*count));
+    return true;
+}
+
+/*
+ * With no DATA_ACK, sending stops at WINDOW frames. Acknowledging them
+ * lets as many new frames through.
+ */
+static int Window(void){
+    MCTP_HostReliable r;
+    uint8_t seq = 0;
+
+    MCTP_HostReliableInit(&r);
+    if(!Setup(4, 100)){
+        return -1;
+    }
+    for(int round = 0; round < 2; round++){
+        for(int i = 0; i < 4; i++){
+            if(!NextData(&seq, 20 * LINK_MS) || seq != round * 4 + i ||
+                    MCTP_HostReliableReceive(&r, seq) != 1){
+                return -1;
+            }
+        }
+        /* Window is full, well before RELIABLE_RTO */
+        if(NextData(&seq, 50 * LINK_MS)){
+            return -1;
+        }
+        Ack(&r);
+    }
+    return 0;
+}
+
+/*
+ * Frame 2 is lost. Acknowledging later frames in SACK brings it back
+ * long before RELIABLE_RTO, and no other frame comes twice.
+ */
+static int SackRetransmit(void){
+    MCTP_HostReliable r;
+    uint8_t seq = 0;
+    bool lost = false;
+    uint64_t lost_at = 0;
+
+    MCTP_HostReliableInit(&r);
+    if(!Setup(8, 16)){
+        return -1;
+    }
+    while(r.received < 16){
+        if(!NextData(&seq, 100 * LINK_MS)){
+            return -1;
+        }
+        if(seq == 2 && !lost){
+            lost = true;
+            lost_at = HalSim_Now();
+            continue;
+        }
+        if(seq == 2 && HalSim_Now() - lost_at > RELIABLE_RTO * LINK_MS / 4){
+            return -1;
+        }
+        if(MCTP_HostReliableReceive(&r, seq) != 1){
+            return -1;
+        }
+        Ack(&r);
+    }
+    return r.next == 16 && r.duplicated == 0? 0 : -1;
+}
+
+/*
+ * Last frame is lost, so no later frame reveals it. It is sent again
+ * after RELIABLE_RTO.
+ */
+static int RtoRetransmit(void){
+    MCTP_HostReliable r;
+    uint8_t seq = 0;
+    uint64_t lost_at = 0;
+
+    MCTP_HostReliableInit(&r);
+    if(!Setup(8, 3)){
+        return -1;
+    }
+    while(r.received < 3){
+        if(!NextData(&seq, 2 * RELIABLE_RTO * LINK_MS)){
+            return -1;
+        }
+        if(seq == 2 && !lost_at){
+            lost_at = HalSim_Now();
+            continue;
+        }
+        if(MCTP_HostReliableReceive(&r, seq) != 1){
+            return -1;
+        }
+        Ack(&r);
+    }
+
+    uint64_t elapsed = (HalSim_Now() - lost_at) / LINK_MS;
+    return seq == 2 && elapsed >= RELIABLE_RTO - 1 && elapsed < RELIABLE_RTO + 20? 0 : -1;
+}
+
+/*
+ * Noise breaks frames at random, one in <peer_rate> bytes from the 
+ * controller. Each one still comes through once, whatever the window:
+ * the application count of every new frame is seen exactly once, and
+ * matches its SEQUENCE.
+ */
+static int Noise(uint8_t window, uint32_t peer_rate){
+    MCTP_Handle *hmctp;
+    MCTP_HostReliable r;
+    uint8_t seq = 0;
+    uint32_t count = 0;
+
+    MCTP_HostReliableInit(&r);
+    memset(delivered, 0, sizeof(delivered));
+    if(!(hmctp = Setup(window, NOISE_FRAMES))){
+        return -1;
+    }
+    HalSim_SetNoise(NOISE_RATE);
+    HalSim_SetPeerNoise(peer_rate);
+    while(r.received < NOISE_FRAMES){
+        if(!NextCount(&seq, &count, 4 * RELIABLE_RTO * LINK_MS)){
+            return -1;
+        }
+        int ret = MCTP_HostReliableReceive(&r, seq);
+        if(ret < 0 || (ret == 1 && (count >= NOISE_FRAMES || delivered[count] || (uint8_t)count != seq))){
+            return -1;
+        }
+        if(ret == 1){
+            delivered[count] = true;
+        }
+        Ack(&r);
+    }
+    /* Nothing left to send, and frames and DATA_ACKs were lost on the way */
+    HalSim_SetPeerNoise(0);
+    Ack(&r);
+    Link_Run(2 * RELIABLE_RTO * LINK_MS);
+    if(NextData(&seq, 0) || HalSim_GetStats()->txGarbled == 0 || hmctp->recv.crcErrors == 0){
+        return -1;
+    }
+    return r.next == (uint8_t)NOISE_FRAMES? 0 : -1;
+}
+
+static int Noise1(void){
+    return Noise(1, NOISE_RATE);
+}
+
+static int Noise8(void){
+    return Noise(8, NOISE_RATE);
+}
+
+static int Noise32(void){
+    return Noise(RELIABLE_MAX_WINDOW, NOISE_RATE);
+}
+
+/*
+ * Resync after so many broken DATA_ACKs finds frames made of bytes of
+ * others, such as DROP, which must not end the session.
+ */
+static int HeavyNoise(void){
+    return Noise(8, HEAVY_NOISE_RATE);
+}
+
+static const Link_Case cases[] = {
+    {"window bounds frames in flight", Window},
+    {"SACK gap sent again", SackRetransmit},
+    {"last frame sent again after RTO", RtoRetransmit},
+    {"noise, window 1", Noise1},
+    {"noise, window 8", Noise8},
+    {"noise, window 32", Noise32},
+    {"heavy noise from controller", HeavyNoise},
+};
+
+int main(void){
+    return Link_RunCases(cases, sizeof(cases) / sizeof(cases[0]));
+}
@@ -0,0 +1,165 @@
+/**
+ * @file rx_burst.c
+ * @brief UART reception of bursty input, through the simulated HAL.
+ *
+ * The peer sends frames in bursts of random length separated by random
+ * gaps, so bursts end anywhere in a frame and the DMA ring is drained
+ * on half transfer, transfer complete and idle line events at any 
+ * position. The main loop takes frames every POLL_PERIOD, as MCTP_Poll
+ * would. Every frame must come out whole and in order, for RXMODE_IT
+ * and RXMODE_DMA, with and without COBS.
+ *
+ * Payloads are random, so they hold EOM bytes and bytes that could 
+ * start a frame. Interrupts per byte received are printed for each 
+ * mode.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal_sim.h"
+#include "mctp_host.h"
+#include "mctp_rx.h"
+
+#define FRAMES 3000
+#define MAX_PAYLOAD 300
+#define MAX_BURST 200
+#define POLL_PERIOD 100000      /* ns */
+
+MCTP_Handle *g_Hmctp;
+
+/* Only reception is linked, and nothing transmitted to abort */
+void MCTP_TxAbort(MCTP_Handle *hmctp){}
+
+static UART_HandleTypeDef huart;
+static DMA_HandleTypeDef hdmarx;
+static MCTP_Handle hmctp;
+
+static uint32_t Rand(uint32_t *state){
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/*
+ * Takes every queued frame and checks it against the next expected
+ * ones in <frames>.
+ *
+ * Returns 0 on success and -1 on a wrong frame
+ */
+static int Poll(const uint8_t *frames, const uint32_t *offsets, uint32_t *next){
+    int status = 0;
+    MCTP_View msg;
+    uint8_t frame[MAX_FRAME_SIZE];
+
+    while(MCTP_RecvPeek(&hmctp.recv, &msg) == 0){
+        if(*next >= FRAMES){
+            status = -1;
+            MCTP_RecvRelease(&hmctp.recv);
+            continue;
+        }
+        uint32_t size = offsets[*next + 1] - offsets[*next];
+        if(msg.size != size ||
+                MCTP_ViewRead(&msg, 0, frame, msg.size) < 0 ||
+                memcmp(frame, &frames[offsets[*next]], size) != 0){
+            status = -1;
+        }
+        (*next)++;
+        MCTP_RecvRelease(&hmctp.recv);
+    }
+    return status;
+}
+
+static int Run(E_MCTP_RxMode mode, bool cobs, uint32_t baud){
+    static uint8_t frames[FRAMES * (HEADER_SIZE + MAX_PAYLOAD + EOM_SIZE)];
+    static uint8_t stream[FRAMES * COBS_MAX_SIZE(HEADER_SIZE + MAX_PAYLOAD + EOM_SIZE)];
+    static uint32_t offsets[FRAMES + 1];
+    uint32_t state = 0xC0FFEE;
+    uint32_t stream_size = 0;
+    uint32_t next = 0;
+    int status = 0;
+
+    /* Frames, and the bytes on the line */
+    offsets[0] = 0;
+    for(uint32_t i = 0; i < FRAMES; i++){
+        uint8_t data[MAX_PAYLOAD];
+        uint16_t size = Rand(&state) % MAX_PAYLOAD;
+        for(uint16_t j = 0; j < size; j++){
+            data[j] = (Rand(&state) & 1)? 0x24 + Rand(&state) % 3 : Rand(&state);
+        }
+        uint32_t frame_size = MCTP_HostBuildFrame(FRAMETYPE_DATA, data, size, &frames[offsets[i]], sizeof(frames) - offsets[i]);
+        if(cobs){
+            stream_size += MCTP_HostCobsEncode(&frames[offsets[i]], frame_size, &stream[stream_size], sizeof(stream) - stream_size);
+        }else{
+            memcpy(&stream[stream_size], &frames[offsets[i]], frame_size);
+            stream_size += frame_size;
+        }
+        offsets[i + 1] = offsets[i] + frame_size;
+    }
+
+    memset(&hmctp, 0, sizeof(hmctp));
+    huart.Init.BaudRate = baud;
+    hdmarx.Init.Mode = DMA_CIRCULAR;
+    huart.hdmarx = &hdmarx;
+    hmctp.huart = &huart;
+    hmctp.rxMode = mode;
+    hmctp.running = true;
+    g_Hmctp = &hmctp;
+    HalSim_Init(&huart);
+    MCTP_RecvInit(&hmctp.recv, cobs);
+    if(MCTP_RxStart(&hmctp) < 0){
+        return -1;
+    }
+
+    /* Bursts, polled meanwhile */
+    uint64_t char_time = 10ull * 1000000000ull / baud;
+    uint32_t sent = 0;
+    while(sent < stream_size){
+        uint32_t n = 1 + Rand(&state) % MAX_BURST;
+        if(n > stream_size - sent){
+            n = stream_size - sent;
+        }
+        HalSim_Send(&stream[sent], n, baud);
+        sent += n;
+
+        uint64_t until = HalSim_SendDone() + char_time * (Rand(&state) % 6);
+        while(HalSim_Now() < until){
+            HalSim_Run(POLL_PERIOD);
+            if(Poll(frames, offsets, &next) < 0){
+                status = -1;
+            }
+        }
+    }
+    HalSim_Run(10 * char_time);
+    if(Poll(frames, offsets, &next) < 0){
+        status = -1;
+    }
+
+    const HalSim_Stats *stats = HalSim_GetStats();
+    if(next != FRAMES || hmctp.recv.queue.dropped || stats->rxLost){
+        status = -1;
+    }
+
+    printf("%-4s %-4s %7u baud: %u/%u frames, %.3f interrupts per byte  %s\n",
+        mode == RXMODE_DMA? "dma" : "it", cobs? "cobs" : "eom", baud, next, FRAMES,
+        (double)stats->rxCallbacks / stats->rxBytes, status == 0? "ok" : "FAIL");
+    return status;
+}
+
+int main(void){
+    static const uint32_t bauds[] = {115200, 921600};
+    int status = 0;
+
+    for(int b = 0; b < 2; b++){
+        for(int cobs = 0; cobs < 2; cobs++){
+            if(Run(RXMODE_IT, cobs, bauds[b]) < 0 || Run(RXMODE_DMA, cobs, bauds[b]) < 0){
+                status = 1;
+            }
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,213 @@
+/**
+ * @file rx_thread.c
+ * @brief Receive path under a real second thread.
+ *
+ * A producer thread plays the UART interrupt, feeding serialized 
+ * frames to MCTP_RecvIngest in chunks of random size, while the main 
+ * thread plays MCTP_Poll, taking frames with MCTP_RecvPeek and 
+ * MCTP_RecvRelease. Both framings are run:
+ *
+ * throttled: producer waits for queue space before each frame, so 
+ *            every frame must come out, whole and in order.
+ * free:      producer never waits, and consumer stalls now and then,
+ *            so frames are dropped. Frames coming out must still be
+ *            whole and in order.
+ *
+ * Frame contents only use bytes that can't start a frame nor look
+ * like EOM, so a resync never finds a frame that wasn't sent.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "mctp_host.h"
+#include "mctp_recv.h"
+
+#define FRAMES 100000
+#define THROTTLED_MAX_PAYLOAD (RECV_BUFFER_SIZE / RECV_QUEUE_SIZE - HEADER_SIZE - EOM_SIZE)
+#define FREE_MAX_PAYLOAD 600
+#define MAX_CHUNK 96
+
+typedef struct{
+    MCTP_Receiver recv;
+    bool throttled;
+    uint16_t maxPayload;
+    atomic_bool done;
+} Link;
+
+static uint32_t Rand(uint32_t *state){
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/*
+ * Payload of frame <index>: index on 4 bytes, then bytes derived from
+ * it. Every byte is in 0x40..0x7F.
+ */
+static uint16_t Payload(uint32_t index, uint16_t max_payload, uint8_t *data){
+    uint32_t state = index * 2654435761u + 1;
+    uint16_t size = 4 + Rand(&state) % (max_payload - 3);
+
+    for(int i = 0; i < 4; i++){
+        data[i] = 0x40 | ((index >> (6 * i)) & 0x3F);
+    }
+    for(uint16_t i = 4; i < size; i++){
+        data[i] = 0x40 | (Rand(&state) & 0x3F);
+    }
+    return size;
+}
+
+static void Feed(Link *link, const uint8_t *data, uint32_t size, uint32_t *state){
+    while(size > 0){
+        uint16_t n = 1 + Rand(state) % MAX_CHUNK;
+        if(n > size){
+            n = size;
+        }
+        MCTP_RecvIngest(&link->recv, data, n);
+        data += n;
+        size -= n;
+    }
+}
+
+static void *Producer(void *arg){
+    Link *link = arg;
+    MCTP_RecvQueue *queue = &link->recv.queue;
+    uint32_t state = 0x12345678;
+    uint8_t data[FREE_MAX_PAYLOAD];
+    uint8_t frame[MAX_FRAME_SIZE];
+    uint8_t encoded[COBS_MAX_SIZE(sizeof(frame))];
+
+    for(uint32_t index = 0; index < FRAMES; index++){
+        uint16_t size = Payload(index, link->maxPayload, data);
+        uint32_t frame_size = MCTP_HostBuildFrame(FRAMETYPE_DATA, data, size, frame, sizeof(frame));
+        const uint8_t *bytes = frame;
+        if(link->recv.cobs){
+            frame_size = MCTP_HostCobsEncode(frame, frame_size, encoded, sizeof(encoded));
+            bytes = encoded;
+        }
+
+        if(link->throttled){
+            while(atomic_load(&queue->head) - atomic_load(&queue->tail) >= RECV_QUEUE_SIZE){
+                sched_yield();
+            }
+        }
+        Feed(link, bytes, frame_size, &state);
+        if(!link->throttled){
+            /* Bytes come no faster than the line */
+            sched_yield();
+        }
+    }
+
+    atomic_store(&link->done, true);
+    return NULL;
+}
+
+/*
+ * Checks the frame in <msg> is whole frame <*index> or a later one,
+ * and moves <*index> past it.
+ *
+ * Returns 0 on success and -1 on a broken or out of order frame
+ */
+static int Check(Link *link, const MCTP_View *msg, uint32_t *index){
+    static const uint8_t eom[EOM_SIZE] = EOM_BYTES;
+    uint8_t frame[MAX_FRAME_SIZE];
+    uint8_t expected[FREE_MAX_PAYLOAD];
+
+    if(msg->size < MIN_FRAME_SIZE + 4 || MCTP_ViewRead(msg, 0, frame, msg->size) < 0){
+        return -1;
+    }
+
+    uint32_t got = 0;
+    for(int i = 0; i < 4; i++){
+        got |= (uint32_t)(frame[HEADER_SIZE + i] & 0x3F) << (6 * i);
+    }
+    if(got < *index || (link->throttled && got != *index)){
+        return -1;
+    }
+
+    uint16_t size = Payload(got, link->maxPayload, expected);
+    uint16_t data_size;
+    memcpy(&data_size, &frame[1], 2);
+    if(frame[0] != FRAMETYPE_DATA || data_size != size ||
+            msg->size != HEADER_SIZE + size + EOM_SIZE ||
+            memcmp(&frame[HEADER_SIZE], expected, size) != 0 ||
+            memcmp(&frame[HEADER_SIZE + size], eom, EOM_SIZE) != 0){
+        return -1;
+    }
+
+    *index = got + 1;
+    return 0;
+}
+
+static int Run(bool cobs, bool throttled){
+    static Link link;
+    pthread_t producer;
+    uint32_t state = 0x9E3779B9;
+    uint32_t index = 0;
+    uint32_t received = 0;
+    int status = 0;
+
+    MCTP_RecvInit(&link.recv, cobs);
+    link.throttled = throttled;
+    link.maxPayload = throttled? THROTTLED_MAX_PAYLOAD : FREE_MAX_PAYLOAD;
+    atomic_init(&link.done, false);
+
+    if(pthread_create(&producer, NULL, Producer, &link) != 0){
+        return -1;
+    }
+
+    for(;;){
+        MCTP_View msg;
+        if(MCTP_RecvPeek(&link.recv, &msg) < 0){
+            if(atomic_load(&link.done) && MCTP_RecvPeek(&link.recv, &msg) < 0){
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        if(status == 0 && Check(&link, &msg, &index) < 0){
+            fprintf(stderr, "broken frame after %u\n", index);
+            status = -1;
+        }
+        received++;
+        MCTP_RecvRelease(&link.recv);
+
+        if(!throttled && Rand(&state) % 64 == 0){
+            usleep(50);
+        }
+    }
+    pthread_join(producer, NULL);
+
+    if(throttled && (received != FRAMES || link.recv.queue.dropped != 0)){
+        status = -1;
+    }
+    if(!throttled && received == 0){
+        status = -1;
+    }
+
+    printf("%-4s %-9s received %6u dropped %6u  %s\n", cobs? "cobs" : "eom",
+        throttled? "throttled" : "free", received, link.recv.queue.dropped,
+        status == 0? "ok" : "FAIL");
+    return status;
+}
+
+int main(void){
+    int status = 0;
+
+    for(int cobs = 0; cobs < 2; cobs++){
+        for(int throttled = 1; throttled >= 0; throttled--){
+            if(Run(cobs, throttled) < 0){
+                status = 1;
+            }
+        }
+    }
+
+    return status;
+}
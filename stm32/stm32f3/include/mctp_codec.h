@@ -0,0 +1,68 @@
+#ifndef MCTP_CODEC_H
+#define MCTP_CODEC_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "mctp_protocol.h"
+
+/*
+ * Sample encodings of the channels data types that are not copied as
+ * they are. No HAL dependency.
+ */
+
+/*
+ * Converts <f> to IEEE 754 half precision, rounding to nearest even.
+ * Values too large for half precision become infinity, NaN stays NaN,
+ * and values too small become subnormal or zero.
+ */
+uint16_t MCTP_FloatToHalf(float f);
+
+/*
+ * Encodes <n> samples of <src> as DATATYPE_FLOAT16 on <dst>, 2 bytes
+ * per sample, little-endian. <dst> needs no alignment.
+ */
+void MCTP_EncodeFloat16(const float *src, uint8_t *dst, uint16_t n);
+
+/*
+ * Encodes <n> samples of <src> as DATATYPE_Q15 or DATATYPE_Q7 on <dst>,
+ * as fractions of (sample - <offset>) / <scale>, saturated to [-1, 1).
+ * Q15 samples take 2 bytes, little-endian. Q7 samples take 1 byte. 
+ * <scale> must not be 0.
+ *
+ * With MCTP_USE_CMSIS_DSP defined, conversion uses CMSIS-DSP kernels 
+ * and <dst> must be 2 byte aligned for Q15.
+ */
+void MCTP_EncodeQ15(const float *src, uint8_t *dst, uint16_t n, float scale, float offset);
+void MCTP_EncodeQ7(const float *src, uint8_t *dst, uint16_t n, float scale, float offset);
+
+/*
+ * Encodes <n> samples of <src> as DATATYPE_FLOAT32_XOR on <dst>, one
+ * block at a time. <dst> must hold XOR_MAX_SIZE(<n>) bytes. 
+ *
+ * Returns number of bytes written
+ */
+uint32_t MCTP_EncodeXor(const float *src, uint8_t *dst, uint16_t n);
+
+/*
+ * Size of samples of delta coded <data_type>, 2 or 4 bytes. 0 if 
+ * type can't be delta coded.
+ */
+uint8_t MCTP_DeltaWidth(E_MCTP_DataType data_type);
+
+/*
+ * Delta codes <n> samples of <width> bytes of <src>, little-endian, 
+ * on <dst>, one block at a time. <dst> must hold 
+ * DELTA_MAX_SIZE(<n>, <width>) bytes. 
+ *
+ * Returns number of bytes written
+ */
+uint32_t MCTP_EncodeDelta(const uint8_t *src, uint8_t *dst, uint16_t n, uint8_t width);
+
+/*
+ * Packs <n> 12 bit samples of <src> as DATATYPE_UINT12 on <dst>, 
+ * UINT12_SIZE(<n>) bytes. Upper 4 bits of samples are ignored.
+ */
+void MCTP_EncodeUint12(const uint16_t *src, uint8_t *dst, uint16_t n);
+
+#endif
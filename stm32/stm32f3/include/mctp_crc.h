@@ -0,0 +1,34 @@
+#ifndef MCTP_CRC_H
+#define MCTP_CRC_H
+
+#include <stdint.h>
+#include "mctp_protocol.h"
+
+/*
+ * CRC-32 of frame trailers: IEEE 802.3 polynomial, reflected, as in 
+ * zlib. Running value starts at MCTP_CRC_INIT, and is complemented 
+ * once all bytes are in.
+ *
+ * With MCTP_USE_HW_CRC defined, the STM32 CRC peripheral computes it.
+ * Otherwise a slice-by-8 table does, 8 bytes per step.
+ */
+#define MCTP_CRC_INIT 0xFFFFFFFFU
+
+/*
+ * Enables CRC peripheral clock. Nothing to do for the table, which is
+ * constant. Called once before any other function.
+ */
+void MCTP_CrcInit(void);
+
+/*
+ * Adds <size> bytes of <data> to running <crc>, which is returned.
+ * <data> needs no alignment. Safe to call from interrupts.
+ */
+uint32_t MCTP_Crc32Update(uint32_t crc, const void *data, uint32_t size);
+
+/*
+ * CRC-32 of <size> bytes of <data>, as written in frame trailers.
+ */
+uint32_t MCTP_Crc32(const void *data, uint32_t size);
+
+#endif
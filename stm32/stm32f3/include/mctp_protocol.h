@@ -0,0 +1,156 @@
+/**
+ * @file mctp_protocol.h
+ * @brief MCTP wire format definitions. 
+ *
+ * Holds no HAL dependency, so controller side code can share it.
+ */
+#ifndef MCTP_PROTOCOL_H
+#define MCTP_PROTOCOL_H
+
+#include <stdint.h>
+
+#define MAX_DATA_SIZE 65536     /* Maximum represented by 2 bytes */
+
+#define HEADER_SIZE 8
+#define DATAHEAD_SIZE 2         /* SEQUENCE and N_OF_CHANNELS of DATA section */
+#define DATAINFO_SIZE 4
+#define EOM_SIZE 3
+#define EOM_BYTES {0x24, 0x25, 0x26}
+#define MIN_FRAME_SIZE (HEADER_SIZE + EOM_SIZE)
+#define MAX_FRAME_SIZE (HEADER_SIZE + MAX_DATA_SIZE + EOM_SIZE)
+#define SYNCRESP_FRAME_SIZE (HEADER_SIZE + 5 + EOM_SIZE)
+#define SCALEINFO_SIZE 8         /* SCALE and OFFSET of fixed point channels in SCHEMA */
+#define SCHEMA_FRAME_SIZE(n) (HEADER_SIZE + 2 + (n) * (DATAINFO_SIZE + SCALEINFO_SIZE) + EOM_SIZE)  /* Largest */
+
+/* 
+ * HEADER section FLAGS(1). Frames with no flag carry the legacy 
+ * filler in FLAGS and TIMESTAMP, so bits 0 to 3 are never used as 
+ * flags.
+ */
+#define HEADER_FILLER 0x05
+#define HEADER_FLAG_TIMESTAMP 0x80  /* TIMESTAMP(4) holds device time of
+                                       first samples, in us */
+#define HEADER_FLAG_SCHEMA 0x40     /* DATA frame follows announced schema.
+                                       Datainfo is left out */
+#define HEADER_FLAG_FRAGMENT 0x20   /* Frame is a fragment of a larger one.
+                                       DATA section starts with FRAGHEAD */
+#define HEADER_FLAG_CRC 0x10        /* CRC(4) trailer between DATA section 
+                                       and EOM */
+
+#define CRC_SIZE 4              /* CRC-32 of HEADER and DATA sections */
+
+/* 
+ * COBS framing. The whole frame, EOM included, is encoded with 
+ * Consistent Overhead Byte Stuffing and followed by COBS_DELIMITER, 
+ * which then never occurs inside a frame.
+ */
+#define COBS_BLOCK_SIZE 254     /* Data bytes per code byte, at most */
+#define COBS_DELIMITER 0x00
+#define COBS_MAX_SIZE(n) ((n) + (n) / COBS_BLOCK_SIZE + 2)  /* Encoded <n> bytes 
+                                   and delimiter, at most */
+
+#define FRAGHEAD_SIZE 4         /* FRAGMENT_INDEX(2) and FRAGMENT_COUNT(2) */
+#define BURSTHEAD_SIZE 2        /* CHANNEL_ID and DATA_FORMAT of BURST */
+
+#define MAX_BAUD_RATES 16       /* Rates offered in a SYNC frame */
+#define PROBE_SIZE 8
+#define PROBE_BYTES {0x55, 0xAA, 0x00, 0xFF, 0x0F, 0xF0, 0x33, 0xCC}   /* Edges at 
+                                   every bit, and long runs */
+#define PROBE_FRAME_SIZE (HEADER_SIZE + PROBE_SIZE + EOM_SIZE)
+#define CREDIT_SIZE 6           /* CREDIT_FRAMES(2) and CREDIT_BYTES(4) */
+#define CREDIT_FRAMES_UNLIMITED 0xFFFF
+#define CREDIT_BYTES_UNLIMITED 0xFFFFFFFF
+#define REQUEST_RELIABLE_SIZE (CREDIT_SIZE + 1)     /* Credit, then WINDOW(1) */
+#define RELIABLE_MAX_WINDOW 32  /* DATA frames not acknowledged. Bounded by SACK bits */
+#define DATAACK_SIZE 5          /* NEXT_SEQUENCE(1) and SACK(4) */
+#define RELIABLE_RTO 200        /* ms before a DATA frame not acknowledged is sent again */
+#define BAUD_PROBE_TIMEOUT 500  /* ms at a new baud rate without confirmation 
+                                   before falling back */
+
+/**
+ * @enum
+ * @brief MCTP frame type, first byte of every frame.
+ */
+typedef enum{
+    FRAMETYPE_NONE        = 0,
+    FRAMETYPE_SYNC        = 1,
+    FRAMETYPE_SYNC_RESP   = 2,
+    FRAMETYPE_ACK         = 3,
+    FRAMETYPE_REQUEST     = 4,
+    FRAMETYPE_DATA        = 5,
+    FRAMETYPE_STOP        = 6,
+    FRAMETYPE_DROP        = 7,
+    FRAMETYPE_SCHEMA      = 8,
+    FRAMETYPE_BURST       = 9,  /* Always fragmented */
+    FRAMETYPE_PROBE       = 10, /* Checks link at a new baud rate. Echoed */
+    FRAMETYPE_CREDIT      = 11, /* Grants more DATA frames */
+    FRAMETYPE_DATA_ACK    = 12, /* Acknowledges DATA frames in reliable mode */
+    FRAMETYPE_END,              /* Not a frame type. Bounds valid types */
+} E_MCTP_FrameType;
+
+/**
+ * @enum
+ * @brief MCTP identifier for data type enumeration.
+ */
+typedef enum{
+    DATATYPE_CHAR     = 0,
+    DATATYPE_INT8     = 1,
+    DATATYPE_INT16    = 2,
+    DATATYPE_INT32    = 3,
+    DATATYPE_UINT8    = 4,
+    DATATYPE_UINT16   = 5,
+    DATATYPE_UINT32   = 6,
+    DATATYPE_FLOAT8   = 7,
+    DATATYPE_FLOAT16  = 8,
+    DATATYPE_FLOAT32  = 9,
+    DATATYPE_Q15      = 10,     /* Fixed point, scaled. See SCHEMA */
+    DATATYPE_Q7       = 11,     /* Fixed point, scaled. See SCHEMA */
+    DATATYPE_FLOAT32_XOR = 12,  /* FLOAT32, XOR compressed. See below */
+    DATATYPE_UINT12   = 13,     /* Packed. See below */
+} E_MCTP_DataType;
+
+/* Channel samples are fixed point, with SCALE and OFFSET in SCHEMA */
+#define DATATYPE_IS_SCALED(t) ((t) == DATATYPE_Q15 || (t) == DATATYPE_Q7)
+
+/*
+ * DATATYPE_FLOAT32_XOR samples are blocks of up to XOR_BLOCK_SAMPLES:
+ * BLOCK_HEAD(1) | BLOCK(x). BLOCK_HEAD holds number of samples - 1, 
+ * and XOR_BLOCK_RAW if BLOCK is plain FLOAT32 instead of an XOR 
+ * bitstream. A block is never larger than its FLOAT32 samples.
+ *
+ * XOR bitstream, MSB first. Each sample bit pattern is XORed with the
+ * previous one, 0 before the first sample of the channel, and coded as
+ *   '0'                            XOR is 0
+ *   '10' + BITS                    XOR fits the current window
+ *   '11' + LZ(5) + LEN-1(5) + BITS new window, LEN bits after LZ 
+ *                                  leading zero bits
+ * There is no window at block start. Last byte is padded with 0.
+ */
+#define XOR_BLOCK_SAMPLES 128
+#define XOR_BLOCK_RAW 0x80
+#define XOR_MAX_SIZE(n) ((n) * 4 + ((n) + XOR_BLOCK_SAMPLES - 1) / XOR_BLOCK_SAMPLES)
+
+/*
+ * DATATYPE_DELTA is OR'ed into INT16, UINT16, INT32 and UINT32 types 
+ * of channels whose samples are delta coded. Samples are blocks of up
+ * to DELTA_BLOCK_SAMPLES: BLOCK_HEAD(1) | BLOCK(x). BLOCK_HEAD holds 
+ * number of samples - 1, and DELTA_BLOCK_RAW if BLOCK is plain 
+ * samples. Otherwise BLOCK is the first sample, plain, then the 
+ * difference to the previous sample of each other one, wrapped to 
+ * sample width, zigzag mapped and LEB128 varint coded. A block is 
+ * never larger than its plain samples.
+ */
+#define DATATYPE_DELTA 0x40
+#define DATATYPE_BASE(t) ((t) & ~DATATYPE_DELTA)
+#define DELTA_BLOCK_SAMPLES 128
+#define DELTA_BLOCK_RAW 0x80
+#define DELTA_MAX_SIZE(n, width) ((n) * (width) + ((n) + DELTA_BLOCK_SAMPLES - 1) / DELTA_BLOCK_SAMPLES)
+
+/*
+ * DATATYPE_UINT12 samples are packed in pairs, a and b, on 3 bytes:
+ * a[7:0] | b[3:0] a[11:8] | b[11:4]. An odd last sample takes 2 bytes,
+ * a[7:0] | a[11:8].
+ */
+#define UINT12_SIZE(n) (((n) * 3 + 1) / 2)
+
+#endif
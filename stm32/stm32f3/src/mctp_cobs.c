@@ -0,0 +1,163 @@
+/**
+ * @file mctp_cobs.c
+ * @brief COBS encoding of frames.
+ */
+
+/*
+ * With EOM framing, a receiver that misjudged a frame boundary hunts
+ * for the next frame byte by byte. With COBS, the delimiter can only
+ * be a frame boundary, so a corrupted frame costs that frame only, and
+ * the next one starts after the next delimiter.
+ *
+ * Whole frames are serialized a few bytes into their buffer, and
+ * encoded forward to its start, so no second buffer is needed. Runs 
+ * between zeros are found with memchr and moved with memmove, not one
+ * byte at a time.
+ *
+ * Frames written in chunks are encoded in place. Each zero byte is 
+ * replaced by the code byte of the block after it, and the code byte
+ * of the block before it is patched with the distance. Only blocks of
+ * COBS_BLOCK_SIZE bytes without zero insert a code byte, so encoded 
+ * frames grow by one byte per COBS_BLOCK_SIZE bytes, plus the first
+ * code byte and the delimiter.
+ */
+
+#include <string.h>
+#include "mctp_cobs.h"
+
+/*
+ * Each code byte is written before the block it heads is moved. The
+ * write position never passes the read position, given the distance
+ * asked for <dst>.
+ */
+uint32_t MCTP_CobsEncode(uint8_t *dst, const uint8_t *src, uint32_t size){
+    const uint8_t *end = src + size;
+    uint8_t *p = dst;
+
+    for(;;){
+        uint32_t left = end - src;
+        uint32_t run = left < COBS_BLOCK_SIZE? left : COBS_BLOCK_SIZE;
+        const uint8_t *zero = memchr(src, COBS_DELIMITER, run);
+        if(zero){
+            run = zero - src;
+        }
+
+        *p = run + 1;
+        memmove(p + 1, src, run);
+        p += run + 1;
+        src += run;
+
+        if(zero){
+            /* Zero is implied by the code byte */
+            src++;
+        }else if(run < COBS_BLOCK_SIZE || src == end){
+            break;
+        }
+    }
+    *p++ = COBS_DELIMITER;
+
+    return p - dst;
+}
+
+uint32_t MCTP_CobsCapacity(uint32_t size){
+    if(size < COBS_MAX_SIZE(0)){
+        return 0;
+    }
+
+    uint32_t n = size - COBS_MAX_SIZE(0);
+    n -= n / (COBS_BLOCK_SIZE + 1);
+    while(COBS_MAX_SIZE(n) > size){
+        n--;
+    }
+    while(COBS_MAX_SIZE(n + 1) <= size){
+        n++;
+    }
+    return n;
+}
+
+/*
+ * Code bytes are followed from the start of the frame. <offset> is in
+ * the first COBS_BLOCK_SIZE bytes, so no code byte was inserted before
+ * it, and it is encoded at <offset> + 1, unless a code byte replaced
+ * it.
+ */
+uint8_t MCTP_CobsPeek(const uint8_t *src, uint8_t offset){
+    uint16_t code = 0;
+
+    while(code <= offset){
+        code += src[code];
+    }
+    return code == offset + 1? 0 : src[offset + 1];
+}
+
+void MCTP_CobsEncoderStart(MCTP_CobsEncoder *enc){
+    enc->head = 0;
+    enc->code = 0;
+    enc->tail = 1;
+    enc->ended = false;
+}
+
+/*
+ * Space never goes beyond the end of the open block, so a full block
+ * is closed only once more bytes come, and the last block of a frame
+ * never needs a code byte of its own. The open block is moved back to
+ * the start once it passed the first half of buf.
+ */
+uint16_t MCTP_CobsEncoderSpace(MCTP_CobsEncoder *enc, uint8_t **space){
+    uint16_t run = enc->tail - enc->code - 1;
+
+    if(enc->ended || enc->head != enc->code){
+        return 0;
+    }
+    if(run == COBS_BLOCK_SIZE){
+        /* Block full, without zero */
+        enc->buf[enc->code] = 0xFF;
+        enc->code = enc->tail++;
+        return 0;
+    }
+    if(enc->code > COBS_BLOCK_SIZE){
+        memmove(enc->buf, &enc->buf[enc->code], run + 1);
+        enc->head = 0;
+        enc->code = 0;
+        enc->tail = run + 1;
+    }
+
+    *space = &enc->buf[enc->tail];
+    return COBS_BLOCK_SIZE - run;
+}
+
+void MCTP_CobsEncoderCommit(MCTP_CobsEncoder *enc, uint16_t n){
+    uint8_t *p = &enc->buf[enc->tail];
+    uint8_t *end = p + n;
+
+    while((p = memchr(p, COBS_DELIMITER, end - p)) != NULL){
+        uint16_t zero = p - enc->buf;
+        enc->buf[enc->code] = zero - enc->code;
+        enc->code = zero;
+        p++;
+    }
+    enc->tail += n;
+}
+
+void MCTP_CobsEncoderEnd(MCTP_CobsEncoder *enc){
+    enc->buf[enc->code] = enc->tail - enc->code;
+    enc->buf[enc->tail++] = COBS_DELIMITER;
+    enc->code = enc->tail;
+    enc->ended = true;
+}
+
+uint16_t MCTP_CobsEncoderRead(MCTP_CobsEncoder *enc, uint8_t *dst, uint16_t size){
+    uint16_t n = enc->code - enc->head;
+
+    if(n > size){
+        n = size;
+    }
+    memcpy(dst, &enc->buf[enc->head], n);
+    enc->head += n;
+
+    return n;
+}
+
+bool MCTP_CobsEncoderDone(MCTP_CobsEncoder *enc){
+    return enc->ended && enc->head == enc->code;
+}
@@ -0,0 +1,148 @@
+/**
+ * @file mctp_rx.c
+ * @brief MCTP UART reception.
+ */
+
+/*
+ * Received bytes reach MCTP_RecvIngest in one of two ways, depending
+ * on the handle rxMode:
+ *
+ * RXMODE_IT: UART interrupt reception of a single byte, re-armed 
+ * after every byte.
+ *
+ * RXMODE_DMA: UART reception to idle on a circular DMA ring. HAL 
+ * reports the ring write position on half transfer, transfer complete 
+ * and idle line events, and every byte written since the last event 
+ * is ingested at once.
+ *
+ * Frames are delimited and queued for MCTP_Poll by the receiver of 
+ * the handle, see mctp_recv.c. Only the UART side is here.
+ */
+
+#include "mctp_rx.h"
+#include "mctp_tx.h"
+
+extern MCTP_Handle *g_Hmctp;
+
+static void MCTP_RxDrainDMA(MCTP_Handle *hmctp, uint16_t pos);
+
+/**
+ * @brief Start UART reception.
+ * @param hmctp Handle for MCTP communication.
+ * @return 0 on success. Negative value if an error occurred.
+ */
+int MCTP_RxStart(MCTP_Handle *hmctp){
+    int status = 0;
+
+    hmctp->rxDmaPos = 0;
+
+    switch(hmctp->rxMode){
+        case RXMODE_IT:
+            if(HAL_UART_Receive_IT(hmctp->huart, hmctp->rxDmaBuf, 1) != HAL_OK){
+                status = -1;
+            }
+            break;
+        case RXMODE_DMA:
+            if(!hmctp->huart->hdmarx || hmctp->huart->hdmarx->Init.Mode != DMA_CIRCULAR){
+                status = -1;
+                break;
+            }
+            if(HAL_UARTEx_ReceiveToIdle_DMA(hmctp->huart, hmctp->rxDmaBuf, RX_DMA_BUFFER_SIZE) != HAL_OK){
+                status = -1;
+            }
+            break;
+        default:
+            status = -1;
+            break;
+    }
+
+    return status;
+}
+
+/*
+ * HAL_UART_Init only reprograms the UART, keeping linked DMA channels.
+ * Frames already queued for MCTP_Poll are kept.
+ */
+int MCTP_RxSetBaudRate(MCTP_Handle *hmctp, uint32_t baud_rate){
+    int status = 0;
+
+    if(hmctp->huart->Init.BaudRate == baud_rate){
+        goto exit;
+    }
+
+    HAL_UART_AbortReceive(hmctp->huart);
+    MCTP_RecvReset(&hmctp->recv);
+
+    hmctp->huart->Init.BaudRate = baud_rate;
+    if(HAL_UART_Init(hmctp->huart) != HAL_OK){
+        status = -1;
+        goto exit;
+    }
+    status = MCTP_RxStart(hmctp);
+
+exit:
+    return status;
+}
+
+/**
+ * @brief Callback for RX complete. 
+ * @note Called during task to receive bytes individually (RXMODE_IT)
+ */
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
+    if(huart != g_Hmctp->huart || !g_Hmctp->running){
+        return;
+    }
+    MCTP_RecvIngest(&g_Hmctp->recv, g_Hmctp->rxDmaBuf, 1);
+    HAL_UART_Receive_IT(g_Hmctp->huart, g_Hmctp->rxDmaBuf, 1);
+}
+
+/**
+ * @brief Callback for RX events (RXMODE_DMA).
+ * @note Called on half transfer, transfer complete and idle line.
+ *       <pos> is the position in the DMA ring of the last byte written.
+ */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t pos){
+    if(huart != g_Hmctp->huart || !g_Hmctp->running){
+        return;
+    }
+    MCTP_RxDrainDMA(g_Hmctp, pos);
+}
+
+/**
+ * @brief Callback for UART errors.
+ * @note On a DMA error, HAL aborts transmission and gets TX ready 
+ *       again. The frame in flight is then sent again or dropped, and
+ *       the next one started, see MCTP_TxAbort. HAL aborts reception
+ *       on overrun, and on any error with RXMODE_DMA. Only then is it
+ *       restarted, so the communication task is not left deaf. Noise,
+ *       framing and parity errors in RXMODE_IT leave it running.
+ */
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart){
+    if(huart != g_Hmctp->huart || !g_Hmctp->running){
+        return;
+    }
+    if((huart->ErrorCode & HAL_UART_ERROR_DMA) && huart->gState == HAL_UART_STATE_READY){
+        MCTP_TxAbort(g_Hmctp);
+    }
+    if(huart->RxState == HAL_UART_STATE_READY){
+        MCTP_RxStart(g_Hmctp);
+    }
+}
+
+/*
+ * Ingests all bytes written by DMA to the ring between the last 
+ * processed position and <pos>.
+ */
+static void MCTP_RxDrainDMA(MCTP_Handle *hmctp, uint16_t pos){
+    uint16_t last = hmctp->rxDmaPos;
+
+    if(pos > last){
+        MCTP_RecvIngest(&hmctp->recv, &hmctp->rxDmaBuf[last], pos - last);
+    }else if(pos < last){
+        /* DMA wrapped around the ring */
+        MCTP_RecvIngest(&hmctp->recv, &hmctp->rxDmaBuf[last], RX_DMA_BUFFER_SIZE - last);
+        MCTP_RecvIngest(&hmctp->recv, hmctp->rxDmaBuf, pos);
+    }
+
+    hmctp->rxDmaPos = (pos >= RX_DMA_BUFFER_SIZE)? 0 : pos;
+}
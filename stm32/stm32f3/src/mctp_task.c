@@ -1,77 +1,32 @@
 /*
  * The MCTP communication task is a finite state machine whose 
  * state changes are triggered by new frames received (via
- * MCTP_ReceiveFrame) or by user notifications (via MCTP_Notify).
- * Both trigger state change by calling MCTP_updateTask.
+ * MCTP_Poll) or by user notifications (via MCTP_Notify).
+ * Both trigger state change by calling MCTP_updateTask, always from
+ * thread context.
  *
- * The finite state machine reacts to 2 types of events, received
- * frames and notifications
+ * The finite state machine reacts to 4 types of events, received
+ * frames, notifications, channel list changes and ticks.
+ *
+ * A baud rate agreed on SYNC is set once ACK is received, and every
+ * frame already queued is sent. Until the controller confirms the new
+ * rate with PROBE and ACK, task stays in STATE_PROBE, and ticks check
+ * BAUD_PROBE_TIMEOUT.
  */
 
 #include "mctp_task.h"
+#include "mctp_tx.h"
+#include "mctp_rx.h"
 
-extern MCTP_Handle *g_Hmctp;
-
-
-static void MCTP_ReceiveFrame(MCTP_Handle *hmctp);
 static int NotifyHandler(MCTP_Handle *hmctp);
-static int FrameRecvHandler(MCTP_Handle *hmctp);
-
-/**
- * @brief Callback for RX complete. 
- * @note Called during task to receive bytes individually
- */
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
-    if(g_Hmctp->running){
-        MCTP_ReceiveFrame(g_Hmctp);
-    }
-}
-
-
-/**
- * @brief Checks received bytes for MCTP EOM delimiter.
- *
- * Appends all bytes received in UART port to recvBuf. Checks for end of message.
- * When a full message is received, update task.
- *
- * @param hmctp Handle for MCTP communication.
- *
- * @return None
- */
-static void MCTP_ReceiveFrame(MCTP_Handle *hmctp) {
-    /* Previous message was not processed or Buffer is full */
-    if(hmctp->recvBufIndex >= RECV_BUFFER_SIZE -1) {
-        /* Discard all in buffer */
-        hmctp->recvBufIndex = 0;
-        goto exit;
-    }
-
-    hmctp->recvBufIndex ++;
-
-    /* Check for EOM after minimum size is received */
-    if(hmctp->recvBufIndex >= HEADER_SIZE + EOM_SIZE){
-        /* EOM = 0x24, 0x25, 0x26 ($%&) */
-        uint8_t *EOMsection = &(hmctp->recvBuf[hmctp->recvBufIndex-3]);
-        if(EOMsection[0] == 0x24 && EOMsection[1] == 0x25 && EOMsection[2] == 0x26){
-
-            /* Disable IT to prevent another interrupt during parsing */
-            __HAL_UART_DISABLE_IT(hmctp->huart, UART_IT_RXNE);
-
-            /* Notify MCTP communication task*/
-            MCTP_updateTask(hmctp, EVENT_FRAME_RECV);
-
-            __HAL_UART_ENABLE_IT(hmctp->huart, UART_IT_RXNE);
-
-            /* Clear buffer for next message */
-            memset(hmctp->recvBuf, 0, RECV_BUFFER_SIZE);
-            hmctp->recvBufIndex = 0;
-        }
-    }
-
-exit:
-    HAL_UART_Receive_IT(hmctp->huart, &hmctp->recvBuf[hmctp->recvBufIndex], 1);
-}
-
+static int FrameRecvHandler(MCTP_Handle *hmctp, const MCTP_Frame *frame);
+static int SchemaHandler(MCTP_Handle *hmctp);
+static int TickHandler(MCTP_Handle *hmctp);
+static uint32_t MCTP_ChooseBaudRate(MCTP_Handle *hmctp, const MCTP_Frame *frame);
+static void MCTP_BaudFallback(MCTP_Handle *hmctp);
+static bool MCTP_ReadCredit(const MCTP_Frame *frame, uint16_t *frames, uint32_t *bytes, uint8_t *window);
+static bool MCTP_ReadDataAck(const MCTP_Frame *frame, uint8_t *next, uint32_t *sack);
+static bool MCTP_FrameTrusted(const MCTP_Handle *hmctp, const MCTP_Frame *frame);
 
 /**
  * Update MCTP communication task finite state machine.
@@ -79,7 +34,7 @@ exit:
  * depending on it's current state, then change state accordingly.
  * Returns 0 on success and -1 on error.
  */
-int MCTP_updateTask(MCTP_Handle *hmctp, E_MCTP_TaskEvent event){
+int MCTP_updateTask(MCTP_Handle *hmctp, E_MCTP_TaskEvent event, const MCTP_Frame *frame){
     int status = 0;
 
     /* Notifications Events */
@@ -90,7 +45,19 @@ int MCTP_updateTask(MCTP_Handle *hmctp, E_MCTP_TaskEvent event){
 
     /* Received Frame Events*/
     }else if(event == EVENT_FRAME_RECV){
-        if((status = FrameRecvHandler(hmctp)) < 0){
+        if((status = FrameRecvHandler(hmctp, frame)) < 0){
+            goto exit;
+        }
+
+    /* Channel List Events */
+    }else if(event == EVENT_SCHEMA){
+        if((status = SchemaHandler(hmctp)) < 0){
+            goto exit;
+        }
+
+    /* Periodic Events */
+    }else if(event == EVENT_TICK){
+        if((status = TickHandler(hmctp)) < 0){
             goto exit;
         }
     }
@@ -105,9 +72,7 @@ static int NotifyHandler(MCTP_Handle *hmctp){
         /* User-triggered stop */
 
         /* Send STOP frame to controller */
-        uint8_t stop_frame[HEADER_SIZE + EOM_SIZE];
-        MCTP_Serialize(hmctp, FRAMETYPE_STOP, stop_frame, HEADER_SIZE + EOM_SIZE, NULL);
-        HAL_UART_Transmit(hmctp->huart, stop_frame, HEADER_SIZE + EOM_SIZE, HAL_MAX_DELAY);
+        MCTP_TxControl(hmctp, FRAMETYPE_STOP);
 
         /* Return to connected state */
         hmctp->state = STATE_CONN;
@@ -121,53 +86,224 @@ static int NotifyHandler(MCTP_Handle *hmctp){
     return status;
 }
 
-int FrameRecvHandler(MCTP_Handle *hmctp){
+/*
+ * Announces channel list to controller, once a session exists. If the
+ * control queue is full, SCHEMA stays pending and is sent on a later
+ * call, from MCTP_Poll.
+ */
+static int SchemaHandler(MCTP_Handle *hmctp){
+    int status = 0;
+
+    if(!hmctp->schemaPending || hmctp->state == STATE_IDLE){
+        goto exit;
+    }
+    hmctp->schemaPending = false;
+    if(MCTP_TxControl(hmctp, FRAMETYPE_SCHEMA) < 0){
+        hmctp->schemaPending = true;
+    }
+
+exit:
+    return status;
+}
+
+/*
+ * Switches baud rate once nothing is left to transmit at the old one,
+ * then waits for confirmation of the new rate.
+ */
+static int TickHandler(MCTP_Handle *hmctp){
     int status = 0;
 
-    MCTP_Frame frame;
-    if(MCTP_ParseMsg(hmctp->recvBuf, hmctp->recvBufIndex, &frame) < 0){
+    if(hmctp->baudSwitch){
+        if(!MCTP_TxDrained(hmctp)){
+            goto exit;
+        }
+        hmctp->baudSwitch = false;
+        hmctp->probeTick = HAL_GetTick();
+        if((status = MCTP_RxSetBaudRate(hmctp, hmctp->baudTarget)) < 0){
+            /* UART refused rate. Controller times out too */
+            MCTP_BaudFallback(hmctp);
+        }
+
+    }else if(hmctp->state == STATE_PROBE && 
+            HAL_GetTick() - hmctp->probeTick > BAUD_PROBE_TIMEOUT){
+        /* New rate not confirmed. Controller falls back too */
+        MCTP_BaudFallback(hmctp);
+
+    }else if(hmctp->state == STATE_TRANS){
+        MCTP_TxReliableTick(hmctp);
+    }
+
+exit:
+    return status;
+}
+
+/*
+ * Returns to STATE_IDLE and to the initial baud rate, once frames 
+ * queued are sent.
+ */
+static void MCTP_BaudFallback(MCTP_Handle *hmctp){
+    hmctp->state = STATE_IDLE;
+    hmctp->baudTarget = hmctp->baudInitial;
+    hmctp->baudSwitch = hmctp->huart->Init.BaudRate != hmctp->baudInitial;
+}
+
+/*
+ * Highest rate offered by controller in <frame> that performer 
+ * supports, or current rate if there is none.
+ */
+static uint32_t MCTP_ChooseBaudRate(MCTP_Handle *hmctp, const MCTP_Frame *frame){
+    uint32_t best = hmctp->huart->Init.BaudRate;
+    uint8_t count = 0;
+
+    if(MCTP_ViewRead(&frame->dataSection, 0, &count, 1) < 0 || count > MAX_BAUD_RATES){
+        return best;
+    }
+
+    uint32_t offered[MAX_BAUD_RATES];
+    if(MCTP_ViewRead(&frame->dataSection, 1, offered, count * 4) < 0){
+        return best;
+    }
+
+    bool found = false;
+    for(int i = 0; i < count; i++){
+        for(int k = 0; k < hmctp->baudRatesCount; k++){
+            if(offered[i] == hmctp->baudRates[k] && (!found || offered[i] > best)){
+                best = offered[i];
+                found = true;
+            }
+        }
+    }
+
+    return best;
+}
+
+/*
+ * Reads CREDIT_FRAMES and CREDIT_BYTES of REQUEST or CREDIT <frame>,
+ * and WINDOW of a reliable REQUEST, or 0 if absent. Returns false if 
+ * frame carries no credit.
+ */
+static bool MCTP_ReadCredit(const MCTP_Frame *frame, uint16_t *frames, uint32_t *bytes, uint8_t *window){
+    uint8_t credit[REQUEST_RELIABLE_SIZE] = {0};
+
+    if((frame->dataSize != CREDIT_SIZE && frame->dataSize != REQUEST_RELIABLE_SIZE) ||
+            MCTP_ViewRead(&frame->dataSection, 0, credit, frame->dataSize) < 0){
+        return false;
+    }
+    memcpy(frames, &credit[0], 2);
+    memcpy(bytes, &credit[2], 4);
+    *window = credit[CREDIT_SIZE];
+    return true;
+}
+
+/*
+ * Reads NEXT_SEQUENCE and SACK of DATA_ACK <frame>. Returns false if 
+ * frame is malformed.
+ */
+static bool MCTP_ReadDataAck(const MCTP_Frame *frame, uint8_t *next, uint32_t *sack){
+    uint8_t ack[DATAACK_SIZE];
+
+    if(frame->dataSize != DATAACK_SIZE || MCTP_ViewRead(&frame->dataSection, 0, ack, DATAACK_SIZE) < 0){
+        return false;
+    }
+    *next = ack[0];
+    memcpy(sack, &ack[1], 4);
+    return true;
+}
+
+/*
+ * Returns false for <frame> without CRC in reliable mode. A corrupted
+ * DATA_ACK would free frames never received, and resync after a broken
+ * frame may find one made of bytes of others, ending on their EOM, so
+ * only frames whose CRC was checked are applied.
+ */
+static bool MCTP_FrameTrusted(const MCTP_Handle *hmctp, const MCTP_Frame *frame){
+    return !hmctp->txReliable.enabled || (frame->flags & HEADER_FLAG_CRC);
+}
+
+static int FrameRecvHandler(MCTP_Handle *hmctp, const MCTP_Frame *frame){
+    int status = 0;
+
+    if(!frame){
         status = -1;
         goto exit;
     }
+    if(!MCTP_FrameTrusted(hmctp, frame)){
+        /* Dropped, as if never received */
+        goto exit;
+    }
 
     switch(hmctp->state){
         case STATE_IDLE:
             /* Idle. Waiting for SYNC packet */
 
-            if(frame.type == FRAMETYPE_SYNC){
+            if(frame->type == FRAMETYPE_SYNC){
                 hmctp->state = STATE_SYNC;
 
-                /* Respond SYNC packet */
-                uint8_t sync_resp_frame[SYNCRESP_FRAME_SIZE];
-                if(MCTP_Serialize(hmctp, FRAMETYPE_SYNC_RESP, sync_resp_frame, SYNCRESP_FRAME_SIZE, NULL) < 0){
-                    break;
-                }
-                HAL_UART_Transmit_IT(hmctp->huart, sync_resp_frame, SYNCRESP_FRAME_SIZE);
-
-            }else if(frame.type == FRAMETYPE_DROP){
-                uint8_t drop_frame[MIN_FRAME_SIZE];
-                if(MCTP_Serialize(hmctp, FRAMETYPE_DROP, drop_frame, MIN_FRAME_SIZE, NULL) < 0){
-                    break;
-                }
-                HAL_UART_Transmit_IT(hmctp->huart, drop_frame, MIN_FRAME_SIZE);
+                /* New session. DATA frames are numbered from 0 */
+                MCTP_TxDropHeld(hmctp);
+                MCTP_TxBurstAbort(hmctp);
+                hmctp->txSequence = 0;
+                hmctp->schemaValid = false;
+                hmctp->baudTarget = MCTP_ChooseBaudRate(hmctp, frame);
+                MCTP_TxCreditSet(hmctp, false, 0, 0);
+                MCTP_TxReliableStart(hmctp, 0);
+
+                /* Respond SYNC packet, then announce channels */
+                MCTP_TxControl(hmctp, FRAMETYPE_SYNC_RESP);
+                hmctp->schemaPending = true;
+                SchemaHandler(hmctp);
+
+            }else if(frame->type == FRAMETYPE_DROP){
+                MCTP_TxDropHeld(hmctp);
+                MCTP_TxBurstAbort(hmctp);
+                MCTP_TxControl(hmctp, FRAMETYPE_DROP);
             }
             break;
 
         case STATE_SYNC:
             /* Waiting for Acknowledge */
 
-            if(frame.type == FRAMETYPE_ACK){
-                /* Switch to connected state */
-                hmctp->state = STATE_CONN;
+            if(frame->type == FRAMETYPE_ACK){
+                if(hmctp->baudTarget != hmctp->huart->Init.BaudRate){
+                    /* Switch rate, then wait for probe */
+                    hmctp->state = STATE_PROBE;
+                    hmctp->baudSwitch = true;
+                }else{
+                    /* Switch to connected state */
+                    hmctp->state = STATE_CONN;
+                }
 
-            }else if(frame.type == FRAMETYPE_DROP){
+            }else if(frame->type == FRAMETYPE_DROP){
+                MCTP_TxDropHeld(hmctp);
+                MCTP_TxBurstAbort(hmctp);
                 hmctp->state = STATE_IDLE;
 
-                uint8_t drop_frame[MIN_FRAME_SIZE];
-                if(MCTP_Serialize(hmctp, FRAMETYPE_DROP, drop_frame, MIN_FRAME_SIZE, NULL) < 0){
-                    break;
+                MCTP_TxControl(hmctp, FRAMETYPE_DROP);
+            }
+
+            break;
+
+        case STATE_PROBE:
+            /* New baud rate. Waiting for confirmation */
+
+            if(frame->type == FRAMETYPE_PROBE){
+                /* Echo probe, so controller checks both directions */
+                uint8_t probe[PROBE_SIZE];
+                const uint8_t pattern[PROBE_SIZE] = PROBE_BYTES;
+                if(MCTP_ViewRead(&frame->dataSection, 0, probe, PROBE_SIZE) == 0 &&
+                        frame->dataSize == PROBE_SIZE && memcmp(probe, pattern, PROBE_SIZE) == 0){
+                    MCTP_TxControl(hmctp, FRAMETYPE_PROBE);
                 }
-                HAL_UART_Transmit_IT(hmctp->huart, drop_frame, MIN_FRAME_SIZE);
+
+            }else if(frame->type == FRAMETYPE_ACK && !hmctp->baudSwitch){
+                /* New rate confirmed */
+                hmctp->state = STATE_CONN;
+
+            }else if(frame->type == FRAMETYPE_DROP){
+                MCTP_TxDropHeld(hmctp);
+                MCTP_TxBurstAbort(hmctp);
+                MCTP_TxControl(hmctp, FRAMETYPE_DROP);
+                MCTP_BaudFallback(hmctp);
             }
 
             break;
@@ -175,19 +311,26 @@ int FrameRecvHandler(MCTP_Handle *hmctp){
         case STATE_CONN:
             /* Connected. Waiting for Request frame*/
 
-            if(frame.type == FRAMETYPE_REQUEST){
+            if(frame->type == FRAMETYPE_REQUEST){
+                /* Flow control only if controller granted credit */
+                uint16_t frames = 0;
+                uint32_t bytes = 0;
+                uint8_t window = 0;
+                bool enabled = MCTP_ReadCredit(frame, &frames, &bytes, &window);
+                /* If reliable mode is unavailable, DATA_ACK frames are ignored */
+                MCTP_TxReliableStart(hmctp, window);
+                MCTP_TxCreditSet(hmctp, enabled, frames, bytes);
+
                 hmctp->state = STATE_TRANS;
                 /* Notify user of start request */
                 hmctp->SignalCallback(SIGNAL_START);
 
-            }else if(frame.type == FRAMETYPE_DROP){
-                hmctp->state = STATE_IDLE;
+            }else if(frame->type == FRAMETYPE_DROP){
+                MCTP_TxDropHeld(hmctp);
+                MCTP_TxBurstAbort(hmctp);
+                MCTP_BaudFallback(hmctp);
 
-                uint8_t drop_frame[MIN_FRAME_SIZE];
-                if(MCTP_Serialize(hmctp, FRAMETYPE_DROP, drop_frame, MIN_FRAME_SIZE, NULL) < 0){
-                    break;
-                }
-                HAL_UART_Transmit_IT(hmctp->huart, drop_frame, MIN_FRAME_SIZE);
+                MCTP_TxControl(hmctp, FRAMETYPE_DROP);
             }
 
             /* 
@@ -199,21 +342,34 @@ int FrameRecvHandler(MCTP_Handle *hmctp){
         case STATE_TRANS:
             /* Allow data until stop is called */
 
-            if(frame.type == FRAMETYPE_DROP){
+            if(frame->type == FRAMETYPE_DROP){
+                MCTP_TxDropHeld(hmctp);
+                MCTP_TxBurstAbort(hmctp);
                 hmctp->SignalCallback(SIGNAL_STOP);
-                hmctp->state = STATE_IDLE;
+                MCTP_BaudFallback(hmctp);
 
-                uint8_t drop_frame[MIN_FRAME_SIZE];
-                if(MCTP_Serialize(hmctp, FRAMETYPE_DROP, drop_frame, MIN_FRAME_SIZE, NULL) < 0){
-                    break;
-                }
-                HAL_UART_Transmit_IT(hmctp->huart, drop_frame, MIN_FRAME_SIZE);
+                MCTP_TxControl(hmctp, FRAMETYPE_DROP);
 
-            }else if(frame.type == FRAMETYPE_STOP){     
+            }else if(frame->type == FRAMETYPE_STOP){     
                 /* Controller-triggered stop */
 
                 /* Signal stop request from controller. Wait for user halt */
                 hmctp->SignalCallback(SIGNAL_STOP);
+
+            }else if(frame->type == FRAMETYPE_CREDIT){
+                uint16_t frames = 0;
+                uint32_t bytes = 0;
+                uint8_t window = 0;
+                if(MCTP_ReadCredit(frame, &frames, &bytes, &window)){
+                    MCTP_TxCreditGrant(hmctp, frames, bytes);
+                }
+
+            }else if(frame->type == FRAMETYPE_DATA_ACK){
+                uint8_t next = 0;
+                uint32_t sack = 0;
+                if(MCTP_ReadDataAck(frame, &next, &sack)){
+                    MCTP_TxReliableAck(hmctp, next, sack);
+                }
             }
             break;
     }
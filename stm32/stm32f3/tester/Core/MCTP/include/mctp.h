@@ -7,18 +7,19 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include "config.h"
+#include "mctp_protocol.h"
+#include "mctp_recv.h"
 
-#define RECV_BUFFER_SIZE 1024
+#define RX_DMA_BUFFER_SIZE 64   /* Circular DMA ring used in RXMODE_DMA */
+#define TX_CTRL_QUEUE_SIZE 4    /* Control frames waiting for transmission. Power of 2 */
+#define TX_CHUNK_SIZE 64        /* Staging buffer of MCTP_SendAll without TX arena */
+#define TX_FRAGMENT_SIZE 256    /* Bytes of a burst per fragment. Bounds the wait of 
+                                   control frames */
 #define MAX_CHANNELS 32 
-#define MAX_DATA_SIZE 65536     /* Maximum represented by 2 bytes */
-                          
-#define HEADER_SIZE 8
-#define DATAINFO_SIZE 4
-#define EOM_SIZE 3
-#define MIN_FRAME_SIZE (HEADER_SIZE + EOM_SIZE)
-#define MAX_FRAME_SIZE (HEADER_SIZE + MAX_DATA_SIZE + EOM_SIZE)
-#define SYNCRESP_FRAME_SIZE (HEADER_SIZE + 1 + EOM_SIZE)
+#define TX_CTRL_FRAME_SIZE COBS_MAX_SIZE(SCHEMA_FRAME_SIZE(MAX_CHANNELS) + CRC_SIZE)  /* Largest 
+                                   control frame */
 
 /**
  * @enum
@@ -27,26 +28,21 @@
 typedef enum{
     STATE_IDLE,
     STATE_SYNC,
+    STATE_PROBE,
     STATE_CONN,
     STATE_TRANS,
 } E_MCTP_State;
 
 /**
  * @enum
- * @brief MCTP identifier for data type enumeration.
+ * @brief MCTP UART reception mode enumeration.
  */
 typedef enum{
-    DATATYPE_CHAR     = 0,
-    DATATYPE_INT8     = 1,
-    DATATYPE_INT16    = 2,
-    DATATYPE_INT32    = 3,
-    DATATYPE_UINT8    = 4,
-    DATATYPE_UINT16   = 5,
-    DATATYPE_UINT32   = 6,
-    DATATYPE_FLOAT8   = 7,
-    DATATYPE_FLOAT16  = 8,
-    DATATYPE_FLOAT32  = 9,
-} E_MCTP_DataType;
+    RXMODE_IT,          /*!< One UART interrupt per received byte */
+    RXMODE_DMA,         /*!< Circular DMA ring drained in bulk on half transfer,
+                            transfer complete and idle line events. UART hdmarx 
+                            must be linked and configured as DMA_CIRCULAR */
+} E_MCTP_RxMode;
 
 /**
  * @enum
@@ -57,6 +53,9 @@ typedef enum{
     SIGNAL_START,       /*!< Notify performer of a START signal from controller */
     SIGNAL_READY,       /*!< Notify controller of a READY signal from performer */
     SIGNAL_HALT,        /*!< Notify controller of a HALT signal from performer */
+    SIGNAL_TX_CPLT,     /*!< Notify performer that a DATA frame sent with 
+                            MCTP_SendAll_DMA left its buffer, which is free
+                            again. Called from interrupt context */
 } E_MCTP_Signal;
 
 /**
@@ -67,6 +66,10 @@ typedef struct{
     uint16_t bufSize;           /*!< Size of dataBuf in bytes */
     int storedSize;             /*!< Size of data stored */
     E_MCTP_DataType dataType;   /*!< Format of data inside dataBuf */
+    uint8_t info[DATAINFO_SIZE];    /*!< Datainfo of channel when full. Part 
+                                    of frame plan */
+    float scale;                /*!< Value of full scale fixed point sample */
+    float offset;               /*!< Value of zero fixed point sample */
 } MCTP_Channel;
 
 
@@ -79,10 +82,237 @@ typedef struct{
                                                 Member is set if same indexed channel
                                                 in channels array is configured */
     uint8_t numberOfChannels;               /*!< Number of configured channels */
-    uint16_t size;                          /*!< Sum of all configured channels
-                                                buffers sizes */
+    uint8_t active[MAX_CHANNELS];           /*!< Frame plan. Ids of configured 
+                                                channels, in frame order. First
+                                                numberOfChannels are valid */
+    uint32_t size;                          /*!< Sum of all configured channels
+                                                buffers sizes and datainfo */
 } MCTP_ChannelList;
 
+/**
+ * @brief Pair of transmit buffers, carved from the application TX arena. 
+ *
+ * One buffer is transmitted while the next frame is serialized into
+ * the other one. A buffer is free when its size is 0.
+ */
+typedef struct{
+    uint8_t *buf[2];                    /*!< Serialized frames. Each half of
+                                            the TX arena */
+    uint32_t bufSize;                   /*!< Capacity of each buffer */
+    volatile uint16_t size[2];          /*!< Size of frame in each buffer */
+    volatile uint8_t active;            /*!< Buffer being transmitted, if busy */
+    volatile bool busy;                 /*!< Set while DMA transmits a buffer */
+} MCTP_TxPingPong;
+
+/**
+ * @brief Piece of a frame transmitted in place.
+ */
+typedef struct{
+    const uint8_t *ptr;                 /*!< First byte of segment */
+    uint16_t size;                      /*!< Size of segment */
+} MCTP_TxSegment;
+
+/**
+ * @brief Zero-copy DATA frame, as a chain of segments transmitted one
+ * at a time.
+ *
+ * Only header and datainfo are written to 'meta'. Data segments point
+ * straight to channels dataBuf.
+ */
+typedef struct{
+    uint8_t meta[HEADER_SIZE + DATAHEAD_SIZE + MAX_CHANNELS * DATAINFO_SIZE + 
+        CRC_SIZE + EOM_SIZE];           /*!< Header, sequence, channel count and 
+                                            datainfo, then trailer */
+    MCTP_TxSegment segs[2 * MAX_CHANNELS + 2];  /*!< Frame segments */
+    int count;                          /*!< Number of segments */
+    volatile int next;                  /*!< Next segment to transmit */
+    volatile bool busy;                 /*!< Set while chain is transmitted */
+} MCTP_TxChain;
+
+/**
+ * @brief Parts of a DATA frame serialized in chunks.
+ */
+typedef enum{
+    CHUNK_META,                         /*!< Header, sequence and channel count, or
+                                            datainfo */
+    CHUNK_SAMPLES,                      /*!< Channel dataBuf */
+    CHUNK_EOM,                          /*!< CRC, if enabled, and EOM */
+    CHUNK_FLUSH,                        /*!< COBS encoded bytes left, once the 
+                                            frame is complete */
+    CHUNK_DONE,
+} E_MCTP_ChunkPart;
+
+/**
+ * @brief Position of a chunked DATA frame serialization. 
+ *
+ * Only header and datainfo of the current channel are held, in 'meta'.
+ * Samples are copied from channels dataBuf as chunks are requested.
+ */
+typedef struct{
+    E_MCTP_ChunkPart part;              /*!< Part being written */
+    uint8_t meta[HEADER_SIZE + DATAHEAD_SIZE];  /*!< Header, sequence and channel
+                                            count, or datainfo */
+    uint8_t metaSize;                   /*!< Bytes used in meta */
+    int channel;                        /*!< Frame plan index of current part. -1 
+                                            for header */
+    uint16_t offset;                    /*!< Bytes of current part already written */
+    bool compact;                       /*!< Frame follows schema, no datainfo */
+    uint32_t crc;                       /*!< Running CRC of bytes written */
+    uint8_t trailer[CRC_SIZE + EOM_SIZE];   /*!< CRC and EOM, once reached */
+    uint8_t trailerSize;                /*!< Bytes used in trailer */
+} MCTP_ChunkCursor;
+
+/**
+ * @brief Position of a fragmented frame serialization.
+ *
+ * The DATA section of the whole frame is 'head' followed by 'data', 
+ * and is cut in fragments of fragSize bytes, each one sent as a frame
+ * of its own.
+ */
+typedef struct{
+    E_MCTP_FrameType type;              /*!< Type of the whole frame */
+    uint8_t head[BURSTHEAD_SIZE];       /*!< Start of DATA section */
+    uint8_t headSize;                   /*!< Bytes used in head */
+    const uint8_t *data;                /*!< Rest of DATA section, in place */
+    uint32_t dataSize;
+    uint32_t offset;                    /*!< DATA section bytes already written */
+    uint16_t index;                     /*!< Next fragment */
+    uint16_t count;                     /*!< Number of fragments */
+    uint16_t fragSize;                  /*!< DATA section bytes per fragment */
+} MCTP_FragCursor;
+
+/**
+ * @brief COBS encoder of a frame written in chunks.
+ *
+ * Bytes are written in place after the code byte of the open block. A
+ * zero byte becomes the code byte of the next block, so only the open
+ * block is held back until its size is known. 'buf' holds two blocks,
+ * so the open block is moved back to the start at most once per block.
+ */
+typedef struct{
+    uint8_t buf[2 * (COBS_BLOCK_SIZE + 1)];  /*!< Encoded bytes, then open block */
+    uint16_t head;                      /*!< First encoded byte not read */
+    uint16_t code;                      /*!< Code byte of the open block. Bytes
+                                            before it are encoded */
+    uint16_t tail;                      /*!< End of bytes written */
+    bool ended;                         /*!< Set once the delimiter is written */
+} MCTP_CobsEncoder;
+
+/**
+ * @brief Control frames waiting for transmission. 
+ *
+ * Control frames are sent at the next frame boundary, ahead of any
+ * DATA frame waiting in the ping-pong buffers.
+ */
+typedef struct{
+    uint8_t frames[TX_CTRL_QUEUE_SIZE][TX_CTRL_FRAME_SIZE];     /*!< Serialized
+                                            control frames */
+    uint16_t size[TX_CTRL_QUEUE_SIZE];  /*!< Size of each frame */
+    uint32_t queuedTick[TX_CTRL_QUEUE_SIZE];    /*!< HAL tick when each frame
+                                            was queued */
+    volatile uint8_t head;              /*!< Next frame to transmit. Free running */
+    volatile uint8_t tail;              /*!< Next free slot. Free running */
+    volatile bool busy;                 /*!< Set while head frame is transmitted */
+} MCTP_TxCtrlQueue;
+
+/**
+ * @brief Transmit scheduler statistics. Latencies are in HAL ticks (ms),
+ * from queuing of a control frame to the end of its transmission.
+ */
+typedef struct{
+    uint32_t ctrlSent;                  /*!< Control frames transmitted */
+    uint32_t ctrlDropped;               /*!< Control frames lost, queue full or
+                                            UART error */
+    uint8_t ctrlDepthMax;               /*!< Most control frames ever queued */
+    uint32_t ctrlLatencyMax;            /*!< Worst control frame latency */
+    uint32_t ctrlLatencySum;            /*!< Sum of latencies of control frames
+                                            sent. Divide by ctrlSent for mean */
+    uint32_t dataSent;                  /*!< DATA frames transmitted */
+    uint32_t dataPreempted;             /*!< Times a waiting DATA frame was passed
+                                            by a control frame */
+    uint32_t dataSuppressed;            /*!< DATA frames not sent for lack of
+                                            credit */
+    uint32_t dataRetransmitted;         /*!< DATA frames sent again in reliable
+                                            mode */
+    uint32_t aborted;                   /*!< Transfers cut short by a UART
+                                            error */
+} MCTP_TxStats;
+
+/**
+ * @brief DATA frames the controller lets the performer send.
+ *
+ * Granted with REQUEST and CREDIT frames, and taken by every DATA 
+ * frame sent. Credit is only enforced if REQUEST granted some. Limits
+ * are UINT32_MAX when unlimited.
+ */
+typedef struct{
+    bool enabled;                       /*!< Set if REQUEST carried credit */
+    uint32_t frames;                    /*!< DATA frames left */
+    uint32_t bytes;                     /*!< DATA frames bytes left */
+    uint16_t held;                      /*!< Size of newest suppressed frame, 
+                                            waiting for credit in the free DMA
+                                            buffer. 0 if none */
+} MCTP_TxCredit;
+
+/**
+ * @brief DATA frames sent and not yet acknowledged, in reliable mode.
+ *
+ * Frames are copied to slots of the application reliableBuf, in 
+ * SEQUENCE order from 'base', and retransmitted straight from there.
+ * Slot bitmasks are indexed by slot.
+ */
+typedef struct{
+    bool enabled;                       /*!< Set if REQUEST asked for it */
+    uint8_t window;                     /*!< Most frames not acknowledged */
+    uint8_t slots;                      /*!< Slots in reliableBuf */
+    uint32_t slotSize;                  /*!< Size of each slot */
+    uint8_t base;                       /*!< SEQUENCE of oldest frame */
+    uint8_t baseSlot;                   /*!< Slot of oldest frame */
+    uint8_t count;                      /*!< Frames in window */
+    uint16_t size[RELIABLE_MAX_WINDOW]; /*!< Frame size in each slot */
+    uint32_t order[RELIABLE_MAX_WINDOW];    /*!< Transmission order of last 
+                                            send of each slot */
+    uint32_t sentTick[RELIABLE_MAX_WINDOW]; /*!< HAL tick of last send */
+    uint32_t nextOrder;                 /*!< Order of next transmission */
+    uint32_t sent;                      /*!< Slots whose frame was sent */
+    uint32_t acked;                     /*!< Slots selectively acknowledged */
+    uint32_t pending;                   /*!< Slots waiting to be sent again */
+    volatile bool busy;                 /*!< Set while a slot is transmitted */
+    uint8_t busySlot;                   /*!< Slot being transmitted */
+} MCTP_TxReliable;
+
+/**
+ * @brief Fragmented frame being sent through the DMA buffers.
+ *
+ * Fragments are serialized one at a time into the free DMA buffer, 
+ * from the transmit complete interrupt.
+ */
+typedef struct{
+    MCTP_FragCursor cursor;             /*!< Next fragment to serialize */
+    volatile bool busy;                 /*!< Set until the last fragment is 
+                                            queued */
+} MCTP_TxBurst;
+
+/**
+ * @brief Continuous transmission over the TX arena, used as a circular
+ * DMA ring.
+ *
+ * Each half of the arena is refilled with the next frame bytes as soon 
+ * as DMA is done with it. Frames are sent back to back, and filler 
+ * bytes (FRAMETYPE_NONE) are sent while no frame is waiting.
+ */
+typedef struct{
+    volatile bool running;              /*!< Set while circular DMA runs */
+    volatile bool stopping;             /*!< Stop at next frame boundary */
+    volatile bool pending;              /*!< DATA frame requested by application */
+    bool dataBusy;                      /*!< DATA frame being written to ring */
+    uint32_t dataCharged;               /*!< Byte credit taken for DATA frame */
+    uint32_t dataWritten;               /*!< DATA frame bytes written to ring */
+    MCTP_ChunkCursor cursor;            /*!< Position in DATA frame */
+    uint16_t ctrlOffset;                /*!< Bytes of head control frame written */
+    bool halfData[2];                   /*!< Set if ring half holds frame bytes */
+} MCTP_TxStream;
+
 /**
  * @brief MCTP Handle struct definition
  *
@@ -90,6 +320,16 @@ typedef struct{
  * - 'huart'
  * - 'UserNotifyCallback'
  * - 'totalChannels
+ * - 'rxMode'
+ * - 'txArena'
+ * - 'txArenaSize'
+ * - 'baudRates' (optional)
+ * - 'baudRatesCount' (optional)
+ * - 'creditKeepLatest' (optional)
+ * - 'reliableBuf' (optional)
+ * - 'reliableBufSize' (optional)
+ * - 'crcEnabled' (optional)
+ * - 'cobsEnabled' (optional)
  */
 typedef struct{
     UART_HandleTypeDef *huart;              /*!< Handle for UART used 
@@ -98,8 +338,74 @@ typedef struct{
                                                             task notifies performer */
     uint8_t totalChannels;                  /*!< Enables usage for channels 0 to 
                                                <total_channels> */
-    uint8_t recvBuf[RECV_BUFFER_SIZE];      /*!< Buffer for received UART data */
-    uint8_t recvBufIndex;                   /*!< Index in buffer for last byte received */
+    E_MCTP_RxMode rxMode;                   /*!< UART reception mode */
+    uint8_t *txArena;                       /*!< Memory for serialized frames. Must
+                                                hold two worst-case DATA frames.
+                                                If NULL, MCTP_SendAll_DMA is not
+                                                available and MCTP_SendAll sends
+                                                frames in TX_CHUNK_SIZE chunks */
+    uint32_t txArenaSize;                   /*!< Size of txArena in bytes */
+    const uint32_t *baudRates;              /*!< UART baud rates the performer 
+                                                can switch to, offered to the
+                                                controller on SYNC. If NULL, 
+                                                rate never changes */
+    uint8_t baudRatesCount;                 /*!< Number of baudRates */
+    bool creditKeepLatest;                  /*!< If set, the newest DATA frame 
+                                                suppressed for lack of credit by
+                                                MCTP_SendAll_DMA is held, and sent
+                                                as soon as credit is granted */
+    uint8_t *reliableBuf;                   /*!< Memory for DATA frames kept for
+                                                retransmission in reliable mode.
+                                                Holds as many frames as TX arena
+                                                halves fit. If NULL, or without
+                                                crcEnabled, reliable mode is
+                                                not available */
+    uint32_t reliableBufSize;               /*!< Size of reliableBuf in bytes */
+    bool crcEnabled;                        /*!< If set, every frame sent carries
+                                                a CRC-32 trailer, and 
+                                                HEADER_FLAG_CRC. Received 
+                                                frames are checked if they 
+                                                carry one */
+    bool cobsEnabled;                       /*!< If set, frames are COBS encoded
+                                                and delimited by COBS_DELIMITER,
+                                                both ways. The controller must 
+                                                use the same framing */
+    uint32_t baudInitial;                   /*!< UART rate at MCTP_Init. Every 
+                                                session starts at this rate */
+    uint32_t baudTarget;                    /*!< Rate agreed on SYNC, or rate to
+                                                fall back to */
+    bool baudSwitch;                        /*!< Set while UART must switch to
+                                                baudTarget, once transmission
+                                                is drained */
+    uint32_t probeTick;                     /*!< HAL tick of the switch to a new
+                                                rate, for BAUD_PROBE_TIMEOUT */
+    MCTP_Receiver recv;                     /*!< Received UART data ring, and 
+                                                frames waiting for MCTP_Poll */
+    uint8_t rxDmaBuf[RX_DMA_BUFFER_SIZE];   /*!< Circular DMA ring for RXMODE_DMA.
+                                                Holds the pending byte in RXMODE_IT */
+    uint16_t rxDmaPos;                      /*!< Position in rxDmaBuf of the next 
+                                                unprocessed byte */
+    MCTP_TxPingPong txPingPong;             /*!< DMA transmit buffers */
+    MCTP_TxChain txChain;                   /*!< Zero-copy DMA transmit segments */
+    MCTP_TxCtrlQueue txCtrl;                /*!< Control frames queue */
+    MCTP_TxStats txStats;                   /*!< Transmit scheduler statistics */
+    MCTP_TxStream txStream;                 /*!< Circular DMA streaming state */
+    MCTP_TxCredit txCredit;                 /*!< Flow control credit */
+    MCTP_TxReliable txReliable;             /*!< Reliable mode window */
+    MCTP_TxBurst txBurst;                   /*!< Burst being sent */
+    MCTP_CobsEncoder txCobs;                /*!< COBS encoder of the chunked DATA
+                                                frame */
+    uint8_t txSequence;                     /*!< SEQUENCE of next DATA frame */
+    uint32_t txTimestamp;                   /*!< Capture time of next DATA frame */
+    bool txTimestampValid;                  /*!< Set if txTimestamp was given for 
+                                                next DATA frame */
+    uint8_t schemaId;                       /*!< Version of channel list. Changes 
+                                                with it */
+    volatile uint8_t schemaAnnounced;       /*!< Version last sent in SCHEMA frame */
+    volatile bool schemaValid;              /*!< Set once SCHEMA was sent in this
+                                                session */
+    volatile bool schemaPending;            /*!< Set while a SCHEMA frame must be
+                                                sent */
     E_MCTP_State state;                     /*!< Communication task state */
     bool userHalt;                          /*!< Communication task flag. Application 
                                                 will stop transmitting DATA frames*/
@@ -6,19 +6,37 @@
 #include <stdbool.h>
 #include "mctp.h"
 #include "mctp_task.h"
+#include "mctp_rx.h"
+#include "mctp_tx.h"
+#include "mctp_codec.h"
+#include "mctp_crc.h"
 
 
 /* MCTP communication functions */
 int MCTP_Init(MCTP_Handle *hmctp);
 int MCTP_Start(MCTP_Handle *hmctp);
 void MCTP_Stop(MCTP_Handle *hmctp);
+int MCTP_Poll(MCTP_Handle *hmctp);
 void MCTP_Notify(MCTP_Handle *hmctp, E_MCTP_Signal sig);
 int MCTP_SendAll(MCTP_Handle *hmctp);
+int MCTP_SendAll_DMA(MCTP_Handle *hmctp);
+int MCTP_SendAll_ZeroCopy(MCTP_Handle *hmctp);
+int MCTP_StartStreaming(MCTP_Handle *hmctp);
+int MCTP_StopStreaming(MCTP_Handle *hmctp);
+int MCTP_SendBurst(MCTP_Handle *hmctp, uint8_t channel_id, E_MCTP_DataType data_type, const uint8_t *data, uint32_t size);
+bool MCTP_BurstBusy(MCTP_Handle *hmctp);
+void MCTP_GetTxStats(MCTP_Handle *hmctp, MCTP_TxStats *stats);
 /* Channel functions */
 int MCTP_EnableChannel(MCTP_Handle *hmctp, uint8_t channel_id, uint8_t *data_buf, uint16_t buf_size, E_MCTP_DataType data_type);
 void MCTP_DisableChannel(MCTP_Handle *hmctp, uint8_t channel_id);
 int MCTP_WriteChannelData(MCTP_Handle *hmctp, uint8_t channel_id, uint8_t *src_buf, uint16_t src_size);
+int MCTP_WriteChannelFloat16(MCTP_Handle *hmctp, uint8_t channel_id, const float *samples, uint16_t n_samples);
+int MCTP_SetChannelScale(MCTP_Handle *hmctp, uint8_t channel_id, float scale, float offset);
+int MCTP_WriteChannelFixed(MCTP_Handle *hmctp, uint8_t channel_id, const float *samples, uint16_t n_samples);
+int MCTP_WriteChannelXor(MCTP_Handle *hmctp, uint8_t channel_id, const float *samples, uint16_t n_samples);
+int MCTP_WriteChannelUint12(MCTP_Handle *hmctp, uint8_t channel_id, const uint16_t *samples, uint16_t n_samples);
 void MCTP_ClearChannelData(MCTP_Handle *hmctp, uint8_t channel_id);
 void MCTP_ClearChannelList(MCTP_Handle *hmctp);
+void MCTP_SetTimestamp(MCTP_Handle *hmctp, uint32_t timestamp);
 
 #endif
@@ -0,0 +1,71 @@
+#ifndef MCTP_COBS_H
+#define MCTP_COBS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mctp.h"
+
+/*
+ * COBS encoding of frames. Every block of up to COBS_BLOCK_SIZE data
+ * bytes is preceded by a code byte, its size plus one. A code below
+ * 0xFF also stands for a zero byte after the block, so zero never
+ * occurs in encoded frames and COBS_DELIMITER ends them.
+ */
+
+/*
+ * Encodes <size> bytes of <src> into <dst>, followed by the delimiter.
+ * <dst> may overlap <src> if it starts at least
+ * COBS_MAX_SIZE(<size>) - <size> bytes before it.
+ *
+ * Returns encoded size, at most COBS_MAX_SIZE(<size>)
+ */
+uint32_t MCTP_CobsEncode(uint8_t *dst, const uint8_t *src, uint32_t size);
+
+/*
+ * Returns the largest number of bytes which, once encoded, fit in
+ * <size> bytes.
+ */
+uint32_t MCTP_CobsCapacity(uint32_t size);
+
+/*
+ * Returns byte <offset> of the frame encoded in <src>, which must be
+ * longer. <offset> must be below COBS_BLOCK_SIZE.
+ */
+uint8_t MCTP_CobsPeek(const uint8_t *src, uint8_t offset);
+
+/*
+ * Resets <enc> for a new frame.
+ */
+void MCTP_CobsEncoderStart(MCTP_CobsEncoder *enc);
+
+/*
+ * Stores on <space> where the next bytes to encode are to be written,
+ * and returns how many may be written. Returns 0 until every encoded
+ * byte was read, or after MCTP_CobsEncoderEnd.
+ */
+uint16_t MCTP_CobsEncoderSpace(MCTP_CobsEncoder *enc, uint8_t **space);
+
+/*
+ * Encodes <n> bytes written to the space given by
+ * MCTP_CobsEncoderSpace.
+ */
+void MCTP_CobsEncoderCommit(MCTP_CobsEncoder *enc, uint16_t n);
+
+/*
+ * Closes the last block of the frame and writes the delimiter.
+ */
+void MCTP_CobsEncoderEnd(MCTP_CobsEncoder *enc);
+
+/*
+ * Copies up to <size> encoded bytes of <enc> to <dst>.
+ *
+ * Returns number of bytes copied
+ */
+uint16_t MCTP_CobsEncoderRead(MCTP_CobsEncoder *enc, uint8_t *dst, uint16_t size);
+
+/*
+ * Returns true once the whole frame, delimiter included, was read.
+ */
+bool MCTP_CobsEncoderDone(MCTP_CobsEncoder *enc);
+
+#endif
@@ -7,33 +7,16 @@
 #include <stdlib.h>
 #include "mctp.h"
 
-typedef enum{
-    FRAMETYPE_NONE        = 0,
-    FRAMETYPE_SYNC        = 1,
-    FRAMETYPE_SYNC_RESP   = 2,
-    FRAMETYPE_ACK         = 3,
-    FRAMETYPE_REQUEST     = 4,
-    FRAMETYPE_DATA        = 5,
-    FRAMETYPE_STOP        = 6,
-    FRAMETYPE_DROP        = 7,
-} E_MCTP_FrameType;
-
-typedef struct{
-    E_MCTP_FrameType type;
-    /* Data */
-    uint16_t dataSize;
-    uint8_t *dataSection;   
-} MCTP_Frame;
-
-/*
- * Parses raw <msg> to <frame> struct.
+/*
+ * Parses raw <msg> to <frame> struct. The frame data section is 
+ * returned as a view into <msg>.
  *
  * Frames with data section such as DATA and SYNC_RESP are not
  * parsed due to not being used by performer.
  *
  * Returns 0 on success and -1 on error
  */
-int MCTP_ParseMsg(uint8_t *msg, int msg_size, MCTP_Frame *frame);
+int MCTP_ParseMsg(const MCTP_View *msg, MCTP_Frame *frame);
 
 /*
  * Create serialized frame of <frame_type> type and stores it on
@@ -42,8 +25,96 @@ int MCTP_ParseMsg(uint8_t *msg, int msg_size, MCTP_Frame *frame);
  * For DATA and SYNC_RESP frames, the data section is created based
  * on channel list inside <hmctp>
  *
+ * With cobsEnabled, the frame is COBS encoded and delimited.
+ *
  * Returns 0 on success and -1 on error
  */
 int MCTP_Serialize(MCTP_Handle *hmctp, E_MCTP_FrameType frame_type, uint8_t *frame_buf, int frame_buf_size, uint16_t *frame_size);
 
+/*
+ * Builds frame plan of <list>: ids of configured channels in frame
+ * order, and datainfo of each one. Must be called whenever channels
+ * are configured or removed.
+ */
+void MCTP_BuildFramePlan(MCTP_ChannelList *list);
+
+/*
+ * Size of the largest DATA frame a channel list of <list_size> bytes
+ * (buffers and datainfo) of <hmctp> can produce, with all enabled 
+ * channels full.
+ */
+uint32_t MCTP_DataFrameMaxSize(MCTP_Handle *hmctp, uint32_t list_size);
+
+/*
+ * Size of the largest frame that fits <buf_size> bytes once framed by
+ * <hmctp>. <buf_size> itself, unless frames are COBS encoded.
+ */
+uint32_t MCTP_FrameCapacity(MCTP_Handle *hmctp, uint32_t buf_size);
+
+/*
+ * Bytes after DATA section of frames sent by <hmctp>: CRC, if 
+ * enabled, and EOM.
+ */
+uint16_t MCTP_TrailerSize(MCTP_Handle *hmctp);
+
+/*
+ * Size of the DATA frame <hmctp> channels would produce now, before
+ * any COBS encoding.
+ */
+uint32_t MCTP_DataFrameSize(MCTP_Handle *hmctp);
+
+/*
+ * Starts chunked serialization of a DATA frame from <hmctp> channels
+ * on <cursor>. Channels must not change until the last chunk.
+ *
+ * Returns 0 on success and -1 if frame is too large
+ */
+int MCTP_SerializeChunkStart(MCTP_Handle *hmctp, MCTP_ChunkCursor *cursor);
+
+/*
+ * Writes the next bytes of the frame at <cursor>, up to <chunk_size>,
+ * to <chunk> and their count to <n>. Output is the same as 
+ * MCTP_Serialize. Every chunk is full except the last one. <n> is 0
+ * once the whole frame was written. With cobsEnabled, frame is encoded
+ * with the handle txCobs, so only one chunked frame may be in progress.
+ *
+ * Returns 0 on success and -1 on error
+ */
+int MCTP_SerializeChunk(MCTP_Handle *hmctp, MCTP_ChunkCursor *cursor, uint8_t *chunk, uint16_t chunk_size, uint16_t *n);
+
+/*
+ * Starts fragmented serialization on <cursor> of a <frame_type> frame 
+ * whose DATA section is <head_size> bytes of <head>, then <data_size>
+ * bytes of <data>, <frag_size> bytes per fragment. <data> must not 
+ * change until the last fragment.
+ *
+ * Returns 0 on success and -1 if <frag_size> is smaller than 
+ * <head_size> or too large, or if more than 65535 fragments are needed
+ */
+int MCTP_FragmentStart(MCTP_FragCursor *cursor, E_MCTP_FrameType frame_type, const uint8_t *head, uint8_t head_size, const uint8_t *data, uint32_t data_size, uint16_t frag_size);
+
+/*
+ * Serializes the next fragment at <cursor> on <frame_buf>, and stores
+ * its size on <frame_size>, 0 once all fragments were serialized.
+ * A capture time set with MCTP_SetTimestamp goes with the first one.
+ *
+ * Returns 0 on success and -1 if fragment doesn't fit <frame_buf>
+ */
+int MCTP_SerializeFragment(MCTP_Handle *hmctp, MCTP_FragCursor *cursor, uint8_t *frame_buf, int frame_buf_size, uint16_t *frame_size);
+
+/*
+ * Create DATA frame from channel list inside <hmctp> as a chain of
+ * segments, without copying channels data. Frame header and all
+ * channels datainfo are written to <meta_buf>, which must hold 
+ * HEADER_SIZE + DATAHEAD_SIZE + DATAINFO_SIZE bytes per channel.
+ * <segs> must hold 2 segments per channel plus two. Number of segments is stored on
+ * <n_segs>.
+ *
+ * Segments transmitted in order are byte-identical to the frame from
+ * MCTP_Serialize.
+ *
+ * Returns 0 on success and -1 on error
+ */
+int MCTP_SerializeSegments(MCTP_Handle *hmctp, uint8_t *meta_buf, int meta_buf_size, MCTP_TxSegment *segs, int max_segs, int *n_segs);
+
 #endif
@@ -0,0 +1,161 @@
+/**
+ * @file mctp_recv.h
+ * @brief Delimiting and queuing of received frames.
+ *
+ * Holds no HAL dependency. Received bytes come in through
+ * MCTP_RecvIngest from any transport, so the same code runs on the
+ * host, with a thread in place of the receive interrupt.
+ */
+#ifndef MCTP_RECV_H
+#define MCTP_RECV_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "mctp_protocol.h"
+
+#define RECV_BUFFER_SIZE 1024   /* Receive ring. Power of 2 */
+#define RECV_QUEUE_SIZE 8       /* Received frames waiting for MCTP_Poll. Power of 2 */
+
+/*
+ * Window of <size> bytes starting at <start> over a ring of <mask> + 1
+ * bytes, which must be a power of 2. Bytes may wrap around the end of
+ * <buf>, so they are accessed through MCTP_ViewRead.
+ */
+typedef struct{
+    const uint8_t *buf;
+    uint16_t mask;
+    uint16_t start;
+    uint16_t size;
+} MCTP_View;
+
+typedef struct{
+    E_MCTP_FrameType type;
+    uint8_t flags;              /* HEADER_FLAG_ bits. 0 for legacy filler */
+    uint32_t timestamp;         /* Valid if HEADER_FLAG_TIMESTAMP is set */
+    /* Data */
+    uint16_t dataSize;
+    MCTP_View dataSection;
+} MCTP_Frame;
+
+/**
+ * @brief Descriptor of a received frame waiting to be handled.
+ */
+typedef struct{
+    uint16_t start;             /*!< Position of the frame in receive ring.
+                                    Free-running, masked on access */
+    uint16_t size;              /*!< Size of the whole frame */
+} MCTP_RecvDesc;
+
+/**
+ * @brief Wait-free single-producer/single-consumer queue of received
+ * frames.
+ *
+ * The receive interrupt is the only producer and only writes 'head'.
+ * MCTP_Poll is the only consumer and only writes 'tail'. Both are
+ * free-running counters, masked on access.
+ *
+ * Queued frames are kept in place in the receive ring. The ring space
+ * they use is released when they leave the queue, so the oldest
+ * queued descriptor marks the end of the free space for the producer.
+ */
+typedef struct{
+    MCTP_RecvDesc slots[RECV_QUEUE_SIZE];   /*!< Descriptors storage */
+    atomic_uint_fast32_t head;              /*!< Total frames pushed */
+    atomic_uint_fast32_t tail;              /*!< Total frames popped */
+    uint32_t dropped;                       /*!< Frames lost because queue or
+                                                receive ring was full */
+} MCTP_RecvQueue;
+
+/**
+ * @brief Receive side of a link: ring of received bytes, parser state
+ * of the frame being received, and queue of complete frames.
+ *
+ * Everything but the queue 'tail' belongs to the producer.
+ */
+typedef struct{
+    bool cobs;                              /*!< Frames are COBS encoded and
+                                                delimited */
+    uint8_t buf[RECV_BUFFER_SIZE];          /*!< Ring for received data. Frames
+                                                are parsed in place */
+    uint16_t head;                          /*!< Position in ring of the first byte of
+                                                the frame being received. Free-running */
+    uint16_t index;                         /*!< Bytes of the frame being received */
+    uint16_t frameSize;                     /*!< Size of the frame being received, taken
+                                                from its header. 0 until the header
+                                                is complete */
+    uint16_t skip;                          /*!< Bytes left of a frame dropped for
+                                                lack of ring space */
+    uint8_t cobsLeft;                       /*!< COBS data bytes left in the block
+                                                being received. 0 before a code
+                                                byte */
+    bool cobsZero;                          /*!< Set if a zero byte goes before
+                                                the next COBS block */
+    bool cobsHunt;                          /*!< Set while the COBS frame being
+                                                received is dropped, up to the
+                                                next delimiter */
+    MCTP_Frame frame;                       /*!< Header of the frame being received,
+                                                once frameSize is set */
+    uint32_t crcErrors;                     /*!< Frames dropped for a wrong CRC */
+    MCTP_RecvQueue queue;                   /*!< Received frames waiting for MCTP_Poll */
+} MCTP_Receiver;
+
+/*
+ * Copies <n> bytes at <offset> of <view> to <dst>, handling wrap
+ * around.
+ *
+ * Returns 0 on success and -1 if bytes are out of view
+ */
+int MCTP_ViewRead(const MCTP_View *view, uint16_t offset, void *dst, uint16_t n);
+
+/*
+ * Parses the HEADER_SIZE bytes in <header> to <frame> struct. Data
+ * section is not touched.
+ *
+ * Returns 0 on success and -1 if header holds an unknown frame type
+ */
+int MCTP_ParseHeader(const uint8_t *header, MCTP_Frame *frame);
+
+/*
+ * Size of the whole <frame>, from its header: HEADER and DATA 
+ * sections, CRC if HEADER_FLAG_CRC is set, and EOM.
+ */
+uint32_t MCTP_RecvFrameSize(const MCTP_Frame *frame);
+
+/*
+ * Resets <recv>, emptying ring and queue. Frames are COBS encoded if
+ * <cobs> is set. No producer nor consumer must be running.
+ */
+void MCTP_RecvInit(MCTP_Receiver *recv, bool cobs);
+
+/*
+ * Discards the bytes of a frame partly received by <recv>. Frames
+ * already queued are kept. Producer side.
+ */
+void MCTP_RecvReset(MCTP_Receiver *recv);
+
+/*
+ * Appends <size> bytes from <data> to the ring of <recv> and queues
+ * every complete frame. Producer side.
+ *
+ * This is the single entry point of received bytes into MCTP. Any
+ * transport (UART interrupt, UART DMA or a host simulation) delivers
+ * data through it, in chunks of arbitrary size.
+ */
+void MCTP_RecvIngest(MCTP_Receiver *recv, const uint8_t *data, uint16_t size);
+
+/*
+ * Stores on <msg> a view of the oldest frame in <recv> queue. The
+ * frame is kept until MCTP_RecvRelease is called. Consumer side.
+ *
+ * Returns 0 on success and -1 if no frame is queued
+ */
+int MCTP_RecvPeek(MCTP_Receiver *recv, MCTP_View *msg);
+
+/*
+ * Removes the oldest frame from <recv> queue. Consumer side, after a
+ * successful MCTP_RecvPeek.
+ */
+void MCTP_RecvRelease(MCTP_Receiver *recv);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef MCTP_RX_H
+#define MCTP_RX_H
+
+#include <stdint.h>
+#include <string.h>
+#include "mctp_task.h"
+
+/*
+ * Arms UART reception of <hmctp> according to its rxMode.
+ *
+ * Returns 0 on success and -1 on error
+ */
+int MCTP_RxStart(MCTP_Handle *hmctp);
+
+/*
+ * Sets UART of <hmctp> to <baud_rate> and arms reception again. Bytes
+ * of a frame partly received are discarded. Nothing must be 
+ * transmitting.
+ *
+ * Returns 0 on success and -1 on error
+ */
+int MCTP_RxSetBaudRate(MCTP_Handle *hmctp, uint32_t baud_rate);
+
+#endif
@@ -12,13 +12,16 @@
 typedef enum{
     EVENT_FRAME_RECV,
     EVENT_NOTIF,
+    EVENT_SCHEMA,               /* Channel list changed, or SCHEMA pending */
+    EVENT_TICK,                 /* Periodic, from MCTP_Poll */
 } E_MCTP_TaskEvent;
 
 /*
- * Update MCTP communication task finite state machine.
+ * Update MCTP communication task finite state machine. <frame> is
+ * the received frame for EVENT_FRAME_RECV and NULL otherwise.
  *
  * Returns 0 on success and -1 on error.
  */
-int MCTP_updateTask(MCTP_Handle *hmctp, E_MCTP_TaskEvent event);
+int MCTP_updateTask(MCTP_Handle *hmctp, E_MCTP_TaskEvent event, const MCTP_Frame *frame);
 
 #endif
@@ -0,0 +1,154 @@
+#ifndef MCTP_TX_H
+#define MCTP_TX_H
+
+#include <stdint.h>
+#include <string.h>
+#include "mctp_parser.h"
+
+/*
+ * Resets <hmctp> transmit buffers. No transfer must be in progress.
+ */
+void MCTP_TxInit(MCTP_Handle *hmctp);
+
+/*
+ * Serializes a control frame of <frame_type> (SYNC_RESP, DROP, STOP)
+ * and queues it for transmission ahead of any waiting DATA frame. 
+ * Transmission starts at the next frame boundary.
+ *
+ * Returns 0 on success and -1 on error or if the queue is full
+ */
+int MCTP_TxControl(MCTP_Handle *hmctp, E_MCTP_FrameType frame_type);
+
+/*
+ * Returns true if <hmctp> has nothing in flight nor queued for 
+ * transmission.
+ */
+bool MCTP_TxDrained(MCTP_Handle *hmctp);
+
+/*
+ * Recovers <hmctp> transmission after HAL aborted the transfer in 
+ * flight on a UART error, which will never complete, and starts the
+ * next frame. Called from the error interrupt.
+ */
+void MCTP_TxAbort(MCTP_Handle *hmctp);
+
+/*
+ * Copies <hmctp> transmit statistics into <stats>.
+ */
+void MCTP_TxGetStats(MCTP_Handle *hmctp, MCTP_TxStats *stats);
+
+/*
+ * Serializes a DATA frame from <hmctp> channels into a free buffer 
+ * and transmits it, blocking until done.
+ *
+ * Returns 0 on success and -1 on error, if a DMA transfer is in
+ * progress or if there is no credit
+ */
+int MCTP_TxDataBlocking(MCTP_Handle *hmctp);
+
+/*
+ * Serializes a DATA frame from <hmctp> channels into the free DMA
+ * buffer. Transmission starts at once if the UART is idle, or when
+ * the frame in flight completes. In streaming mode, frame is only
+ * requested, and serialized into the ring by DMA interrupts. Without
+ * credit, frame is held if creditKeepLatest is set.
+ *
+ * Returns 0 on success and -1 on error, if no buffer is free or if 
+ * frame was suppressed for lack of credit
+ */
+int MCTP_TxDataDMA(MCTP_Handle *hmctp);
+
+/*
+ * Starts streaming mode. TX arena is transmitted continuously by 
+ * circular DMA and refilled with frames as each half is sent. UART
+ * hdmatx is switched to DMA_CIRCULAR until streaming stops.
+ *
+ * Returns 0 on success and -1 on error or if a transfer is in progress
+ */
+int MCTP_TxStreamStart(MCTP_Handle *hmctp);
+
+/*
+ * Requests streaming mode to stop once frames already queued are sent.
+ * New DATA frames are refused meanwhile.
+ *
+ * Returns 0 on success and -1 if not streaming
+ */
+int MCTP_TxStreamStop(MCTP_Handle *hmctp);
+
+/*
+ * Builds a DATA frame from <hmctp> channels as a chain of segments
+ * and starts their DMA transmission, one segment at a time. Channels 
+ * data is not copied and must not change until SIGNAL_TX_CPLT.
+ *
+ * Returns 0 on success and -1 on error, if a transfer is in progress,
+ * if there is no credit or if frames are COBS encoded
+ */
+int MCTP_TxDataSegments(MCTP_Handle *hmctp);
+
+/*
+ * Sets flow control of <hmctp> as granted by REQUEST. If <enabled>, 
+ * DATA frames are only sent while <frames> and <bytes> are left, 
+ * CREDIT_FRAMES_UNLIMITED and CREDIT_BYTES_UNLIMITED being no limit.
+ */
+void MCTP_TxCreditSet(MCTP_Handle *hmctp, bool enabled, uint16_t frames, uint32_t bytes);
+
+/*
+ * Adds <frames> and <bytes> granted by a CREDIT frame to <hmctp> 
+ * credit. A DATA frame held for lack of credit is sent if it now
+ * has enough.
+ */
+void MCTP_TxCreditGrant(MCTP_Handle *hmctp, uint16_t frames, uint32_t bytes);
+
+/*
+ * Discards the DATA frame of <hmctp> held for lack of credit, if any.
+ * Called on a new session, or when the session ends, so it is never
+ * sent under another session.
+ */
+void MCTP_TxDropHeld(MCTP_Handle *hmctp);
+
+/*
+ * Starts reliable mode of <hmctp> with up to <window> DATA frames not
+ * acknowledged, or stops it if <window> is 0. SEQUENCE restarts at 0.
+ * Only DATA frames sent with MCTP_TxDataDMA are allowed meanwhile.
+ *
+ * Returns 0 on success and -1 if reliable mode is not available, 
+ * without reliableBuf, TX DMA or crcEnabled, and stays off
+ */
+int MCTP_TxReliableStart(MCTP_Handle *hmctp, uint8_t window);
+
+/*
+ * Handles DATA_ACK: DATA frames before <next>, and those flagged in
+ * <sack>, were received. Frames found lost are sent again.
+ */
+void MCTP_TxReliableAck(MCTP_Handle *hmctp, uint8_t next, uint32_t sack);
+
+/*
+ * Queues for retransmission frames not acknowledged after 
+ * RELIABLE_RTO. Called periodically.
+ */
+void MCTP_TxReliableTick(MCTP_Handle *hmctp);
+
+/*
+ * Starts transmission of all fragments left in <cursor> with DMA, and
+ * returns at once. Fragments use the DMA buffers, and control frames
+ * are sent between them. Fragments take no flow control credit and are
+ * not kept for retransmission in reliable mode. No DATA frame may be
+ * sent until the last fragment is queued.
+ *
+ * Returns 0 on success and -1 on error, if streaming or if a burst is
+ * already in progress
+ */
+int MCTP_TxFragments(MCTP_Handle *hmctp, const MCTP_FragCursor *cursor);
+
+/*
+ * Returns true until the last fragment of the burst is queued.
+ */
+bool MCTP_TxBurstBusy(MCTP_Handle *hmctp);
+
+/*
+ * Stops the burst in progress. Fragments already queued are still 
+ * sent. Called when the session ends.
+ */
+void MCTP_TxBurstAbort(MCTP_Handle *hmctp);
+
+#endif
@@ -13,6 +13,18 @@
  * des both datainfo (DATA_INFO_SIZE bytes for each channel) and
  * buffer sizes, doesn't exceed MAX_DATA_SIZE.
  *
+ * The channel list is announced to the controller in a SCHEMA frame,
+ * after SYNC_RESP and again whenever it changes. When every enabled 
+ * channel is full, DATA frames leave out datainfo and refer to the 
+ * schema instead.
+ *
+ * Serialized frames are built in a TX arena provided by the 
+ * application. The arena is split in two buffers, so one frame can be
+ * serialized while the other is transmitted. A channel is only 
+ * enabled if the largest DATA frame the channel list can produce still
+ * fits in one buffer, so RAM used for transmission is known up front
+ * and nothing large is placed on the stack.
+ *
  * Before creating channels, it is necessary to initialize MCTP.
  */
 
@@ -20,11 +32,21 @@
 
 MCTP_Handle *g_Hmctp;
 
+static void MCTP_ChannelListChanged(MCTP_Handle *hmctp);
+
 /**
  * @brief Initialize MCTP library and start MCTP communication.
  * @note Ensure the UART associated with the handle passed to hmctp
  *       was initialized before calling this.
  * @note Maximum number of channels is 32.
+ * @note With crcEnabled, every frame sent carries a CRC-32 trailer, 
+ *       computed by the CRC peripheral if MCTP_USE_HW_CRC is defined.
+ *       Received frames with a CRC trailer are checked, and dropped 
+ *       on mismatch. Controllers only add it once SYNC_RESP shows 
+ *       HEADER_FLAG_CRC, so the CRC peripheral is only used if set.
+ * @note With cobsEnabled, frames are COBS encoded both ways, so the 
+ *       controller must frame them the same way. TX arena halves must
+ *       then hold the largest DATA frame encoded.
  * @param hmctp Handle for MCTP communication. Must be configured
  *              before calling this function.
  * @return 0 on success. Negative value if an error occurred.
@@ -32,10 +54,18 @@ MCTP_Handle *g_Hmctp;
  * Example
  * -------
  * @code
+ * static uint8_t tx_arena[2048];
+ * static const uint32_t baud_rates[] = {115200, 230400, 460800, 921600};
+ *
  * MCTP_Handle hmctp;
  * hmctp.huart = &huart2;
  * hmctp.UserNotifyCallback = mctp_user_callback;
  * hmctp.totalChannels = 8;
+ * hmctp.rxMode = RXMODE_DMA;
+ * hmctp.txArena = tx_arena;
+ * hmctp.txArenaSize = sizeof(tx_arena);
+ * hmctp.baudRates = baud_rates;
+ * hmctp.baudRatesCount = 4;
  *
  * MCTP_Init(&hmctp);
  * @endcode
@@ -47,12 +77,32 @@ int MCTP_Init(MCTP_Handle *hmctp){
         status = -1;
         goto exit;
     }
+    if(hmctp->txArena && hmctp->txArenaSize < 2 * MCTP_DataFrameMaxSize(hmctp, 0)){
+        status = -1;
+        goto exit;
+    }
+    if(hmctp->baudRatesCount > MAX_BAUD_RATES || (hmctp->baudRatesCount && !hmctp->baudRates)){
+        status = -1;
+        goto exit;
+    }
     g_Hmctp = hmctp;
 
-    memset(hmctp->recvBuf, 0, RECV_BUFFER_SIZE); 
-    hmctp->recvBufIndex = 0;
+    MCTP_RecvInit(&hmctp->recv, hmctp->cobsEnabled);
+    hmctp->rxDmaPos = 0;
 
     memset(&hmctp->channelList, 0, sizeof(MCTP_ChannelList));
+    hmctp->schemaId = 0;
+    hmctp->schemaValid = false;
+    hmctp->schemaPending = false;
+
+    if(hmctp->crcEnabled){
+        MCTP_CrcInit();
+    }
+    MCTP_TxInit(hmctp);
+
+    hmctp->baudInitial = hmctp->huart->Init.BaudRate;
+    hmctp->baudTarget = hmctp->baudInitial;
+    hmctp->baudSwitch = false;
 
     hmctp->state = STATE_IDLE;
     hmctp->userHalt = 0;
@@ -69,7 +119,7 @@ exit:
  */
 int MCTP_Start(MCTP_Handle *hmctp){
     hmctp->running = true;
-    if(HAL_UART_Receive_IT(hmctp->huart, hmctp->recvBuf, 1) != HAL_OK){
+    if(MCTP_RxStart(hmctp) < 0){
         return -1;
     }
     return 0;
@@ -84,6 +134,38 @@ void MCTP_Stop(MCTP_Handle *hmctp){
     hmctp->running = false;
 }
 
+/**
+ * @brief Run MCTP communication task on all received frames.
+ * @note Frames are only received in interrupt context. They are handled,
+ *       and SignalCallback called, from here. Call it periodically from 
+ *       the application main loop. Baud rate changes agreed with the
+ *       controller are also applied from here.
+ * @param hmctp Handle for MCTP communication.
+ * @return 0 on success. Negative value if handling any frame failed.
+ */
+int MCTP_Poll(MCTP_Handle *hmctp){
+    int status = 0;
+    MCTP_View msg;
+    MCTP_Frame frame;
+
+    while(MCTP_RecvPeek(&hmctp->recv, &msg) == 0){
+        if(MCTP_ParseMsg(&msg, &frame) < 0 ||
+                MCTP_updateTask(hmctp, EVENT_FRAME_RECV, &frame) < 0){
+            status = -1;
+        }
+        MCTP_RecvRelease(&hmctp->recv);
+    }
+
+    if(hmctp->schemaPending){
+        MCTP_updateTask(hmctp, EVENT_SCHEMA, NULL);
+    }
+    if(MCTP_updateTask(hmctp, EVENT_TICK, NULL) < 0){
+        status = -1;
+    }
+
+    return status;
+}
+
 /**
  * @brief Notify MCTP communication task.
  * @param hmctp Handle for MCTP communication.
@@ -104,7 +186,7 @@ void MCTP_Notify(MCTP_Handle *hmctp, E_MCTP_Signal notif){
             break;
     }
 
-    MCTP_updateTask(hmctp, EVENT_NOTIF);
+    MCTP_updateTask(hmctp, EVENT_NOTIF, NULL);
 }
 
 /**
@@ -113,7 +195,11 @@ void MCTP_Notify(MCTP_Handle *hmctp, E_MCTP_Signal notif){
  * @param channel_id The channel number.
  * @param data_buf Data buffer for the channel.
  * @param buf_size Data buffer size.
- * @param data_type Data type code.
+ * @param data_type Data type code. DATATYPE_INT16, DATATYPE_UINT16, 
+ *        DATATYPE_INT32 and DATATYPE_UINT32 can be OR'ed with 
+ *        DATATYPE_DELTA, so samples are sent as differences between 
+ *        them. Slowly varying readings then take about 1 byte per
+ *        sample. Buffer must then be sized with DELTA_MAX_SIZE.
  * @return 0 on success. Negative value if an error occurred.
  */
 int MCTP_EnableChannel(MCTP_Handle *hmctp, uint8_t channel_id, uint8_t *data_buf, uint16_t buf_size, E_MCTP_DataType data_type){
@@ -123,8 +209,22 @@ int MCTP_EnableChannel(MCTP_Handle *hmctp, uint8_t channel_id, uint8_t *data_buf
         status = -1;
         goto exit;
     }
-    if(hmctp->channelList.size + buf_size> MAX_DATA_SIZE){
-        /* FIXME: channelList size must include dataInfo size */
+    if((data_type & DATATYPE_DELTA) && !MCTP_DeltaWidth(data_type)){
+        status = -1;
+        goto exit;
+    }
+
+    /* Size of channel list with this channel (re)configured */
+    uint32_t list_size = hmctp->channelList.size + buf_size + DATAINFO_SIZE;
+    if(hmctp->channelList.map[channel_id]){
+        list_size -= hmctp->channelList.channels[channel_id].bufSize + DATAINFO_SIZE;
+    }
+    if(1 + list_size >= MAX_DATA_SIZE){
+        status = -1;
+        goto exit;
+    }
+    if(hmctp->txArena && MCTP_DataFrameMaxSize(hmctp, list_size) > hmctp->txArenaSize / 2){
+        /* Frame would not fit TX arena */
         status = -1;
         goto exit;
     }
@@ -133,12 +233,15 @@ int MCTP_EnableChannel(MCTP_Handle *hmctp, uint8_t channel_id, uint8_t *data_buf
     p_channel->dataType = data_type;
     p_channel->dataBuf = data_buf;
     p_channel->bufSize = buf_size;
+    p_channel->scale = 1.0f;
+    p_channel->offset = 0.0f;
 
-    hmctp->channelList.size += buf_size;
+    hmctp->channelList.size = list_size;
     if(!hmctp->channelList.map[channel_id]){
         hmctp->channelList.map[channel_id] = 1;
         hmctp->channelList.numberOfChannels += 1;
     }
+    MCTP_ChannelListChanged(hmctp);
 
 exit: 
     return status;
@@ -154,16 +257,40 @@ exit:
  * @return 0 on success. Negative value if an error occurred.
  */
 void MCTP_DisableChannel(MCTP_Handle *hmctp, uint8_t channel_id){
-    hmctp->channelList.size -= hmctp->channelList.channels[channel_id].bufSize;
+    if(channel_id >= MAX_CHANNELS || !hmctp->channelList.map[channel_id]){
+        return;
+    }
+    hmctp->channelList.size -= hmctp->channelList.channels[channel_id].bufSize + DATAINFO_SIZE;
 
     memset(&(hmctp->channelList.channels[channel_id]), 0, sizeof(MCTP_Channel));
     hmctp->channelList.map[channel_id] = 0;
     hmctp->channelList.numberOfChannels -= 1;
+    MCTP_ChannelListChanged(hmctp);
 }
 
 
+/**
+ * @brief Set capture time of the next DATA frame.
+ * @note The timestamp is sent in the frame header, so the controller
+ *       can place samples in time regardless of transmission delays. 
+ *       It should be the time the first samples of the frame were 
+ *       captured, from a free running microsecond counter. It applies 
+ *       to the next DATA frame only. Frames with no timestamp are sent 
+ *       as before.
+ * @param hmctp Handle for MCTP communication.
+ * @param timestamp Capture time, in us. Wraps at 32 bits.
+ * @return None
+ */
+void MCTP_SetTimestamp(MCTP_Handle *hmctp, uint32_t timestamp){
+    hmctp->txTimestamp = timestamp;
+    hmctp->txTimestampValid = true;
+}
+
 /**
  * @brief Write data from source to channel buffer.
+ * @note Samples of delta coded channels (DATATYPE_DELTA) are coded as
+ *       they are written. Their buffer must hold 
+ *       DELTA_MAX_SIZE(samples, sample size) bytes.
  * @param hmctp Handle for MCTP communication.
  * @param channel_id The channel number.
  * @param src_buf Data source.
@@ -181,10 +308,195 @@ int MCTP_WriteChannelData(MCTP_Handle *hmctp, uint8_t channel_id, uint8_t *src_b
         goto exit;
     }
 
+    MCTP_Channel *channel = &hmctp->channelList.channels[channel_id];
+    uint8_t width = MCTP_DeltaWidth(channel->dataType);
+    if(width){
+        uint16_t n = src_size / width;
+        if(src_size % width || DELTA_MAX_SIZE(n, width) > channel->bufSize){
+            status = -1;
+            goto exit;
+        }
+        channel->storedSize = MCTP_EncodeDelta(src_buf, channel->dataBuf, n, width);
+        goto exit;
+    }
+
     /* TODO: error check. Ensure safety before copying */
-    uint8_t *channel_data = hmctp->channelList.channels[channel_id].dataBuf;
+    uint8_t *channel_data = channel->dataBuf;
     memcpy(channel_data, src_buf, src_size);
-    hmctp->channelList.channels[channel_id].storedSize = src_size;
+    channel->storedSize = src_size;
+
+exit:
+    return status;
+}
+
+/**
+ * @brief Write float samples to a DATATYPE_FLOAT16 channel.
+ * @note Samples are converted to IEEE half precision as they are 
+ *       written, so the channel takes 2 bytes per sample, half of 
+ *       DATATYPE_FLOAT32. Half precision keeps about 3 significant
+ *       digits, from 6.1e-5 to 65504. Larger values are sent as 
+ *       infinity.
+ * @param hmctp Handle for MCTP communication.
+ * @param channel_id The channel number.
+ * @param samples Float samples.
+ * @param n_samples Number of samples. Channel buffer must be at least
+ *        2 * n_samples bytes.
+ * @return 0 on success. Negative value if an error occurred.
+ */
+int MCTP_WriteChannelFloat16(MCTP_Handle *hmctp, uint8_t channel_id, const float *samples, uint16_t n_samples){
+    int status = 0;
+
+    if(channel_id >= MAX_CHANNELS || !hmctp->channelList.map[channel_id]){
+        status = -1;
+        goto exit;
+    }
+    MCTP_Channel *channel = &hmctp->channelList.channels[channel_id];
+    if(channel->dataType != DATATYPE_FLOAT16 || 2 * n_samples > channel->bufSize){
+        status = -1;
+        goto exit;
+    }
+
+    MCTP_EncodeFloat16(samples, channel->dataBuf, n_samples);
+    channel->storedSize = 2 * n_samples;
+
+exit:
+    return status;
+}
+
+/**
+ * @brief Set scale and offset of a fixed point channel.
+ * @note Fixed point channels (DATATYPE_Q15, DATATYPE_Q7) carry samples
+ *       as fractions in [-1, 1), and the controller gets them back as
+ *       q * scale + offset. Samples outside [offset - scale, 
+ *       offset + scale) saturate. Scale and offset are sent once in 
+ *       the channel schema. Default is scale 1 and offset 0.
+ * @param hmctp Handle for MCTP communication.
+ * @param channel_id The channel number.
+ * @param scale Value of a full scale sample. Must not be 0.
+ * @param offset Value of a zero sample.
+ * @return 0 on success. Negative value if an error occurred.
+ */
+int MCTP_SetChannelScale(MCTP_Handle *hmctp, uint8_t channel_id, float scale, float offset){
+    int status = 0;
+
+    if(channel_id >= MAX_CHANNELS || !hmctp->channelList.map[channel_id] || scale == 0.0f){
+        status = -1;
+        goto exit;
+    }
+    MCTP_Channel *channel = &hmctp->channelList.channels[channel_id];
+    if(!DATATYPE_IS_SCALED(channel->dataType)){
+        status = -1;
+        goto exit;
+    }
+
+    channel->scale = scale;
+    channel->offset = offset;
+    MCTP_ChannelListChanged(hmctp);
+
+exit:
+    return status;
+}
+
+/**
+ * @brief Write float samples to a fixed point channel.
+ * @note Samples are converted to the channel data type, DATATYPE_Q15 
+ *       (2 bytes per sample) or DATATYPE_Q7 (1 byte per sample), with 
+ *       the channel scale and offset. See MCTP_SetChannelScale.
+ * @param hmctp Handle for MCTP communication.
+ * @param channel_id The channel number.
+ * @param samples Float samples.
+ * @param n_samples Number of samples. Must fit channel buffer.
+ * @return 0 on success. Negative value if an error occurred.
+ */
+int MCTP_WriteChannelFixed(MCTP_Handle *hmctp, uint8_t channel_id, const float *samples, uint16_t n_samples){
+    int status = 0;
+
+    if(channel_id >= MAX_CHANNELS || !hmctp->channelList.map[channel_id]){
+        status = -1;
+        goto exit;
+    }
+    MCTP_Channel *channel = &hmctp->channelList.channels[channel_id];
+    uint32_t size = channel->dataType == DATATYPE_Q15? 2 * n_samples : n_samples;
+    if(!DATATYPE_IS_SCALED(channel->dataType) || size > channel->bufSize){
+        status = -1;
+        goto exit;
+    }
+
+    if(channel->dataType == DATATYPE_Q15){
+        MCTP_EncodeQ15(samples, channel->dataBuf, n_samples, channel->scale, channel->offset);
+    }else{
+        MCTP_EncodeQ7(samples, channel->dataBuf, n_samples, channel->scale, channel->offset);
+    }
+    channel->storedSize = size;
+
+exit:
+    return status;
+}
+
+/**
+ * @brief Write float samples to a DATATYPE_FLOAT32_XOR channel.
+ * @note Samples are compressed without loss, each one as the XOR with
+ *       the previous one. Slowly varying signals take fewer bytes 
+ *       than DATATYPE_FLOAT32. Noisy ones take at most 1 more byte
+ *       every XOR_BLOCK_SAMPLES samples.
+ * @note Stored size depends on the samples, so frames with this 
+ *       channel only follow the schema if it happens to fill its 
+ *       buffer.
+ * @param hmctp Handle for MCTP communication.
+ * @param channel_id The channel number.
+ * @param samples Float samples.
+ * @param n_samples Number of samples. Channel buffer must be at least
+ *        XOR_MAX_SIZE(n_samples) bytes.
+ * @return 0 on success. Negative value if an error occurred.
+ */
+int MCTP_WriteChannelXor(MCTP_Handle *hmctp, uint8_t channel_id, const float *samples, uint16_t n_samples){
+    int status = 0;
+
+    if(channel_id >= MAX_CHANNELS || !hmctp->channelList.map[channel_id]){
+        status = -1;
+        goto exit;
+    }
+    MCTP_Channel *channel = &hmctp->channelList.channels[channel_id];
+    if(channel->dataType != DATATYPE_FLOAT32_XOR || XOR_MAX_SIZE(n_samples) > channel->bufSize){
+        status = -1;
+        goto exit;
+    }
+
+    channel->storedSize = MCTP_EncodeXor(samples, channel->dataBuf, n_samples);
+
+exit:
+    return status;
+}
+
+/**
+ * @brief Write 12 bit samples to a DATATYPE_UINT12 channel.
+ * @note Samples are packed two in three bytes, so 12 bit ADC readings
+ *       take 25% less than with DATATYPE_UINT16. Cheap enough to run
+ *       on each half of a circular ADC DMA buffer, from its half and 
+ *       full transfer callbacks.
+ * @param hmctp Handle for MCTP communication.
+ * @param channel_id The channel number.
+ * @param samples 12 bit samples, right aligned. Upper 4 bits are 
+ *        ignored.
+ * @param n_samples Number of samples. Channel buffer must be at least
+ *        UINT12_SIZE(n_samples) bytes.
+ * @return 0 on success. Negative value if an error occurred.
+ */
+int MCTP_WriteChannelUint12(MCTP_Handle *hmctp, uint8_t channel_id, const uint16_t *samples, uint16_t n_samples){
+    int status = 0;
+
+    if(channel_id >= MAX_CHANNELS || !hmctp->channelList.map[channel_id]){
+        status = -1;
+        goto exit;
+    }
+    MCTP_Channel *channel = &hmctp->channelList.channels[channel_id];
+    if(channel->dataType != DATATYPE_UINT12 || UINT12_SIZE(n_samples) > channel->bufSize){
+        status = -1;
+        goto exit;
+    }
+
+    MCTP_EncodeUint12(samples, channel->dataBuf, n_samples);
+    channel->storedSize = UINT12_SIZE(n_samples);
 
 exit:
     return status;
@@ -209,29 +521,184 @@ void MCTP_ClearChannelData(MCTP_Handle *hmctp, uint8_t channel_id){
  */
 void MCTP_ClearChannelList(MCTP_Handle *hmctp){
     memset(&hmctp->channelList, 0, sizeof(MCTP_ChannelList));
+    MCTP_ChannelListChanged(hmctp);
+}
+
+/*
+ * New frame plan and schema version, with interrupts disabled since
+ * streaming interrupts read the plan. SCHEMA is sent by MCTP_Poll, and
+ * DATA frames carry datainfo until it was transmitted.
+ */
+static void MCTP_ChannelListChanged(MCTP_Handle *hmctp){
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    MCTP_BuildFramePlan(&hmctp->channelList);
+    hmctp->schemaId++;
+    hmctp->schemaPending = true;
+    __set_PRIMASK(primask);
 }
 
 /**
  * @brief Send all data from all configured channels. Polling mode.
- * @note All stored data is sent in a single MCTP DATA frame.
+ * @note All stored data is sent in a single MCTP DATA frame, serialized
+ *       in the TX arena. Without TX arena, the frame is serialized and 
+ *       sent in TX_CHUNK_SIZE chunks, so its size is only limited by 
+ *       MAX_DATA_SIZE.
+ * @note If the controller granted credit with REQUEST, frames are only
+ *       sent while credit is left, and suppressed otherwise. They are
+ *       counted in MCTP_TxStats dataSuppressed.
  * @param hmctp Handle for MCTP communication.
- * @return 0 on success. Negative value if an error occurred.
+ * @return 0 on success. Negative value if an error occurred, if a
+ *         transfer is in progress or if frame was suppressed.
  *
  */
 int MCTP_SendAll(MCTP_Handle *hmctp){
+    return MCTP_TxDataBlocking(hmctp);
+}
+
+/**
+ * @brief Send all data from all configured channels. DMA mode.
+ * @note All stored data is serialized in a single MCTP DATA frame into
+ *       one of two handle buffers, and this function returns at once. 
+ *       Channels may be written again right after it returns. 
+ *       SignalCallback is called with SIGNAL_TX_CPLT, in interrupt 
+ *       context, whenever a buffer is sent and free again.
+ *       In streaming mode, the frame is serialized by DMA interrupts,
+ *       and channels must not be written until SIGNAL_TX_CPLT.
+ * @note Without credit, the frame is suppressed, or held if 
+ *       creditKeepLatest is set. A held frame is replaced by the next 
+ *       one, and sent as soon as the controller grants credit, so the
+ *       controller gets the newest data first.
+ * @note In reliable mode, requested by the controller, each frame is
+ *       also copied to reliableBuf until acknowledged, and sent again
+ *       if lost. This is the only send function allowed then.
+ * @param hmctp Handle for MCTP communication.
+ * @return 0 on success, or if frame was held. Negative value if an 
+ *         error occurred, if both buffers are still in use, if frame
+ *         was suppressed or if reliable window is full.
+ */
+int MCTP_SendAll_DMA(MCTP_Handle *hmctp){
+    return MCTP_TxDataDMA(hmctp);
+}
+
+/**
+ * @brief Send all data from all configured channels. Zero-copy DMA mode.
+ * @note Channels data is transmitted in place, straight from each channel
+ *       dataBuf, as a chain of DMA segments. Only header and datainfo 
+ *       are built by MCTP. Channels must not be written until 
+ *       SignalCallback is called with SIGNAL_TX_CPLT, in interrupt 
+ *       context.
+ * @note Not available with cobsEnabled, since channels data would have
+ *       to be encoded.
+ * @param hmctp Handle for MCTP communication.
+ * @return 0 on success. Negative value if an error occurred, if a 
+ *         transfer is in progress or if frame was suppressed for lack
+ *         of credit.
+ */
+int MCTP_SendAll_ZeroCopy(MCTP_Handle *hmctp){
+    return MCTP_TxDataSegments(hmctp);
+}
+
+/**
+ * @brief Send a block of samples of one channel, of any size. DMA mode.
+ * @note Block is sent as a BURST frame, split into fragments of up to 
+ *       TX_FRAGMENT_SIZE bytes that go through the DMA buffers one 
+ *       after the other. Control frames are sent between fragments. 
+ *       This function returns at once: fragments are serialized from
+ *       the TX complete interrupt, and MCTP_Poll keeps handling 
+ *       received frames meanwhile. SignalCallback is called with 
+ *       SIGNAL_TX_CPLT for each fragment, and MCTP_BurstBusy is true
+ *       until the last one is queued. No DATA frame may be sent until
+ *       then. Timestamp, if set, is sent with the first fragment.
+ * @note Bursts bypass flow control and reliable mode. They take no 
+ *       credit, a held DATA frame is dropped, and fragments are not
+ *       kept for retransmission, so a lost fragment loses the burst.
+ * @note A session ended by the controller (DROP, SYNC) stops the 
+ *       burst.
+ * @param hmctp Handle for MCTP communication.
+ * @param channel_id ID of the channel the samples belong to.
+ * @param data_type Data type of the samples.
+ * @param data Samples to send. Must not change until the last 
+ *        SIGNAL_TX_CPLT.
+ * @param size Size of samples in bytes.
+ * @return 0 on success. Negative value if an error occurred, if block
+ *         is too large, if streaming or if a burst is in progress.
+ */
+int MCTP_SendBurst(MCTP_Handle *hmctp, uint8_t channel_id, E_MCTP_DataType data_type, const uint8_t *data, uint32_t size){
     int status = 0;
+    MCTP_FragCursor cursor;
+    uint8_t head[BURSTHEAD_SIZE] = {channel_id, data_type};
+    uint32_t frag_size = TX_FRAGMENT_SIZE;
+
+    uint32_t overhead = HEADER_SIZE + FRAGHEAD_SIZE + MCTP_TrailerSize(hmctp);
+    uint32_t room = MCTP_FrameCapacity(hmctp, hmctp->txPingPong.bufSize);
 
-    uint16_t frame_size = 0;
-    /* FIXME: Frame size must be dynamic */
-    uint8_t frame[2048];    
+    if(room < overhead + 1){
+        status = -1;
+        goto exit;
+    }
+    if(room - overhead < frag_size){
+        frag_size = room - overhead;
+    }
 
-    if(MCTP_Serialize(hmctp, FRAMETYPE_DATA, frame, 2048, &frame_size) < 0){
+    if(MCTP_FragmentStart(&cursor, FRAMETYPE_BURST, head, BURSTHEAD_SIZE, data, size, frag_size) < 0){
         status = -1;
         goto exit;
     }
-    HAL_UART_Transmit(hmctp->huart, frame, frame_size, HAL_MAX_DELAY);
+    status = MCTP_TxFragments(hmctp, &cursor);
 
 exit:
     return status;
 }
-/* TODO: SendAll with interrupts. Notify application via txCpltCallback */
+
+/**
+ * @brief Check whether a burst is still being sent.
+ * @param hmctp Handle for MCTP communication.
+ * @return true until the last fragment of the burst started by 
+ *         MCTP_SendBurst is queued.
+ */
+bool MCTP_BurstBusy(MCTP_Handle *hmctp){
+    return MCTP_TxBurstBusy(hmctp);
+}
+
+/**
+ * @brief Start streaming mode.
+ * @note The TX arena becomes a ring transmitted without pause by 
+ *       circular DMA. Each time DMA is done with one half of the ring,
+ *       the half is refilled with the next frames bytes, so frames are
+ *       sent back to back with no gaps and no CPU work per byte. While
+ *       no frame is waiting, filler bytes (0x00) are sent, which 
+ *       receivers skip. Send DATA frames with MCTP_SendAll_DMA.
+ * @param hmctp Handle for MCTP communication.
+ * @return 0 on success. Negative value if an error occurred or if a
+ *         transfer is in progress.
+ */
+int MCTP_StartStreaming(MCTP_Handle *hmctp){
+    return MCTP_TxStreamStart(hmctp);
+}
+
+/**
+ * @brief Stop streaming mode.
+ * @note Streaming stops in interrupt context once all frames already
+ *       requested are sent. Other send functions fail until then.
+ * @param hmctp Handle for MCTP communication.
+ * @return 0 on success. Negative value if not streaming.
+ */
+int MCTP_StopStreaming(MCTP_Handle *hmctp){
+    return MCTP_TxStreamStop(hmctp);
+}
+
+/**
+ * @brief Get transmit statistics.
+ * @note Control frames (SYNC_RESP, DROP, STOP) are queued with priority
+ *       over DATA frames. Statistics show control queue depth, control 
+ *       frames latency, in ms, and how often DATA frames were passed.
+ *       DATA frames suppressed for lack of flow control credit, and 
+ *       sent again in reliable mode, are counted too.
+ * @param hmctp Handle for MCTP communication.
+ * @param stats Where statistics are copied to.
+ * @return None
+ */
+void MCTP_GetTxStats(MCTP_Handle *hmctp, MCTP_TxStats *stats){
+    MCTP_TxGetStats(hmctp, stats);
+}
@@ -0,0 +1,360 @@
+/**
+ * @file mctp_codec.c
+ * @brief Encoding of channel samples.
+ */
+
+/*
+ * Half precision conversion works on the float bit pattern, with a 
+ * single float addition for the subnormal range, so it only needs a 
+ * single precision FPU. Each range is a short straight path and 
+ * samples of a signal usually stay in one of them.
+ *
+ * Normal range: exponent is rebiased by integer addition on the bit
+ * pattern, and the dropped 13 mantissa bits are rounded to nearest 
+ * even by adding 0xFFF plus the lowest kept bit. A carry out of the
+ * mantissa correctly moves to the next exponent, or to infinity.
+ *
+ * Subnormal range: adding 0.5 shifts the value so its half precision
+ * mantissa lands on the low float mantissa bits, and the FPU does the
+ * rounding.
+ *
+ * Fixed point samples are first normalized, (sample - offset) / scale,
+ * then converted to Q15 or Q7. With MCTP_USE_CMSIS_DSP, both steps run
+ * on CMSIS-DSP kernels, a block at a time through a stack buffer. 
+ * Otherwise a portable loop does the same, rounding like CMSIS-DSP 
+ * built with ARM_MATH_ROUNDING. Prebuilt CMSIS-DSP libraries truncate
+ * instead, which adds up to 1 LSB of error.
+ *
+ * XOR compression is the Gorilla scheme, on 32 bit floats. Slowly 
+ * varying signals keep sign, exponent and upper mantissa bits from 
+ * one sample to the next, so their XOR is a short run of meaningful 
+ * bits, often in the same window as the previous one. Blocks are 
+ * coded in place on the destination and replaced by plain samples 
+ * when the bitstream would not be smaller, which bounds expansion to
+ * the block head.
+ *
+ * Delta coding works the same way for integer samples. Differences 
+ * are taken modulo the sample width, so signed and unsigned samples 
+ * are coded alike, and zigzag mapping makes small negative ones small
+ * too. Slow ADC readings mostly take a single varint byte.
+ */
+
+#include "mctp_codec.h"
+
+#if defined(MCTP_USE_CMSIS_DSP)
+#include "config.h"
+#include "arm_math.h"
+#endif
+
+#define CODEC_BLOCK_SIZE 32     /* Samples converted per CMSIS-DSP call */
+
+/* Bit writer. MSB first, fails instead of writing past <end> */
+typedef struct{
+    uint8_t *p;
+    uint8_t *end;
+    uint32_t acc;
+    uint32_t n;                 /* Bits in acc not written yet */
+} MCTP_BitWriter;
+
+static uint32_t MCTP_XorBlock(const float *src, uint8_t *dst, uint32_t count, uint32_t *prev);
+static uint32_t MCTP_DeltaBlock(const uint8_t *src, uint8_t *dst, uint32_t count, uint8_t width);
+static inline uint32_t MCTP_DeltaLoad(const uint8_t *src, uint8_t width);
+static inline bool MCTP_BitPut(MCTP_BitWriter *w, uint32_t value, uint32_t bits);
+static inline bool MCTP_BitPutLong(MCTP_BitWriter *w, uint32_t value, uint32_t bits);
+
+/* Float bit patterns */
+#define F32_INFINITY        (255u << 23)
+#define F32_HALF_OVERFLOW   ((127u + 16) << 23)     /* 65536.0f */
+#define F32_HALF_NORMAL_MIN ((127u - 14) << 23)     /* 2^-14 */
+#define F32_DENORM_MAGIC    ((127u - 1) << 23)      /* 0.5f */
+
+#define F16_INFINITY        0x7C00
+#define F16_NAN             0x7E00
+
+uint16_t MCTP_FloatToHalf(float f){
+    uint32_t u;
+    uint16_t h;
+
+    memcpy(&u, &f, 4);
+    uint32_t sign = u & 0x80000000u;
+    u ^= sign;
+
+    if(u >= F32_HALF_OVERFLOW){
+        /* Overflow to infinity. NaN stays quiet NaN */
+        h = u > F32_INFINITY? F16_NAN : F16_INFINITY;
+    }else if(u < F32_HALF_NORMAL_MIN){
+        /* Subnormal or zero */
+        float magic;
+        uint32_t m = F32_DENORM_MAGIC;
+        memcpy(&magic, &m, 4);
+        memcpy(&f, &u, 4);
+        f += magic;
+        memcpy(&u, &f, 4);
+        h = u - F32_DENORM_MAGIC;
+    }else{
+        /* Normal. Rebias exponent and round to nearest even */
+        uint32_t odd = (u >> 13) & 1;
+        u += ((uint32_t)(15 - 127) << 23) + 0xFFF + odd;
+        h = u >> 13;
+    }
+
+    return h | (sign >> 16);
+}
+
+void MCTP_EncodeFloat16(const float *src, uint8_t *dst, uint16_t n){
+    for(uint16_t i = 0; i < n; i++){
+        uint16_t h = MCTP_FloatToHalf(src[i]);
+        dst[2 * i] = h;
+        dst[2 * i + 1] = h >> 8;
+    }
+}
+
+uint32_t MCTP_EncodeXor(const float *src, uint8_t *dst, uint16_t n){
+    uint32_t size = 0;
+    uint32_t prev = 0;
+
+    for(uint32_t i = 0; i < n; i += XOR_BLOCK_SAMPLES){
+        uint32_t count = n - i < XOR_BLOCK_SAMPLES? n - i : XOR_BLOCK_SAMPLES;
+        size += MCTP_XorBlock(&src[i], &dst[size], count, &prev);
+    }
+
+    return size;
+}
+
+/*
+ * Codes a block of <count> samples on <dst>, following sample <prev>,
+ * and updates <prev> to its last sample.
+ *
+ * Returns size of block, head included
+ */
+static uint32_t MCTP_XorBlock(const float *src, uint8_t *dst, uint32_t count, uint32_t *prev){
+    MCTP_BitWriter w = {dst + 1, dst + 1 + 4 * count, 0, 0};
+    uint32_t lead = 32;         /* No window */
+    uint32_t trail = 32;
+    uint32_t last = *prev;
+    bool fit = true;
+
+    for(uint32_t i = 0; i < count && fit; i++){
+        uint32_t u;
+        memcpy(&u, &src[i], 4);
+        uint32_t x = u ^ last;
+        last = u;
+
+        if(x == 0){
+            fit = MCTP_BitPut(&w, 0, 1);
+            continue;
+        }
+        uint32_t lz = __builtin_clz(x);
+        uint32_t tz = __builtin_ctz(x);
+        if(lz >= lead && tz >= trail){
+            fit = MCTP_BitPut(&w, 2, 2) && 
+                MCTP_BitPutLong(&w, x >> trail, 32 - lead - trail);
+        }else{
+            uint32_t len = 32 - lz - tz;
+            fit = MCTP_BitPut(&w, (3 << 10) | (lz << 5) | (len - 1), 12) && 
+                MCTP_BitPutLong(&w, x >> tz, len);
+            lead = lz;
+            trail = tz;
+        }
+    }
+    if(fit && w.n > 0){
+        fit = MCTP_BitPut(&w, 0, 8 - w.n);
+    }
+
+    if(!fit){
+        /* Bitstream would be larger */
+        dst[0] = XOR_BLOCK_RAW | (count - 1);
+        memcpy(&dst[1], src, 4 * count);
+        memcpy(prev, &src[count - 1], 4);
+        return 1 + 4 * count;
+    }
+    dst[0] = count - 1;
+    *prev = last;
+    return w.p - dst;
+}
+
+/*
+ * Appends <bits> low bits of <value>, up to 24.
+ */
+static inline bool MCTP_BitPut(MCTP_BitWriter *w, uint32_t value, uint32_t bits){
+    w->acc = (w->acc << bits) | value;
+    w->n += bits;
+    while(w->n >= 8){
+        if(w->p == w->end){
+            return false;
+        }
+        w->n -= 8;
+        *w->p++ = w->acc >> w->n;
+    }
+    return true;
+}
+
+/*
+ * Appends <bits> low bits of <value>, up to 32.
+ */
+static inline bool MCTP_BitPutLong(MCTP_BitWriter *w, uint32_t value, uint32_t bits){
+    if(bits > 16){
+        return MCTP_BitPut(w, value >> 16, bits - 16) && MCTP_BitPut(w, value & 0xFFFF, 16);
+    }
+    return MCTP_BitPut(w, value, bits);
+}
+
+uint8_t MCTP_DeltaWidth(E_MCTP_DataType data_type){
+    if(!(data_type & DATATYPE_DELTA)){
+        return 0;
+    }
+    switch(DATATYPE_BASE(data_type)){
+        case DATATYPE_INT16:
+        case DATATYPE_UINT16:
+            return 2;
+        case DATATYPE_INT32:
+        case DATATYPE_UINT32:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+uint32_t MCTP_EncodeDelta(const uint8_t *src, uint8_t *dst, uint16_t n, uint8_t width){
+    uint32_t size = 0;
+
+    for(uint32_t i = 0; i < n; i += DELTA_BLOCK_SAMPLES){
+        uint32_t count = n - i < DELTA_BLOCK_SAMPLES? n - i : DELTA_BLOCK_SAMPLES;
+        size += MCTP_DeltaBlock(&src[i * width], &dst[size], count, width);
+    }
+
+    return size;
+}
+
+/*
+ * Codes a block of <count> samples on <dst>. 
+ *
+ * Returns size of block, head included
+ */
+static uint32_t MCTP_DeltaBlock(const uint8_t *src, uint8_t *dst, uint32_t count, uint8_t width){
+    uint8_t *p = dst + 1;
+    uint8_t *end = dst + 1 + count * width;
+    uint32_t shift = 8 * width - 1;
+    uint32_t mask = width == 4? 0xFFFFFFFF : 0xFFFF;
+
+    /* Reference */
+    memcpy(p, src, width);
+    p += width;
+    uint32_t prev = MCTP_DeltaLoad(src, width);
+
+    for(uint32_t i = 1; i < count; i++){
+        uint32_t x = MCTP_DeltaLoad(&src[i * width], width);
+        uint32_t delta = (x - prev) & mask;
+        prev = x;
+
+        /* Zigzag, sign taken from top bit of sample width */
+        uint32_t z = ((delta << 1) & mask) ^ ((0 - (delta >> shift)) & mask);
+        while(z >= 0x80){
+            if(p == end){
+                goto raw;
+            }
+            *p++ = z | 0x80;
+            z >>= 7;
+        }
+        if(p == end){
+            goto raw;
+        }
+        *p++ = z;
+    }
+    dst[0] = count - 1;
+    return p - dst;
+
+raw:
+    /* Varints would be larger */
+    dst[0] = DELTA_BLOCK_RAW | (count - 1);
+    memcpy(&dst[1], src, count * width);
+    return 1 + count * width;
+}
+
+static inline uint32_t MCTP_DeltaLoad(const uint8_t *src, uint8_t width){
+    uint32_t x = src[0] | src[1] << 8;
+    if(width == 4){
+        x |= (uint32_t)src[2] << 16 | (uint32_t)src[3] << 24;
+    }
+    return x;
+}
+
+/*
+ * A pair of samples is built in a register and stored as 3 bytes.
+ */
+void MCTP_EncodeUint12(const uint16_t *src, uint8_t *dst, uint16_t n){
+    uint32_t i = 0;
+
+    for(; i + 1 < n; i += 2){
+        uint32_t pair = (src[i] & 0xFFF) | (uint32_t)(src[i + 1] & 0xFFF) << 12;
+        dst[0] = pair;
+        dst[1] = pair >> 8;
+        dst[2] = pair >> 16;
+        dst += 3;
+    }
+    if(i < n){
+        dst[0] = src[i];
+        dst[1] = (src[i] >> 8) & 0xF;
+    }
+}
+
+#if defined(MCTP_USE_CMSIS_DSP)
+
+void MCTP_EncodeQ15(const float *src, uint8_t *dst, uint16_t n, float scale, float offset){
+    float32_t block[CODEC_BLOCK_SIZE];
+
+    for(uint32_t i = 0; i < n; i += CODEC_BLOCK_SIZE){
+        uint32_t count = n - i < CODEC_BLOCK_SIZE? n - i : CODEC_BLOCK_SIZE;
+        arm_offset_f32((float32_t*)&src[i], -offset, block, count);
+        arm_scale_f32(block, 1.0f / scale, block, count);
+        arm_float_to_q15(block, (q15_t*)&dst[2 * i], count);
+    }
+}
+
+void MCTP_EncodeQ7(const float *src, uint8_t *dst, uint16_t n, float scale, float offset){
+    float32_t block[CODEC_BLOCK_SIZE];
+
+    for(uint32_t i = 0; i < n; i += CODEC_BLOCK_SIZE){
+        uint32_t count = n - i < CODEC_BLOCK_SIZE? n - i : CODEC_BLOCK_SIZE;
+        arm_offset_f32((float32_t*)&src[i], -offset, block, count);
+        arm_scale_f32(block, 1.0f / scale, block, count);
+        arm_float_to_q7(block, (q7_t*)&dst[i], count);
+    }
+}
+
+#else
+
+/*
+ * Rounds <x> half away from zero and saturates it to [<min>, <max>].
+ * NaN becomes <min>.
+ */
+static int32_t MCTP_Quantize(float x, float min, float max){
+    x += x > 0.0f? 0.5f : -0.5f;
+    if(x >= max){
+        return max;
+    }
+    if(!(x > min)){
+        return min;
+    }
+    return (int32_t)x;
+}
+
+void MCTP_EncodeQ15(const float *src, uint8_t *dst, uint16_t n, float scale, float offset){
+    float gain = 1.0f / scale;
+
+    for(uint16_t i = 0; i < n; i++){
+        int16_t q = MCTP_Quantize((src[i] - offset) * gain * 32768.0f, -32768.0f, 32767.0f);
+        dst[2 * i] = q;
+        dst[2 * i + 1] = (uint16_t)q >> 8;
+    }
+}
+
+void MCTP_EncodeQ7(const float *src, uint8_t *dst, uint16_t n, float scale, float offset){
+    float gain = 1.0f / scale;
+
+    for(uint16_t i = 0; i < n; i++){
+        dst[i] = (int8_t)MCTP_Quantize((src[i] - offset) * gain * 128.0f, -128.0f, 127.0f);
+    }
+}
+
+#endif
@@ -4,52 +4,222 @@
  * | HEADER (8) | DATA (x) | EOM |
  * *------------*----------*-----*
  * 
+ * >FRAME with HEADER_FLAG_CRC
+ * *------------*----------*---------*-----*
+ * | HEADER (8) | DATA (x) | CRC (4) | EOM |
+ * *------------*----------*---------*-----*
+ * (*) CRC-32 (IEEE 802.3, as zlib crc32) of HEADER and DATA sections,
+ *     little-endian. Sent on every frame if the performer has 
+ *     crcEnabled. DATA_SIZE does not count it. Controllers may send
+ *     it on any frame, once SYNC_RESP shows the flag. Either way, a
+ *     frame whose CRC doesn't match is dropped by its receiver.
+ * 
  * >HEADER section
- * *-------------*--------------*-------------*
- * | FRM_TYPE(1) | DATA_SIZE(2) | RESERVED(5) |
- * *-------------*--------------*-------------*
+ * *-------------*--------------*----------*--------------*
+ * | FRM_TYPE(1) | DATA_SIZE(2) | FLAGS(1) | TIMESTAMP(4) |
+ * *-------------*--------------*----------*--------------*
+ * (*) Without flags, FLAGS and TIMESTAMP hold HEADER_FILLER. DATA 
+ *     frames given a capture time with MCTP_SetTimestamp set 
+ *     HEADER_FLAG_TIMESTAMP, and TIMESTAMP holds it, in us.
  * 
  * >DATA section (DATA frame)
- * *--------------*---------------*-----------------*----------------*------------*-----*
- * | SEQUENCE (1) | CHANNEL_ID(1) | SAMPLES_SIZE(2) | DATA_FORMAT(1) | SAMPLES(x) | ... |
- * *--------------*---------------*-----------------*----------------*------------*-----*
+ * *--------------*------------------*---------------*-----------------*----------------*------------*-----*
+ * | SEQUENCE (1) | N_OF_CHANNELS(1) | CHANNEL_ID(1) | SAMPLES_SIZE(2) | DATA_FORMAT(1) | SAMPLES(x) | ... |
+ * *--------------*------------------*---------------*-----------------*----------------*------------*-----*
  * *-----*---------------*-----------------*----------------*------------*-----*
  * | ... | CHANNEL_ID(1) | SAMPLES_SIZE(2) | DATA_FORMAT(1) | SAMPLES(x) | ... |
  * *-----*---------------*-----------------*----------------*------------*-----*
- * (*) TODO: SEQUENCE bits currently not implemented
+ * (*) SEQUENCE counts DATA frames of a session, wrapping at 255. It
+ *     restarts at 0 on every SYNC, so the controller can tell lost, 
+ *     repeated and reordered frames apart.
+ * 
+ * >DATA section (DATA frame following schema, HEADER_FLAG_SCHEMA set)
+ * *--------------*--------------*------------*-----*------------*
+ * | SEQUENCE (1) | SCHEMA_ID(1) | SAMPLES(x) | ... | SAMPLES(x) |
+ * *--------------*--------------*------------*-----*------------*
+ * (*) Samples of every channel announced in SCHEMA, in the same order
+ *     and with the same size. Sent when all enabled channels are full.
+ * 
+ * >DATA section (SYNC frame)
+ * *-------------*--------------*-----*
+ * | N_RATES(1)  | BAUD_RATE(4) | ... |
+ * *-------------*--------------*-----*
+ * (*) Baud rates the controller can switch to. Optional. Empty SYNC 
+ *     keeps the current rate.
  * 
  * >DATA section (SYNC RESP frame)
- * *------------------*
- * | N_OF_CHANNELS(1) |
- * *------------------*
+ * *------------------*--------------*
+ * | N_OF_CHANNELS(1) | BAUD_RATE(4) |
+ * *------------------*--------------*
+ * (*) BAUD_RATE is the highest rate offered by both sides, or the 
+ *     current one. If it differs, both sides switch to it once ACK is
+ *     sent, and the controller sends PROBE frames until one is echoed,
+ *     then ACK again. Without that ACK within BAUD_PROBE_TIMEOUT, both
+ *     sides fall back to the initial rate, and the controller starts
+ *     over with SYNC. DROP also returns to the initial rate.
+ * 
+ * >DATA section (REQUEST and CREDIT frames)
+ * *------------------*------------------*
+ * | CREDIT_FRAMES(2) | CREDIT_BYTES(4)  |
+ * *------------------*------------------*
+ * (*) Flow control. Optional in REQUEST, which then sets the DATA 
+ *     frames and bytes the performer may send. CREDIT adds to them. 
+ *     CREDIT_FRAMES_UNLIMITED and CREDIT_BYTES_UNLIMITED lift a limit.
+ *     Empty REQUEST sends without limit. Bytes are counted as sent on
+ *     the wire, COBS encoded if enabled.
+ * 
+ * >DATA section (REQUEST frame, reliable mode)
+ * *------------------*------------------*-----------*
+ * | CREDIT_FRAMES(2) | CREDIT_BYTES(4)  | WINDOW(1) |
+ * *------------------*------------------*-----------*
+ * (*) WINDOW, up to RELIABLE_MAX_WINDOW, enables reliable mode. The 
+ *     performer keeps up to WINDOW DATA frames sent until they are 
+ *     acknowledged with DATA_ACK, and sends again those found lost. 
+ *     SEQUENCE restarts at 0. Only available with CRC: in reliable 
+ *     mode, frames without CRC are ignored.
+ * 
+ * >DATA section (DATA_ACK frame)
+ * *------------------*----------*
+ * | NEXT_SEQUENCE(1) | SACK(4)  |
+ * *------------------*----------*
+ * (*) Every DATA frame before NEXT_SEQUENCE was received. Bit i of 
+ *     SACK is set if frame NEXT_SEQUENCE + 1 + i was received too. A 
+ *     frame missing while a later one was received is sent again at
+ *     once. One never acknowledged is sent again after RELIABLE_RTO.
+ * 
+ * >DATA section (PROBE frame)
+ * *----------------*
+ * | PROBE_BYTES(8) |
+ * *----------------*
+ * 
+ * 
+ * >DATA section (SCHEMA frame)
+ * *--------------*------------------*---------------*--------------*----------------*-----*
+ * | SCHEMA_ID(1) | N_OF_CHANNELS(1) | CHANNEL_ID(1) | BUF_SIZE(2) | DATA_FORMAT(1) | ... |
+ * *--------------*------------------*---------------*--------------*----------------*-----*
+ * *-----*----------*-----------*-----*
+ * | ... | SCALE(4) | OFFSET(4) | ... |
+ * *-----*----------*-----------*-----*
+ * (*) Sent after SYNC_RESP and whenever the channel list changes. 
+ *     SCHEMA_ID changes with every channel list change.
+ * (*) SCALE and OFFSET, floats, follow DATA_FORMAT of fixed point 
+ *     channels only (Q15, Q7). Sample value is 
+ *     q * SCALE + OFFSET, with q the fixed point fraction in [-1, 1).
+ * 
+ * >DATA section (fragment, HEADER_FLAG_FRAGMENT set)
+ * *-----------------------*-----------------------*-------------*
+ * | FRAGMENT_INDEX (2)    | FRAGMENT_COUNT (2)    | PIECE (x)   |
+ * *-----------------------*-----------------------*-------------*
+ * (*) Frames with a DATA section above DATA_SIZE range are sent as
+ *     FRAGMENT_COUNT frames of the same type, each with a piece of 
+ *     it, in order. Header flags other than HEADER_FLAG_FRAGMENT and
+ *     timestamp are those of the first fragment.
+ * 
+ * >DATA section (BURST frame, always fragmented)
+ * *---------------*----------------*------------*
+ * | CHANNEL_ID(1) | DATA_FORMAT(1) | SAMPLES(x) |
+ * *---------------*----------------*------------*
+ * (*) A block of samples of one channel, of any size, such as a burst 
+ *     capture.
  * 
  * >EFD
  * *------------*
  * |0x242526 (3)|
  * *------------*
+ * 
+ * >COBS framing (cobsEnabled)
+ * *-----------------------*-----------*
+ * | COBS(FRAME) (x + ...) | 0x00 (1)  |
+ * *-----------------------*-----------*
+ * (*) Whole FRAME, EOM included, COBS encoded: at most one byte more
+ *     per COBS_BLOCK_SIZE bytes, plus one. 0x00 only occurs as 
+ *     delimiter. Used both ways, so both sides must agree on it.
  */
 
 
 #include "mctp_parser.h"
+#include "mctp_crc.h"
+#include "mctp_cobs.h"
 
+static const uint8_t eom[EOM_SIZE] = EOM_BYTES;
+
+/* 
+ * Frames without data section only differ in type. Copied as a whole
+ * and patched. Byte order of DATA_SIZE is little-endian.
+ */
+static const uint8_t empty_frame[MIN_FRAME_SIZE] = {
+    FRAMETYPE_NONE, 0, 0, 
+    HEADER_FILLER, HEADER_FILLER, HEADER_FILLER, HEADER_FILLER, HEADER_FILLER,
+    0x24, 0x25, 0x26
+};
+static const uint8_t syncresp_frame[SYNCRESP_FRAME_SIZE] = {
+    FRAMETYPE_SYNC_RESP, 5, 0, 
+    HEADER_FILLER, HEADER_FILLER, HEADER_FILLER, HEADER_FILLER, HEADER_FILLER,
+    0, 0, 0, 0, 0,
+    0x24, 0x25, 0x26
+};
+static const uint8_t probe_frame[PROBE_FRAME_SIZE] = {
+    FRAMETYPE_PROBE, PROBE_SIZE, 0, 
+    HEADER_FILLER, HEADER_FILLER, HEADER_FILLER, HEADER_FILLER, HEADER_FILLER,
+    0x55, 0xAA, 0x00, 0xFF, 0x0F, 0xF0, 0x33, 0xCC,
+    0x24, 0x25, 0x26
+};
+
+static void MCTP_WriteHeader(uint8_t *frame_buf, E_MCTP_FrameType frame_type, uint16_t data_size);
+static void MCTP_WriteDataHeader(MCTP_Handle *hmctp, uint8_t *frame_buf, uint16_t data_size, bool compact);
+static void MCTP_WriteFlaggedHeader(MCTP_Handle *hmctp, uint8_t *frame_buf, E_MCTP_FrameType frame_type, uint16_t data_size, uint8_t flags);
+static bool MCTP_SchemaMatch(MCTP_Handle *hmctp);
+static void MCTP_MarkCrc(MCTP_Handle *hmctp, uint8_t *frame_buf);
+static uint16_t MCTP_WriteTrailer(MCTP_Handle *hmctp, uint8_t *frame_buf, uint16_t data_size);
+static void MCTP_ChunkTrailer(MCTP_Handle *hmctp, MCTP_ChunkCursor *cursor);
+static void MCTP_ChunkNextChannel(MCTP_ChannelList *list, MCTP_ChunkCursor *cursor);
+static int MCTP_SerializeFrame(MCTP_Handle *hmctp, E_MCTP_FrameType frame_type, uint8_t *frame_buf, int frame_buf_size, uint16_t *frame_size);
+static int MCTP_SerializePiece(MCTP_Handle *hmctp, MCTP_FragCursor *cursor, uint8_t *frame_buf, int frame_buf_size, uint16_t *frame_size);
+static int MCTP_ChunkWrite(MCTP_Handle *hmctp, MCTP_ChunkCursor *cursor, uint8_t *chunk, uint16_t chunk_size, uint16_t *n);
+
+/*
+ * With COBS, frame is serialized at the end of <frame_buf>, just far
+ * enough to be encoded forward to its start.
+ */
+int MCTP_Serialize(MCTP_Handle *hmctp, E_MCTP_FrameType frame_type, uint8_t *frame_buf, int frame_buf_size, uint16_t *frame_size){
+    int status = 0;
+    uint32_t offset = frame_buf_size > 0? frame_buf_size - MCTP_FrameCapacity(hmctp, frame_buf_size) : 0;
+    uint16_t size = 0;
+
+    status = MCTP_SerializeFrame(hmctp, frame_type, frame_buf + offset, frame_buf_size - offset, &size);
+    if(status < 0){
+        goto exit;
+    }
+    if(hmctp->cobsEnabled){
+        size = MCTP_CobsEncode(frame_buf, frame_buf + offset, size);
+    }
+    if(frame_size){
+        (*frame_size) = size;
+    }
+
+exit:
+    return status;
+}
 
 /*
  * Creates serialized frame based on <frame_type>, stores it on
  * <frame_buf> and it's size on <frame_size>.
- * In case of frames with data section, such as SYNC_RESP and DATA,
+ * In case of frames with data section, such as SYNC_RESP, SCHEMA and DATA,
  * data_section is generated based on available channels on <hmctp>
  * channel list. 
  */
-int MCTP_Serialize(MCTP_Handle *hmctp, E_MCTP_FrameType frame_type, uint8_t *frame_buf, int frame_buf_size, uint16_t *frame_size){
+static int MCTP_SerializeFrame(MCTP_Handle *hmctp, E_MCTP_FrameType frame_type, uint8_t *frame_buf, int frame_buf_size, uint16_t *frame_size){
     int status = 0;
 
-    if(frame_buf_size < HEADER_SIZE + EOM_SIZE){
+    uint16_t trailer_size = MCTP_TrailerSize(hmctp);
+    if(frame_buf_size < HEADER_SIZE + trailer_size){
         status = -1;
         goto exit;
     }
 
-    uint16_t total_data_size = 0;
-    uint8_t *p_data_section = frame_buf + HEADER_SIZE;;
+    MCTP_ChannelList *list = &hmctp->channelList;
+    uint32_t total_data_size = 0;
+    uint8_t *p_data_section = frame_buf + HEADER_SIZE;
 
     /* 
      * DATA Section
@@ -57,99 +227,667 @@ int MCTP_Serialize(MCTP_Handle *hmctp, E_MCTP_FrameType frame_type, uint8_t *fra
     switch(frame_type){
         case FRAMETYPE_SYNC_RESP:
             {
-            /* N of channels */
-            memcpy(p_data_section, &(hmctp->totalChannels), 1);
-            p_data_section+= 1;
-            total_data_size += 1;
+            if(frame_buf_size < SYNCRESP_FRAME_SIZE + CRC_SIZE){
+                status = -1;
+                goto exit;
+            }
+            /* N of channels and agreed baud rate */
+            memcpy(frame_buf, syncresp_frame, SYNCRESP_FRAME_SIZE);
+            frame_buf[HEADER_SIZE] = hmctp->totalChannels;
+            memcpy(&frame_buf[HEADER_SIZE + 1], &hmctp->baudTarget, 4);
+            total_data_size = SYNCRESP_FRAME_SIZE - HEADER_SIZE - EOM_SIZE;
+            }
+            goto trailer;
+        case FRAMETYPE_PROBE:
+            if(frame_buf_size < PROBE_FRAME_SIZE + CRC_SIZE){
+                status = -1;
+                goto exit;
+            }
+            memcpy(frame_buf, probe_frame, PROBE_FRAME_SIZE);
+            total_data_size = PROBE_SIZE;
+            goto trailer;
+        case FRAMETYPE_SCHEMA:
+            {
+            if(frame_buf_size < SCHEMA_FRAME_SIZE(list->numberOfChannels) + CRC_SIZE){
+                status = -1;
+                goto exit;
+            }
+
+            /* Schema version and N of channels */
+            p_data_section[0] = hmctp->schemaId;
+            p_data_section[1] = list->numberOfChannels;
+            p_data_section += 2;
+            total_data_size += 2;
+
+            /* Datainfo, with full buffer size, as planned */
+            for(int k = 0; k < list->numberOfChannels; k++){
+                MCTP_Channel *channel = &list->channels[list->active[k]];
+                memcpy(p_data_section, channel->info, DATAINFO_SIZE);
+                p_data_section += DATAINFO_SIZE;
+                total_data_size += DATAINFO_SIZE;
+                if(DATATYPE_IS_SCALED(channel->dataType)){
+                    memcpy(&p_data_section[0], &channel->scale, 4);
+                    memcpy(&p_data_section[4], &channel->offset, 4);
+                    p_data_section += SCALEINFO_SIZE;
+                    total_data_size += SCALEINFO_SIZE;
+                }
+            }
             }
             break;
         case FRAMETYPE_DATA:
             {
-            /* N of channels */
-            memcpy(p_data_section, &(hmctp->channelList.numberOfChannels), 1);
+            bool compact = MCTP_SchemaMatch(hmctp);
+
+            /* Sequence */
+            *p_data_section = hmctp->txSequence;
+            p_data_section += 1;
+            total_data_size += 1;
+
+            /* N of channels, or schema version */
+            if(compact){
+                *p_data_section = hmctp->schemaId;
+            }else{
+                *p_data_section = list->numberOfChannels;
+            }
             p_data_section += 1;
             total_data_size += 1;
 
-            /* Datainfo + Data */
-            for(int i = 0; i < MAX_CHANNELS; i++){
-                if(hmctp->channelList.map[i] && hmctp->channelList.channels[i].storedSize > 0){
-                    uint8_t *data = hmctp->channelList.channels[i].dataBuf;
-                    uint16_t data_size = hmctp->channelList.channels[i].storedSize;
-                    E_MCTP_DataType data_type = hmctp->channelList.channels[i].dataType;
-
-                    total_data_size += data_size + DATAINFO_SIZE;
-                    if(total_data_size > MAX_DATA_SIZE){
-                        /* FIXME: Irrelevant, since total_data_size is 2 bytes */
-                        status = -1;
-                        goto exit;
-                    }
-                    /* Channel id */
-                    memcpy(p_data_section, &i, 1);  
-                    p_data_section += 1;
-                    /* Data size */
-                    memcpy(p_data_section, &data_size, 2);
-                    p_data_section += 2;
-                    /* Data type */
-                    memcpy(p_data_section, &data_type, 1);
-                    p_data_section += 1;
-                    memcpy(p_data_section, data, data_size);
-                    p_data_section += data_size;
+            /* 
+             * Datainfo + Data. Datainfo is the planned one, with size
+             * patched for channels not full.
+             */
+            for(int k = 0; k < list->numberOfChannels; k++){
+                MCTP_Channel *channel = &list->channels[list->active[k]];
+                uint16_t data_size = channel->storedSize;
+                if(data_size == 0){
+                    continue;
                 }
+
+                total_data_size += data_size + (compact? 0 : DATAINFO_SIZE);
+                if(total_data_size >= MAX_DATA_SIZE ||
+                        HEADER_SIZE + total_data_size + trailer_size > (uint32_t)frame_buf_size){
+                    status = -1;
+                    goto exit;
+                }
+                if(!compact){
+                    uint8_t info[DATAINFO_SIZE] = {channel->info[0], data_size, data_size >> 8, channel->info[3]};
+                    memcpy(p_data_section, info, DATAINFO_SIZE);
+                    p_data_section += DATAINFO_SIZE;
+                }
+                memcpy(p_data_section, channel->dataBuf, data_size);
+                p_data_section += data_size;
             }
+            MCTP_WriteDataHeader(hmctp, frame_buf, total_data_size, compact);
             }
             break;
         case FRAMETYPE_SYNC:
-            break;
         case FRAMETYPE_ACK:
-            break;
         case FRAMETYPE_REQUEST:
-            break;
         case FRAMETYPE_STOP:
-            break;
         case FRAMETYPE_DROP:
-            break;
+            memcpy(frame_buf, empty_frame, MIN_FRAME_SIZE);
+            frame_buf[0] = frame_type;
+            goto trailer;
         default:
             status = -1;
             goto exit;
     }
 
     /* HEADER Section */
-    frame_buf[0] = frame_type;
-    memcpy(&frame_buf[1], &total_data_size, 2);
-    const uint8_t reserved[5] = {0x05, 0x05, 0x05, 0x05, 0x05};
-    memcpy(&frame_buf[3], reserved, 5);
-    
-    /* EOM Section */
-    const uint8_t eom[EOM_SIZE] = {0x24, 0x25, 0x26};
-    memcpy(p_data_section, eom, EOM_SIZE);
+    if(frame_type != FRAMETYPE_DATA){
+        MCTP_WriteHeader(frame_buf, frame_type, total_data_size);
+    }
 
-    /* Save total serialized frame size */
-    uint16_t total_size = HEADER_SIZE + total_data_size + EOM_SIZE;
+trailer:
+    /* CRC and EOM Section. Save total serialized frame size */
+    trailer_size = MCTP_WriteTrailer(hmctp, frame_buf, total_data_size);
     if(frame_size){
-        (*frame_size) = total_size > MAX_FRAME_SIZE? MAX_FRAME_SIZE : total_size;
+        (*frame_size) = HEADER_SIZE + total_data_size + trailer_size;
     }
 
 exit:
     return status;
 }
 
+/*
+ * Frame plan: configured channels are listed once in frame order, with
+ * their datainfo, so serializing walks only channels in use.
+ */
+void MCTP_BuildFramePlan(MCTP_ChannelList *list){
+    int n = 0;
+
+    for(int i = 0; i < MAX_CHANNELS; i++){
+        if(list->map[i]){
+            MCTP_Channel *channel = &list->channels[i];
+            channel->info[0] = i;
+            memcpy(&channel->info[1], &channel->bufSize, 2);
+            channel->info[3] = channel->dataType;
+            list->active[n++] = i;
+        }
+    }
+    list->numberOfChannels = n;
+}
 
 /*
- * Extracts frame type and data size from msg.
- * TODO: If any subsection is added to header section reserved bits,
- * implement it's parsing here.
+ * Same walk as MCTP_Serialize, without copying.
  */
-int MCTP_ParseMsg(uint8_t *msg, int msg_size, MCTP_Frame *frame){
+uint32_t MCTP_DataFrameSize(MCTP_Handle *hmctp){
+    MCTP_ChannelList *list = &hmctp->channelList;
+    bool compact = MCTP_SchemaMatch(hmctp);
+    uint32_t size = HEADER_SIZE + DATAHEAD_SIZE + MCTP_TrailerSize(hmctp);
+
+    for(int k = 0; k < list->numberOfChannels; k++){
+        MCTP_Channel *channel = &list->channels[list->active[k]];
+        if(channel->storedSize){
+            size += channel->storedSize + (compact? 0 : DATAINFO_SIZE);
+        }
+    }
+    return size;
+}
+
+/*
+ * Header, sequence and channel count, then datainfo and full buffer
+ * for every enabled channel, and trailer.
+ */
+uint32_t MCTP_DataFrameMaxSize(MCTP_Handle *hmctp, uint32_t list_size){
+    uint32_t size = HEADER_SIZE + DATAHEAD_SIZE + list_size + MCTP_TrailerSize(hmctp);
+    return hmctp->cobsEnabled? COBS_MAX_SIZE(size) : size;
+}
+
+uint32_t MCTP_FrameCapacity(MCTP_Handle *hmctp, uint32_t buf_size){
+    return hmctp->cobsEnabled? MCTP_CobsCapacity(buf_size) : buf_size;
+}
+
+uint16_t MCTP_TrailerSize(MCTP_Handle *hmctp){
+    return hmctp->crcEnabled? CRC_SIZE + EOM_SIZE : EOM_SIZE;
+}
+
+int MCTP_FragmentStart(MCTP_FragCursor *cursor, E_MCTP_FrameType frame_type, const uint8_t *head, uint8_t head_size, const uint8_t *data, uint32_t data_size, uint16_t frag_size){
     int status = 0;
-    if(msg_size < HEADER_SIZE + EOM_SIZE){
+    uint32_t total_size = head_size + data_size;
+
+    /* Head goes whole in the first fragment */
+    if(frag_size == 0 || frag_size < head_size || head_size > BURSTHEAD_SIZE ||
+            FRAGHEAD_SIZE + frag_size >= MAX_DATA_SIZE){
+        status = -1;
+        goto exit;
+    }
+    uint32_t count = (total_size + frag_size - 1) / frag_size;
+    if(count > 0xFFFF){
         status = -1;
         goto exit;
     }
 
-    memset(frame, 0, sizeof(MCTP_Frame));
+    cursor->type = frame_type;
+    memcpy(cursor->head, head, head_size);
+    cursor->headSize = head_size;
+    cursor->data = data;
+    cursor->dataSize = data_size;
+    cursor->offset = 0;
+    cursor->index = 0;
+    cursor->count = count;
+    cursor->fragSize = frag_size;
+
+exit:
+    return status;
+}
+
+/*
+ * Same as MCTP_Serialize, fragment is serialized at the end of
+ * <frame_buf> if it is COBS encoded.
+ */
+int MCTP_SerializeFragment(MCTP_Handle *hmctp, MCTP_FragCursor *cursor, uint8_t *frame_buf, int frame_buf_size, uint16_t *frame_size){
+    int status = 0;
+    uint32_t offset = frame_buf_size > 0? frame_buf_size - MCTP_FrameCapacity(hmctp, frame_buf_size) : 0;
+
+    status = MCTP_SerializePiece(hmctp, cursor, frame_buf + offset, frame_buf_size - offset, frame_size);
+    if(status == 0 && *frame_size && hmctp->cobsEnabled){
+        *frame_size = MCTP_CobsEncode(frame_buf, frame_buf + offset, *frame_size);
+    }
+
+    return status;
+}
+
+/*
+ * A piece may take bytes from both head and data. Only the first one
+ * takes the timestamp, since later ones may be serialized after the
+ * application set one for its next DATA frame.
+ */
+static int MCTP_SerializePiece(MCTP_Handle *hmctp, MCTP_FragCursor *cursor, uint8_t *frame_buf, int frame_buf_size, uint16_t *frame_size){
+    int status = 0;
+    uint32_t total_size = cursor->headSize + cursor->dataSize;
+
+    if(cursor->index == cursor->count){
+        *frame_size = 0;
+        goto exit;
+    }
+
+    uint32_t piece_size = total_size - cursor->offset;
+    if(piece_size > cursor->fragSize){
+        piece_size = cursor->fragSize;
+    }
+    if(HEADER_SIZE + FRAGHEAD_SIZE + piece_size + MCTP_TrailerSize(hmctp) > (uint32_t)frame_buf_size){
+        status = -1;
+        goto exit;
+    }
+
+    if(cursor->index == 0){
+        MCTP_WriteFlaggedHeader(hmctp, frame_buf, cursor->type, FRAGHEAD_SIZE + piece_size, HEADER_FLAG_FRAGMENT);
+    }else{
+        MCTP_WriteHeader(frame_buf, cursor->type, FRAGHEAD_SIZE + piece_size);
+        frame_buf[3] = HEADER_FLAG_FRAGMENT;
+    }
+    uint8_t *p = frame_buf + HEADER_SIZE;
+    memcpy(&p[0], &cursor->index, 2);
+    memcpy(&p[2], &cursor->count, 2);
+    p += FRAGHEAD_SIZE;
+
+    uint32_t end = cursor->offset + piece_size;
+    if(cursor->offset < cursor->headSize){
+        uint32_t n = (end < cursor->headSize? end : cursor->headSize) - cursor->offset;
+        memcpy(p, &cursor->head[cursor->offset], n);
+        p += n;
+        cursor->offset += n;
+    }
+    memcpy(p, &cursor->data[cursor->offset - cursor->headSize], end - cursor->offset);
+
+    cursor->offset = end;
+    cursor->index++;
+    *frame_size = HEADER_SIZE + FRAGHEAD_SIZE + piece_size + 
+        MCTP_WriteTrailer(hmctp, frame_buf, FRAGHEAD_SIZE + piece_size);
+
+exit:
+    return status;
+}
+
+/*
+ * Builds the DATA frame as a chain of segments. Header, sequence, 
+ * channel count and channels datainfo are written to <meta_buf>, and
+ * segments alternate between runs of <meta_buf> and channels dataBuf:
+ *
+ * [HEADER + SEQUENCE + N_OF_CHANNELS + DATAINFO 0] [SAMPLES 0] [DATAINFO 1] 
+ * [SAMPLES 1] ... [SAMPLES n] [CRC + EOM]
+ *
+ * CRC, if enabled, is computed over the segments and written to 
+ * <meta_buf> after the last datainfo.
+ */
+int MCTP_SerializeSegments(MCTP_Handle *hmctp, uint8_t *meta_buf, int meta_buf_size, MCTP_TxSegment *segs, int max_segs, int *n_segs){
+    int status = 0;
+    MCTP_ChannelList *list = &hmctp->channelList;
+
+    if(meta_buf_size < HEADER_SIZE + DATAHEAD_SIZE + list->numberOfChannels * DATAINFO_SIZE + 
+                CRC_SIZE + EOM_SIZE ||
+            max_segs < 2 * list->numberOfChannels + 2){
+        status = -1;
+        goto exit;
+    }
+
+    bool compact = MCTP_SchemaMatch(hmctp);
+    uint32_t total_data_size = DATAHEAD_SIZE;
+    uint8_t *p_meta = meta_buf + HEADER_SIZE;
+    int n = 0;
+
+    /* Sequence and N of channels, or schema version */
+    *p_meta++ = hmctp->txSequence;
+    *p_meta++ = compact? hmctp->schemaId : list->numberOfChannels;
+    segs[n].ptr = meta_buf;
+    segs[n++].size = HEADER_SIZE + DATAHEAD_SIZE;
+
+    /* 
+     * Datainfo is appended to the open meta segment, data gets its own.
+     * Frames following schema are only data after the first segment.
+     */
+    for(int k = 0; k < list->numberOfChannels; k++){
+        MCTP_Channel *channel = &list->channels[list->active[k]];
+        uint16_t data_size = channel->storedSize;
+        if(data_size == 0){
+            continue;
+        }
+
+        total_data_size += data_size + (compact? 0 : DATAINFO_SIZE);
+        if(total_data_size >= MAX_DATA_SIZE){
+            status = -1;
+            goto exit;
+        }
+        if(!compact){
+            memcpy(p_meta, channel->info, DATAINFO_SIZE);
+            memcpy(&p_meta[1], &data_size, 2);
+            p_meta += DATAINFO_SIZE;
+            segs[n - 1].size += DATAINFO_SIZE;
+        }
+
+        segs[n].ptr = channel->dataBuf;
+        segs[n++].size = data_size;
+        if(!compact){
+            segs[n].ptr = p_meta;
+            segs[n++].size = 0;
+        }
+    }
+
+    /* Last meta segment is empty if any channel was added */
+    if(segs[n - 1].size == 0){
+        n--;
+    }
+
+    MCTP_WriteDataHeader(hmctp, meta_buf, total_data_size, compact);
+    MCTP_MarkCrc(hmctp, meta_buf);
+    if(hmctp->crcEnabled){
+        uint32_t crc = MCTP_CRC_INIT;
+        for(int k = 0; k < n; k++){
+            crc = MCTP_Crc32Update(crc, segs[k].ptr, segs[k].size);
+        }
+        crc = ~crc;
+        memcpy(p_meta, &crc, CRC_SIZE);
+        memcpy(p_meta + CRC_SIZE, eom, EOM_SIZE);
+        segs[n].ptr = p_meta;
+        segs[n++].size = CRC_SIZE + EOM_SIZE;
+    }else{
+        segs[n].ptr = eom;
+        segs[n++].size = EOM_SIZE;
+    }
+    *n_segs = n;
+
+exit:
+    return status;
+}
+
+/*
+ * Frame is walked as a sequence of parts: header, sequence and channel
+ * count, then datainfo and samples of each channel with stored data,
+ * then CRC and EOM. The cursor keeps the current part and how much of
+ * it was already written, so any chunk size can be used. CRC is 
+ * updated with every chunk, so no byte is read twice.
+ */
+int MCTP_SerializeChunkStart(MCTP_Handle *hmctp, MCTP_ChunkCursor *cursor){
+    int status = 0;
+    MCTP_ChannelList *list = &hmctp->channelList;
+    bool compact = MCTP_SchemaMatch(hmctp);
+
+    uint32_t total_data_size = DATAHEAD_SIZE;
+    for(int k = 0; k < list->numberOfChannels; k++){
+        int stored_size = list->channels[list->active[k]].storedSize;
+        if(stored_size > 0){
+            total_data_size += stored_size + (compact? 0 : DATAINFO_SIZE);
+        }
+    }
+    if(total_data_size >= MAX_DATA_SIZE){
+        status = -1;
+        goto exit;
+    }
+
+    MCTP_WriteDataHeader(hmctp, cursor->meta, total_data_size, compact);
+    MCTP_MarkCrc(hmctp, cursor->meta);
+    MCTP_CobsEncoderStart(&hmctp->txCobs);
+    cursor->crc = MCTP_CRC_INIT;
+    cursor->meta[HEADER_SIZE] = hmctp->txSequence;
+    cursor->meta[HEADER_SIZE + 1] = compact? hmctp->schemaId : list->numberOfChannels;
+    cursor->compact = compact;
+    cursor->metaSize = HEADER_SIZE + DATAHEAD_SIZE;
+    cursor->part = CHUNK_META;
+    cursor->channel = -1;
+    cursor->offset = 0;
+
+exit:
+    return status;
+}
+
+/*
+ * With COBS, frame bytes are written straight into the encoder, at 
+ * most one block at a time, and chunks are read from it. Once the 
+ * frame is complete, cursor stays at CHUNK_FLUSH until every encoded
+ * byte was read.
+ */
+int MCTP_SerializeChunk(MCTP_Handle *hmctp, MCTP_ChunkCursor *cursor, uint8_t *chunk, uint16_t chunk_size, uint16_t *n){
+    int status = 0;
+    MCTP_CobsEncoder *enc = &hmctp->txCobs;
+    uint16_t written = 0;
+
+    if(!hmctp->cobsEnabled){
+        return MCTP_ChunkWrite(hmctp, cursor, chunk, chunk_size, n);
+    }
+
+    while(written < chunk_size && cursor->part != CHUNK_DONE){
+        written += MCTP_CobsEncoderRead(enc, chunk + written, chunk_size - written);
+        if(cursor->part == CHUNK_FLUSH){
+            if(MCTP_CobsEncoderDone(enc)){
+                cursor->part = CHUNK_DONE;
+            }
+            continue;
+        }
+
+        uint8_t *space;
+        uint16_t copy = 0;
+        uint16_t room = MCTP_CobsEncoderSpace(enc, &space);
+        if(room == 0){
+            continue;
+        }
+        if(MCTP_ChunkWrite(hmctp, cursor, space, room, &copy) < 0){
+            status = -1;
+            goto exit;
+        }
+        MCTP_CobsEncoderCommit(enc, copy);
+        if(cursor->part == CHUNK_DONE){
+            MCTP_CobsEncoderEnd(enc);
+            cursor->part = CHUNK_FLUSH;
+        }
+    }
+
+exit:
+    *n = written;
+    return status;
+}
+
+/*
+ * Writes frame bytes at <cursor>, before any COBS encoding.
+ */
+static int MCTP_ChunkWrite(MCTP_Handle *hmctp, MCTP_ChunkCursor *cursor, uint8_t *chunk, uint16_t chunk_size, uint16_t *n){
+    int status = 0;
+    MCTP_ChannelList *list = &hmctp->channelList;
+    uint16_t written = 0;
+
+    while(written < chunk_size && cursor->part != CHUNK_DONE){
+        const uint8_t *part;
+        uint16_t part_size;
+
+        switch(cursor->part){
+            case CHUNK_META:
+                part = cursor->meta;
+                part_size = cursor->metaSize;
+                break;
+            case CHUNK_SAMPLES:
+                part = list->channels[list->active[cursor->channel]].dataBuf;
+                part_size = list->channels[list->active[cursor->channel]].storedSize;
+                break;
+            case CHUNK_EOM:
+                part = cursor->trailer;
+                part_size = cursor->trailerSize;
+                break;
+            default:
+                status = -1;
+                goto exit;
+        }
+
+        uint16_t copy = part_size - cursor->offset;
+        if(copy > chunk_size - written){
+            copy = chunk_size - written;
+        }
+        memcpy(chunk + written, part + cursor->offset, copy);
+        if(hmctp->crcEnabled && cursor->part != CHUNK_EOM){
+            cursor->crc = MCTP_Crc32Update(cursor->crc, chunk + written, copy);
+        }
+        written += copy;
+        cursor->offset += copy;
+
+        if(cursor->offset < part_size){
+            /* Chunk is full */
+            break;
+        }
+
+        /* Next part */
+        cursor->offset = 0;
+        if(cursor->part == CHUNK_META && cursor->channel >= 0){
+            cursor->part = CHUNK_SAMPLES;
+        }else if(cursor->part == CHUNK_EOM){
+            cursor->part = CHUNK_DONE;
+        }else{
+            MCTP_ChunkNextChannel(list, cursor);
+            if(cursor->part == CHUNK_EOM){
+                MCTP_ChunkTrailer(hmctp, cursor);
+            }
+        }
+    }
+
+exit:
+    *n = written;
+    return status;
+}
+
+/*
+ * Moves <cursor> to datainfo of next channel with stored data, or to
+ * its samples if frame follows schema, or to EOM if none is left.
+ */
+static void MCTP_ChunkNextChannel(MCTP_ChannelList *list, MCTP_ChunkCursor *cursor){
+    for(int k = cursor->channel + 1; k < list->numberOfChannels; k++){
+        MCTP_Channel *channel = &list->channels[list->active[k]];
+        if(channel->storedSize > 0){
+            cursor->channel = k;
+            if(cursor->compact){
+                cursor->part = CHUNK_SAMPLES;
+                return;
+            }
+            uint16_t data_size = channel->storedSize;
+            memcpy(cursor->meta, channel->info, DATAINFO_SIZE);
+            memcpy(&cursor->meta[1], &data_size, 2);
+            cursor->metaSize = DATAINFO_SIZE;
+            cursor->part = CHUNK_META;
+            return;
+        }
+    }
+    cursor->part = CHUNK_EOM;
+}
+
+/*
+ * Fills trailer of <cursor> once every byte before it was written.
+ */
+static void MCTP_ChunkTrailer(MCTP_Handle *hmctp, MCTP_ChunkCursor *cursor){
+    cursor->trailerSize = 0;
+    if(hmctp->crcEnabled){
+        uint32_t crc = ~cursor->crc;
+        memcpy(cursor->trailer, &crc, CRC_SIZE);
+        cursor->trailerSize = CRC_SIZE;
+    }
+    memcpy(&cursor->trailer[cursor->trailerSize], eom, EOM_SIZE);
+    cursor->trailerSize += EOM_SIZE;
+}
+
+/*
+ * Sets HEADER_FLAG_CRC of the header in <frame_buf>, if enabled. 
+ * Header must be complete, and its CRC not computed yet.
+ */
+static void MCTP_MarkCrc(MCTP_Handle *hmctp, uint8_t *frame_buf){
+    if(hmctp->crcEnabled){
+        frame_buf[3] = (frame_buf[3] == HEADER_FILLER? 0 : frame_buf[3]) | HEADER_FLAG_CRC;
+    }
+}
+
+/*
+ * Writes CRC, if enabled, and EOM after <data_size> bytes of DATA 
+ * section of the frame in <frame_buf>. Returns bytes written.
+ */
+static uint16_t MCTP_WriteTrailer(MCTP_Handle *hmctp, uint8_t *frame_buf, uint16_t data_size){
+    uint8_t *p = frame_buf + HEADER_SIZE + data_size;
+
+    MCTP_MarkCrc(hmctp, frame_buf);
+    if(hmctp->crcEnabled){
+        uint32_t crc = MCTP_Crc32(frame_buf, HEADER_SIZE + data_size);
+        memcpy(p, &crc, CRC_SIZE);
+        p += CRC_SIZE;
+    }
+    memcpy(p, eom, EOM_SIZE);
+
+    return MCTP_TrailerSize(hmctp);
+}
+
+/*
+ * Writes HEADER section.
+ */
+static void MCTP_WriteHeader(uint8_t *frame_buf, E_MCTP_FrameType frame_type, uint16_t data_size){
+    frame_buf[0] = frame_type;
+    memcpy(&frame_buf[1], &data_size, 2);
+    memset(&frame_buf[3], HEADER_FILLER, 5);
+}
+
+/*
+ * Writes HEADER section of a DATA frame, with capture timestamp if one
+ * was given, and schema flag if <compact>. Timestamp is only used once.
+ */
+static void MCTP_WriteDataHeader(MCTP_Handle *hmctp, uint8_t *frame_buf, uint16_t data_size, bool compact){
+    MCTP_WriteFlaggedHeader(hmctp, frame_buf, FRAMETYPE_DATA, data_size, compact? HEADER_FLAG_SCHEMA : 0);
+}
+
+/*
+ * Writes HEADER section with <flags>, and capture timestamp if one 
+ * was given.
+ */
+static void MCTP_WriteFlaggedHeader(MCTP_Handle *hmctp, uint8_t *frame_buf, E_MCTP_FrameType frame_type, uint16_t data_size, uint8_t flags){
+    MCTP_WriteHeader(frame_buf, frame_type, data_size);
+    if(hmctp->txTimestampValid){
+        flags |= HEADER_FLAG_TIMESTAMP;
+        memcpy(&frame_buf[4], &hmctp->txTimestamp, 4);
+        hmctp->txTimestampValid = false;
+    }
+    if(flags){
+        frame_buf[3] = flags;
+    }
+}
+
+/*
+ * A DATA frame may leave datainfo out if controller knows the current
+ * channel list, and every enabled channel is full, as announced.
+ */
+static bool MCTP_SchemaMatch(MCTP_Handle *hmctp){
+    MCTP_ChannelList *list = &hmctp->channelList;
+
+    if(!hmctp->schemaValid || hmctp->schemaAnnounced != hmctp->schemaId){
+        return false;
+    }
+    for(int k = 0; k < list->numberOfChannels; k++){
+        MCTP_Channel *channel = &list->channels[list->active[k]];
+        if(channel->storedSize != channel->bufSize){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*
+ * Extracts frame type and data size from msg, and makes the data
+ * section view. The receiver already checked EOM and CRC, so only 
+ * the size is checked again here.
+ */
+int MCTP_ParseMsg(const MCTP_View *msg, MCTP_Frame *frame){
+    int status = 0;
+    uint8_t header[HEADER_SIZE];
+
+    if(msg->size < HEADER_SIZE + EOM_SIZE){
+        status = -1;
+        goto exit;
+    }
+
+    MCTP_ViewRead(msg, 0, header, HEADER_SIZE);
+    if(MCTP_ParseHeader(header, frame) < 0){
+        status = -1;
+        goto exit;
+    }
+    if(MCTP_RecvFrameSize(frame) != msg->size){
+        status = -1;
+        goto exit;
+    }
 
-    frame->type = msg[0];
-    memcpy(&frame->dataSize, &msg[1], 2);
+    frame->dataSection = *msg;
+    frame->dataSection.start = msg->start + HEADER_SIZE;
+    frame->dataSection.size = frame->dataSize;
     if(frame->dataSize){
         /* 
          * TODO: If any packet with data section needs to be parsed
@@ -0,0 +1,473 @@
+/**
+ * @file mctp_recv.c
+ * @brief Delimiting and queuing of received frames.
+ */
+
+/*
+ * Frames are delimited by length. Bytes are collected until a full
+ * header is received, which gives the exact frame size through its
+ * DATA_SIZE field. The rest of the frame is then copied in bulk and
+ * the EOM is checked only once, as a trailer. A header with an unknown
+ * frame type or a frame with a wrong trailer causes a resync to the
+ * next byte that can start a frame.
+ *
+ * Frames with HEADER_FLAG_CRC carry CRC_SIZE more bytes before EOM. 
+ * Their CRC is checked along with the EOM, and a mismatch is handled
+ * as a wrong trailer, so only intact frames are queued.
+ *
+ * With COBS, frames are delimited by COBS_DELIMITER instead, and
+ * decoded into the ring as they arrive. Runs of data bytes between
+ * code bytes are copied in bulk, after memchr checked they hold no
+ * delimiter. A frame is checked once its delimiter comes, and dropped
+ * if its header, size, CRC or EOM is wrong, or if a delimiter cut one of
+ * its blocks short. Either way, the next frame starts right after the
+ * delimiter, so a corrupted frame never costs more than itself.
+ *
+ * Complete frames are not handled here, since reception runs in
+ * interrupt context. A descriptor of the frame is pushed to a
+ * single-producer/single-consumer queue, and MCTP_Poll runs the
+ * communication task on it from the application main loop.
+ *
+ * The ring is parsed in place, frames possibly wrapped around its end.
+ * Consuming a frame only moves indices, so the cost per frame doesn't
+ * depend on the ring size.
+ */
+
+#include <string.h>
+#include "mctp_recv.h"
+#include "mctp_crc.h"
+
+#define RECV_MASK (RECV_BUFFER_SIZE - 1)
+
+_Static_assert((RECV_BUFFER_SIZE & RECV_MASK) == 0, "RECV_BUFFER_SIZE must be a power of 2");
+_Static_assert((RECV_QUEUE_SIZE & (RECV_QUEUE_SIZE - 1)) == 0, "RECV_QUEUE_SIZE must be a power of 2");
+
+static void MCTP_RecvProcess(MCTP_Receiver *recv);
+static void MCTP_RecvResync(MCTP_Receiver *recv);
+static void MCTP_RecvPush(MCTP_Receiver *recv);
+static uint16_t MCTP_RecvFreeSpace(MCTP_Receiver *recv);
+static void MCTP_RecvCopy(MCTP_Receiver *recv, const uint8_t *data, uint16_t n);
+static void MCTP_RecvIngestCobs(MCTP_Receiver *recv, const uint8_t *data, uint16_t size);
+static void MCTP_RecvCobsAppend(MCTP_Receiver *recv, const uint8_t *data, uint16_t n);
+static void MCTP_RecvCobsEnd(MCTP_Receiver *recv);
+static bool MCTP_RecvCrcValid(const MCTP_View *view, const MCTP_Frame *frame);
+
+void MCTP_RecvInit(MCTP_Receiver *recv, bool cobs){
+    recv->cobs = cobs;
+    recv->head = 0;
+    recv->index = 0;
+    MCTP_RecvReset(recv);
+
+    atomic_init(&recv->queue.head, 0);
+    atomic_init(&recv->queue.tail, 0);
+    recv->queue.dropped = 0;
+    recv->crcErrors = 0;
+}
+
+void MCTP_RecvReset(MCTP_Receiver *recv){
+    recv->head += recv->index;
+    recv->index = 0;
+    recv->frameSize = 0;
+    recv->skip = 0;
+    recv->cobsLeft = 0;
+    recv->cobsZero = false;
+    recv->cobsHunt = false;
+}
+
+void MCTP_RecvIngest(MCTP_Receiver *recv, const uint8_t *data, uint16_t size){
+    if(recv->cobs){
+        MCTP_RecvIngestCobs(recv, data, size);
+        return;
+    }
+
+    while(size > 0){
+        /* Skip remaining bytes of a dropped frame */
+        if(recv->skip){
+            uint16_t n = recv->skip < size? recv->skip : size;
+            recv->skip -= n;
+            data += n;
+            size -= n;
+            continue;
+        }
+
+        /* Skip bytes that can't start a frame */
+        if(recv->index == 0){
+            while(size > 0 && (data[0] == FRAMETYPE_NONE || data[0] >= FRAMETYPE_END)){
+                data++;
+                size--;
+            }
+            if(size == 0){
+                break;
+            }
+        }
+
+        /* Copy up to the end of header, or of frame if header is known */
+        uint16_t wanted = recv->frameSize? recv->frameSize : HEADER_SIZE;
+        uint16_t n = wanted - recv->index;
+        if(n > size){
+            n = size;
+        }
+        if(n > MCTP_RecvFreeSpace(recv)){
+            /* Queued frames hold the ring. Drop the frame being received */
+            recv->queue.dropped++;
+            recv->skip = recv->frameSize? recv->frameSize - recv->index : n;
+            recv->index = 0;
+            recv->frameSize = 0;
+            continue;
+        }
+
+        MCTP_RecvCopy(recv, data, n);
+        data += n;
+        size -= n;
+
+        MCTP_RecvProcess(recv);
+    }
+}
+
+/*
+ * Appends <n> bytes to the frame being received. Caller checked
+ * there is space.
+ */
+static void MCTP_RecvCopy(MCTP_Receiver *recv, const uint8_t *data, uint16_t n){
+    uint16_t pos = (recv->head + recv->index) & RECV_MASK;
+    uint16_t first = RECV_BUFFER_SIZE - pos;
+    if(first > n){
+        first = n;
+    }
+    memcpy(&recv->buf[pos], data, first);
+    memcpy(recv->buf, data + first, n - first);
+    recv->index += n;
+}
+
+/*
+ * COBS decoder. cobsLeft counts data bytes left in the current block,
+ * and a byte coming when it is 0 is a code byte. The zero a block code
+ * stands for is only written when the next block starts, since the
+ * last block of a frame has none.
+ */
+static void MCTP_RecvIngestCobs(MCTP_Receiver *recv, const uint8_t *data, uint16_t size){
+    static const uint8_t zero = 0;
+
+    while(size > 0){
+        if(recv->cobsHunt){
+            const uint8_t *delimiter = memchr(data, COBS_DELIMITER, size);
+            if(!delimiter){
+                break;
+            }
+            size -= delimiter - data;
+            data = delimiter;
+        }
+
+        if(data[0] == COBS_DELIMITER){
+            MCTP_RecvCobsEnd(recv);
+            data++;
+            size--;
+            continue;
+        }
+
+        if(recv->cobsLeft == 0){
+            uint8_t code = data[0];
+            data++;
+            size--;
+            if(recv->cobsZero){
+                MCTP_RecvCobsAppend(recv, &zero, 1);
+            }
+            recv->cobsLeft = code - 1;
+            recv->cobsZero = code != 0xFF;
+            continue;
+        }
+
+        uint16_t n = recv->cobsLeft < size? recv->cobsLeft : size;
+        if(memchr(data, COBS_DELIMITER, n)){
+            /* Block cut short. Frame lost bytes */
+            recv->cobsHunt = true;
+            continue;
+        }
+        MCTP_RecvCobsAppend(recv, data, n);
+        recv->cobsLeft -= n;
+        data += n;
+        size -= n;
+    }
+}
+
+/*
+ * Appends decoded bytes, unless the frame is being dropped. Without
+ * ring space, frame is dropped up to its delimiter.
+ */
+static void MCTP_RecvCobsAppend(MCTP_Receiver *recv, const uint8_t *data, uint16_t n){
+    if(recv->cobsHunt){
+        return;
+    }
+    if(n > MCTP_RecvFreeSpace(recv)){
+        recv->queue.dropped++;
+        recv->cobsHunt = true;
+        return;
+    }
+    MCTP_RecvCopy(recv, data, n);
+}
+
+/*
+ * Delimiter received. The decoded frame is queued if it is exactly
+ * the size its header gives, ends with EOM, and its CRC matches if it
+ * has one. Decoder is reset for
+ * the next frame in any case.
+ */
+static void MCTP_RecvCobsEnd(MCTP_Receiver *recv){
+    MCTP_View view = {
+        .buf = recv->buf,
+        .mask = RECV_MASK,
+        .start = recv->head,
+        .size = recv->index,
+    };
+    uint8_t header[HEADER_SIZE];
+    uint8_t EOMsection[EOM_SIZE];
+    MCTP_Frame frame;
+
+    if(!recv->cobsHunt && recv->index >= MIN_FRAME_SIZE){
+        MCTP_ViewRead(&view, 0, header, HEADER_SIZE);
+        MCTP_ViewRead(&view, recv->index - EOM_SIZE, EOMsection, EOM_SIZE);
+        if(MCTP_ParseHeader(header, &frame) == 0 &&
+                MCTP_RecvFrameSize(&frame) == recv->index &&
+                EOMsection[0] == 0x24 && EOMsection[1] == 0x25 && EOMsection[2] == 0x26){
+            if(MCTP_RecvCrcValid(&view, &frame)){
+                recv->frameSize = recv->index;
+                MCTP_RecvPush(recv);
+                recv->head += recv->frameSize;
+            }else{
+                recv->crcErrors++;
+            }
+        }
+    }
+
+    recv->index = 0;
+    recv->frameSize = 0;
+    recv->cobsLeft = 0;
+    recv->cobsZero = false;
+    recv->cobsHunt = false;
+}
+
+/*
+ * Ring bytes available after the frame being received. Producer
+ * side. If no frame is queued, the whole ring but the frame being
+ * received is free. Otherwise free space ends at the oldest queued
+ * frame. A stale descriptor read while MCTP_Poll releases it only
+ * underestimates free space.
+ */
+static uint16_t MCTP_RecvFreeSpace(MCTP_Receiver *recv){
+    MCTP_RecvQueue *queue = &recv->queue;
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    uint16_t used = recv->index;
+    if(head != tail){
+        uint16_t oldest = queue->slots[tail & (RECV_QUEUE_SIZE - 1)].start;
+        used = (uint16_t)(recv->head + recv->index - oldest);
+    }
+
+    return RECV_BUFFER_SIZE - used;
+}
+
+/*
+ * Advances the frame parser over the bytes of the frame being
+ * received. Loops because a resync may leave more than one header
+ * worth of bytes, or even a complete frame, in the ring.
+ */
+static void MCTP_RecvProcess(MCTP_Receiver *recv){
+    MCTP_View view = {
+        .buf = recv->buf,
+        .mask = RECV_MASK,
+    };
+
+    for(;;){
+        view.start = recv->head;
+        view.size = recv->index;
+
+        if(recv->frameSize == 0){
+            if(recv->index < HEADER_SIZE){
+                return;
+            }
+
+            uint8_t header[HEADER_SIZE];
+            MCTP_ViewRead(&view, 0, header, HEADER_SIZE);
+            if(MCTP_ParseHeader(header, &recv->frame) < 0 ||
+                    MCTP_RecvFrameSize(&recv->frame) > RECV_BUFFER_SIZE){
+                MCTP_RecvResync(recv);
+                continue;
+            }
+            recv->frameSize = MCTP_RecvFrameSize(&recv->frame);
+        }
+
+        if(recv->index < recv->frameSize){
+            return;
+        }
+
+        /* EOM = 0x24, 0x25, 0x26 ($%&) */
+        uint8_t EOMsection[EOM_SIZE];
+        MCTP_ViewRead(&view, recv->frameSize - EOM_SIZE, EOMsection, EOM_SIZE);
+        if(EOMsection[0] != 0x24 || EOMsection[1] != 0x25 || EOMsection[2] != 0x26){
+            MCTP_RecvResync(recv);
+            continue;
+        }
+        if(!MCTP_RecvCrcValid(&view, &recv->frame)){
+            recv->crcErrors++;
+            MCTP_RecvResync(recv);
+            continue;
+        }
+
+        /* Queue frame for MCTP communication task */
+        MCTP_RecvPush(recv);
+
+        /* Next frame starts right after. Keep bytes left by a resync */
+        recv->head += recv->frameSize;
+        recv->index -= recv->frameSize;
+        recv->frameSize = 0;
+    }
+}
+
+/*
+ * True if <frame> in <view> has no CRC, or if its CRC matches the 
+ * HEADER and DATA sections. Bytes wrapped around the ring end are 
+ * added in a second step.
+ */
+static bool MCTP_RecvCrcValid(const MCTP_View *view, const MCTP_Frame *frame){
+    if(!(frame->flags & HEADER_FLAG_CRC)){
+        return true;
+    }
+
+    uint16_t body_size = HEADER_SIZE + frame->dataSize;
+    uint32_t expected;
+    MCTP_ViewRead(view, body_size, &expected, CRC_SIZE);
+
+    uint16_t pos = view->start & view->mask;
+    uint16_t first = view->mask + 1 - pos;
+    if(first > body_size){
+        first = body_size;
+    }
+    uint32_t crc = MCTP_Crc32Update(MCTP_CRC_INIT, &view->buf[pos], first);
+    crc = MCTP_Crc32Update(crc, view->buf, body_size - first);
+
+    return ~crc == expected;
+}
+
+/*
+ * Discards the first byte of the frame being received, then every
+ * following byte up to the next one that can start a frame.
+ */
+static void MCTP_RecvResync(MCTP_Receiver *recv){
+    uint16_t i = 1;
+    while(i < recv->index){
+        uint8_t byte = recv->buf[(recv->head + i) & RECV_MASK];
+        if(byte != FRAMETYPE_NONE && byte < FRAMETYPE_END){
+            break;
+        }
+        i++;
+    }
+
+    recv->head += i;
+    recv->index -= i;
+    recv->frameSize = 0;
+}
+
+/*
+ * Pushes a descriptor of the complete frame at head to the queue.
+ * Producer side, interrupt context. The frame is dropped if the
+ * queue is full.
+ */
+static void MCTP_RecvPush(MCTP_Receiver *recv){
+    MCTP_RecvQueue *queue = &recv->queue;
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    if(head - tail >= RECV_QUEUE_SIZE){
+        queue->dropped++;
+        return;
+    }
+
+    MCTP_RecvDesc *desc = &queue->slots[head & (RECV_QUEUE_SIZE - 1)];
+    desc->start = recv->head;
+    desc->size = recv->frameSize;
+
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+}
+
+/*
+ * Returns a view of the oldest queued frame. Consumer side, thread
+ * context. The frame stays in the ring until MCTP_RecvRelease.
+ */
+int MCTP_RecvPeek(MCTP_Receiver *recv, MCTP_View *msg){
+    MCTP_RecvQueue *queue = &recv->queue;
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    if(head == tail){
+        return -1;
+    }
+
+    MCTP_RecvDesc *desc = &queue->slots[tail & (RECV_QUEUE_SIZE - 1)];
+    msg->buf = recv->buf;
+    msg->mask = RECV_MASK;
+    msg->start = desc->start;
+    msg->size = desc->size;
+
+    return 0;
+}
+
+/*
+ * Removes the oldest frame from the queue, releasing its ring space.
+ * Consumer side, thread context.
+ */
+void MCTP_RecvRelease(MCTP_Receiver *recv){
+    MCTP_RecvQueue *queue = &recv->queue;
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+}
+
+/*
+ * Extracts frame type, data size, flags and timestamp from header.
+ */
+int MCTP_ParseHeader(const uint8_t *header, MCTP_Frame *frame){
+    int status = 0;
+
+    memset(frame, 0, sizeof(MCTP_Frame));
+    if(header[0] == FRAMETYPE_NONE || header[0] >= FRAMETYPE_END){
+        status = -1;
+        goto exit;
+    }
+
+    frame->type = header[0];
+    memcpy(&frame->dataSize, &header[1], 2);
+    if(header[3] != HEADER_FILLER){
+        frame->flags = header[3];
+    }
+    if(frame->flags & HEADER_FLAG_TIMESTAMP){
+        memcpy(&frame->timestamp, &header[4], 4);
+    }
+
+exit:
+    return status;
+}
+
+uint32_t MCTP_RecvFrameSize(const MCTP_Frame *frame){
+    return HEADER_SIZE + frame->dataSize + ((frame->flags & HEADER_FLAG_CRC)? CRC_SIZE : 0) + EOM_SIZE;
+}
+
+/*
+ * Copies view bytes in at most two chunks, split where the ring
+ * wraps around.
+ */
+int MCTP_ViewRead(const MCTP_View *view, uint16_t offset, void *dst, uint16_t n){
+    if(offset + n > view->size){
+        return -1;
+    }
+
+    uint16_t pos = (view->start + offset) & view->mask;
+    uint16_t first = view->mask + 1 - pos;
+    if(first > n){
+        first = n;
+    }
+    memcpy(dst, &view->buf[pos], first);
+    memcpy((uint8_t*)dst + first, view->buf, n - first);
+
+    return 0;
+}
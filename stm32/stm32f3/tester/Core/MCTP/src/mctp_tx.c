@@ -0,0 +1,1224 @@
+/**
+ * @file mctp_tx.c
+ * @brief MCTP UART DMA transmission.
+ */
+
+/*
+ * DATA frames sent with DMA use two buffers, the halves of the TX 
+ * arena provided by the application. 
+ * A frame is serialized into the buffer not being transmitted, then
+ * either starts transmission at once, or waits for the frame in
+ * flight to complete. Serialization of frame N+1 thus overlaps
+ * transmission of frame N, and the caller never blocks.
+ *
+ * Zero-copy DATA frames are transmitted as a chain of segments, 
+ * where only the header and datainfo are built by MCTP, and channels
+ * dataBuf are sent in place. Each transmit complete interrupt starts
+ * the next segment.
+ *
+ * Control frames (SYNC_RESP, DROP, STOP) are queued apart and have
+ * priority over DATA frames. Whenever a frame (or the last segment of
+ * a chain) completes, the scheduler starts the oldest control frame if
+ * any, and only then the DATA buffer waiting. A control frame thus 
+ * waits at most for the frame in flight, never for queued DATA. 
+ *
+ * When a DATA buffer or a chain is done, the application is notified 
+ * with SIGNAL_TX_CPLT from the transmit complete interrupt.
+ *
+ * In streaming mode, the TX arena is a single ring transmitted over 
+ * and over by circular DMA. Half transfer and transfer complete 
+ * interrupts refill the half just sent with the next bytes of control
+ * and DATA frames, using the chunked serializer, so frames go out back
+ * to back whatever their size. Filler bytes are sent when no frame is
+ * waiting. SIGNAL_TX_CPLT is signaled once a DATA frame is written to
+ * the ring, when channels may be written again. Filler is zero, so
+ * with COBS it only delimits empty frames.
+ *
+ * Frames too big for a DMA buffer (bursts) are sent as fragments of
+ * TX_FRAGMENT_SIZE bytes through the same pair of buffers. Each time a
+ * buffer is done, the transmit complete interrupt serializes the next
+ * fragment into it, so the caller never waits for a burst. Control 
+ * frames are scheduled between fragments, so they never wait for a 
+ * whole burst. Bursts bypass flow control credit and the reliable 
+ * window: they are sent whatever the credit left, and never 
+ * retransmitted.
+ * 
+ * With flow control, each DATA frame takes credit granted by the 
+ * controller. Frames without credit are suppressed before being
+ * serialized, except the newest one with creditKeepLatest. It is
+ * serialized into the free DMA buffer, without being scheduled, and 
+ * replaced by any newer frame, which reuses its SEQUENCE. It is sent 
+ * as soon as credit is granted. A held frame belongs to its session,
+ * and is dropped unsent on SYNC and DROP.
+ *
+ * Byte credit is charged for frames as they go on the wire. With COBS,
+ * the encoded size is only known once the frame is serialized, so the
+ * worst case is taken first, and the rest given back once encoded.
+ *
+ * Serializers only write the current SEQUENCE. It moves on once the
+ * frame is committed to the link: scheduled, started or, for chunked
+ * frames, once their first chunk may be written. A frame that fails to
+ * serialize, or is held, leaves no gap.
+ * 
+ * In reliable mode, every DATA frame sent with DMA is also copied to
+ * a slot of the retransmit ring, kept until the controller 
+ * acknowledges it. Each transmission is numbered in order. Since the
+ * link keeps order, a frame not acknowledged while a frame sent after 
+ * it was, is lost, and is queued for retransmission. Retransmissions
+ * go straight from the ring, after control frames and before new 
+ * DATA frames. Frames never acknowledged are sent again after 
+ * RELIABLE_RTO.
+ * 
+ * A UART error aborts the transfer in flight, and its complete 
+ * interrupt never comes. The error interrupt frees what was in flight,
+ * sending it again where this keeps frames in order, and starts the 
+ * next frame.
+ * 
+ * UART hdmatx must be linked and configured as DMA_NORMAL. Control 
+ * frames are sent in interrupt mode if no hdmatx is linked.
+ */
+
+#include "mctp_tx.h"
+#include "mctp_cobs.h"
+
+extern MCTP_Handle *g_Hmctp;
+
+static void MCTP_TxSchedule(MCTP_Handle *hmctp);
+static bool MCTP_TxIdle(MCTP_Handle *hmctp);
+static void MCTP_TxStart(MCTP_Handle *hmctp, uint8_t index);
+static void MCTP_TxNextSegment(MCTP_Handle *hmctp);
+static void MCTP_TxCtrlDone(MCTP_Handle *hmctp);
+static int MCTP_TxSetDmaMode(MCTP_Handle *hmctp, uint32_t mode);
+static void MCTP_TxStreamFill(MCTP_Handle *hmctp, uint8_t half);
+static void MCTP_TxStreamHalfDone(MCTP_Handle *hmctp, uint8_t half);
+static void MCTP_TxStreamRestart(MCTP_Handle *hmctp);
+static int MCTP_TxBurstFill(MCTP_Handle *hmctp);
+static bool MCTP_TxCreditTake(MCTP_Handle *hmctp, uint32_t size);
+static uint32_t MCTP_TxCreditCost(MCTP_Handle *hmctp);
+static void MCTP_TxCreditRefund(MCTP_Handle *hmctp, uint32_t frames, uint32_t bytes);
+static uint32_t MCTP_TxCreditAdd(uint32_t credit, uint32_t grant);
+static void MCTP_TxCreditRelease(MCTP_Handle *hmctp);
+static bool MCTP_TxReliableFull(MCTP_Handle *hmctp);
+static void MCTP_TxReliableStore(MCTP_Handle *hmctp, const uint8_t *frame, uint16_t size);
+static void MCTP_TxReliableSent(MCTP_Handle *hmctp, const uint8_t *frame);
+static void MCTP_TxRetransmit(MCTP_Handle *hmctp);
+static uint8_t MCTP_TxFrameByte(MCTP_Handle *hmctp, const uint8_t *frame, uint8_t offset);
+
+/*
+ * Resets buffers state.
+ */
+void MCTP_TxInit(MCTP_Handle *hmctp){
+    MCTP_TxPingPong *pp = &hmctp->txPingPong;
+    pp->bufSize = hmctp->txArena? hmctp->txArenaSize / 2 : 0;
+    pp->buf[0] = hmctp->txArena;
+    pp->buf[1] = hmctp->txArena + pp->bufSize;
+    pp->size[0] = 0;
+    pp->size[1] = 0;
+    pp->active = 1;
+    pp->busy = false;
+
+    hmctp->txChain.count = 0;
+    hmctp->txChain.next = 0;
+    hmctp->txChain.busy = false;
+
+    hmctp->txCtrl.head = 0;
+    hmctp->txCtrl.tail = 0;
+    hmctp->txCtrl.busy = false;
+
+    hmctp->txStream.running = false;
+    hmctp->txStream.stopping = false;
+    hmctp->txStream.pending = false;
+    hmctp->txStream.dataBusy = false;
+
+    hmctp->txBurst.busy = false;
+
+    memset(&hmctp->txStats, 0, sizeof(MCTP_TxStats));
+    memset(&hmctp->txCredit, 0, sizeof(MCTP_TxCredit));
+
+    MCTP_TxReliable *rel = &hmctp->txReliable;
+    memset(rel, 0, sizeof(MCTP_TxReliable));
+    rel->slotSize = pp->bufSize;
+    if(hmctp->reliableBuf && pp->bufSize){
+        uint32_t slots = hmctp->reliableBufSize / pp->bufSize;
+        rel->slots = slots < RELIABLE_MAX_WINDOW? slots : RELIABLE_MAX_WINDOW;
+    }
+    hmctp->txSequence = 0;
+    hmctp->txTimestampValid = false;
+}
+
+/*
+ * Serializes control frame in the queue tail. Transmission starts at
+ * once if the UART is idle.
+ */
+int MCTP_TxControl(MCTP_Handle *hmctp, E_MCTP_FrameType frame_type){
+    int status = 0;
+    MCTP_TxCtrlQueue *q = &hmctp->txCtrl;
+
+    /* Only consumer (TX complete interrupt) changes head */
+    uint8_t depth = (uint8_t)(q->tail - q->head);
+    if(depth >= TX_CTRL_QUEUE_SIZE){
+        hmctp->txStats.ctrlDropped++;
+        status = -1;
+        goto exit;
+    }
+
+    uint8_t slot = q->tail & (TX_CTRL_QUEUE_SIZE - 1);
+    uint16_t frame_size = 0;
+    if(MCTP_Serialize(hmctp, frame_type, q->frames[slot], TX_CTRL_FRAME_SIZE, &frame_size) < 0){
+        status = -1;
+        goto exit;
+    }
+    q->size[slot] = frame_size;
+    q->queuedTick[slot] = HAL_GetTick();
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    q->tail++;
+    depth = (uint8_t)(q->tail - q->head);
+    if(depth > hmctp->txStats.ctrlDepthMax){
+        hmctp->txStats.ctrlDepthMax = depth;
+    }
+    MCTP_TxSchedule(hmctp);
+    __set_PRIMASK(primask);
+
+exit:
+    return status;
+}
+
+/*
+ * Copies statistics with interrupts disabled, so all counters are
+ * from the same instant.
+ */
+void MCTP_TxGetStats(MCTP_Handle *hmctp, MCTP_TxStats *stats){
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *stats = hmctp->txStats;
+    __set_PRIMASK(primask);
+}
+
+/*
+ * True if no frame is being transmitted.
+ */
+static bool MCTP_TxIdle(MCTP_Handle *hmctp){
+    return !hmctp->txPingPong.busy && !hmctp->txChain.busy && !hmctp->txCtrl.busy &&
+        !hmctp->txReliable.busy && !hmctp->txStream.running;
+}
+
+/*
+ * Starts the next frame, if UART is idle. Control frames first, then 
+ * DATA frames to retransmit, then the waiting DATA buffer. Must run 
+ * with interrupts disabled or from the transmit complete interrupt.
+ */
+static void MCTP_TxSchedule(MCTP_Handle *hmctp){
+    MCTP_TxCtrlQueue *q = &hmctp->txCtrl;
+    MCTP_TxPingPong *pp = &hmctp->txPingPong;
+
+    while(MCTP_TxIdle(hmctp)){
+        if(q->head != q->tail){
+            uint8_t slot = q->head & (TX_CTRL_QUEUE_SIZE - 1);
+            if(pp->size[pp->active ^ 1] != 0){
+                hmctp->txStats.dataPreempted++;
+            }
+
+            q->busy = true;
+            HAL_StatusTypeDef ret = hmctp->huart->hdmatx?
+                HAL_UART_Transmit_DMA(hmctp->huart, q->frames[slot], q->size[slot]):
+                HAL_UART_Transmit_IT(hmctp->huart, q->frames[slot], q->size[slot]);
+            if(ret != HAL_OK){
+                /* Drop frame and try the next one. SCHEMA is sent again */
+                if(MCTP_TxFrameByte(hmctp, q->frames[slot], 0) == FRAMETYPE_SCHEMA){
+                    hmctp->schemaPending = true;
+                }
+                q->busy = false;
+                q->head++;
+                hmctp->txStats.ctrlDropped++;
+            }
+
+        }else if(hmctp->txReliable.pending){
+            MCTP_TxRetransmit(hmctp);
+
+        }else if(pp->size[pp->active ^ 1] != 0){
+            MCTP_TxStart(hmctp, pp->active ^ 1);
+
+        }else{
+            break;
+        }
+    }
+}
+
+bool MCTP_TxDrained(MCTP_Handle *hmctp){
+    return MCTP_TxIdle(hmctp) && hmctp->txCtrl.head == hmctp->txCtrl.tail &&
+        hmctp->txPingPong.size[hmctp->txPingPong.active ^ 1] == 0 && !hmctp->txBurst.busy;
+}
+
+/*
+ * Uses the buffer that would be next for DMA. Without TX arena, frame
+ * is serialized and sent TX_CHUNK_SIZE bytes at a time from the stack,
+ * so frames of any size need no more RAM. Nothing else may be 
+ * transmitting.
+ */
+int MCTP_TxDataBlocking(MCTP_Handle *hmctp){
+    int status = 0;
+    MCTP_TxPingPong *pp = &hmctp->txPingPong;
+
+    if(!MCTP_TxIdle(hmctp) || hmctp->txReliable.enabled || hmctp->txBurst.busy){
+        status = -1;
+        goto exit;
+    }
+
+    MCTP_TxDropHeld(hmctp);
+    uint32_t cost = MCTP_TxCreditCost(hmctp);
+    if(!MCTP_TxCreditTake(hmctp, cost)){
+        hmctp->txStats.dataSuppressed++;
+        status = -1;
+        goto exit;
+    }
+
+    if(!hmctp->txArena){
+        MCTP_ChunkCursor cursor;
+        uint8_t chunk[TX_CHUNK_SIZE];
+        uint16_t n = 0;
+        uint32_t sent = 0;
+
+        if(MCTP_SerializeChunkStart(hmctp, &cursor) < 0){
+            MCTP_TxCreditRefund(hmctp, 1, cost);
+            status = -1;
+            goto exit;
+        }
+        hmctp->txSequence++;
+        while((status = MCTP_SerializeChunk(hmctp, &cursor, chunk, TX_CHUNK_SIZE, &n)) == 0 && n > 0){
+            if(HAL_UART_Transmit(hmctp->huart, chunk, n, HAL_MAX_DELAY) != HAL_OK){
+                status = -1;
+                break;
+            }
+            sent += n;
+        }
+        MCTP_TxCreditRefund(hmctp, 0, cost - sent);
+        goto exit;
+    }
+
+    uint8_t index = pp->active ^ 1;
+    uint16_t frame_size = 0;
+    if(MCTP_Serialize(hmctp, FRAMETYPE_DATA, pp->buf[index], pp->bufSize, &frame_size) < 0){
+        MCTP_TxCreditRefund(hmctp, 1, cost);
+        status = -1;
+        goto exit;
+    }
+    MCTP_TxCreditRefund(hmctp, 0, cost - frame_size);
+    hmctp->txSequence++;
+    if(HAL_UART_Transmit(hmctp->huart, pp->buf[index], frame_size, HAL_MAX_DELAY) != HAL_OK){
+        status = -1;
+    }
+
+exit:
+    return status;
+}
+
+/*
+ * Serializes DATA frame into the buffer not in flight. Buffer 
+ * selection and start of transmission are done with interrupts
+ * disabled, since the transmit complete interrupt changes them.
+ */
+int MCTP_TxDataDMA(MCTP_Handle *hmctp){
+    int status = 0;
+    MCTP_TxPingPong *pp = &hmctp->txPingPong;
+
+    if(!hmctp->txArena){
+        status = -1;
+        goto exit;
+    }
+
+    if(hmctp->txStream.running){
+        /* Frame is serialized by the ring refill interrupts */
+        MCTP_TxStream *s = &hmctp->txStream;
+        uint32_t cost = MCTP_TxCreditCost(hmctp);
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        if(s->stopping || s->pending || s->dataBusy || hmctp->txReliable.enabled){
+            status = -1;
+        }else if(!MCTP_TxCreditTake(hmctp, cost)){
+            hmctp->txStats.dataSuppressed++;
+            status = -1;
+        }else{
+            s->dataCharged = cost;
+            s->pending = true;
+        }
+        __set_PRIMASK(primask);
+        goto exit;
+    }
+
+    if(!hmctp->huart->hdmatx || hmctp->huart->hdmatx->Init.Mode == DMA_CIRCULAR){
+        status = -1;
+        goto exit;
+    }
+
+    uint8_t index = pp->active ^ 1;
+    if(pp->size[index] != 0 || hmctp->txBurst.busy){
+        /* One frame in flight and one waiting, or buffers taken by burst */
+        status = -1;
+        goto exit;
+    }
+    if(MCTP_TxReliableFull(hmctp)){
+        /* Window of frames not acknowledged is full */
+        status = -1;
+        goto exit;
+    }
+
+    MCTP_TxDropHeld(hmctp);
+    uint32_t cost = MCTP_TxCreditCost(hmctp);
+    bool credit = MCTP_TxCreditTake(hmctp, cost);
+    if(!credit && !hmctp->creditKeepLatest){
+        hmctp->txStats.dataSuppressed++;
+        status = -1;
+        goto exit;
+    }
+
+    uint16_t frame_size = 0;
+    if(MCTP_Serialize(hmctp, FRAMETYPE_DATA, pp->buf[index], pp->bufSize, &frame_size) < 0){
+        if(credit){
+            MCTP_TxCreditRefund(hmctp, 1, cost);
+        }
+        status = -1;
+        goto exit;
+    }
+    if(!credit){
+        /* Hold frame until credit is granted. Charged as encoded */
+        hmctp->txCredit.held = frame_size;
+        goto exit;
+    }
+    MCTP_TxCreditRefund(hmctp, 0, cost - frame_size);
+    hmctp->txSequence++;
+    MCTP_TxReliableStore(hmctp, pp->buf[index], frame_size);
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    pp->size[index] = frame_size;
+    MCTP_TxSchedule(hmctp);
+    __set_PRIMASK(primask);
+
+exit:
+    return status;
+}
+
+/*
+ * Both ring halves are filled before circular DMA starts. DMA length
+ * is 16 bits, so the whole arena must be below 64 KB.
+ */
+int MCTP_TxStreamStart(MCTP_Handle *hmctp){
+    int status = 0;
+    MCTP_TxStream *s = &hmctp->txStream;
+    MCTP_TxPingPong *pp = &hmctp->txPingPong;
+
+    if(!hmctp->txArena || !hmctp->huart->hdmatx || 2 * pp->bufSize > 0xFFFF){
+        status = -1;
+        goto exit;
+    }
+    if(!MCTP_TxIdle(hmctp) || pp->size[pp->active ^ 1] != 0 || hmctp->txBurst.busy){
+        status = -1;
+        goto exit;
+    }
+    if(MCTP_TxSetDmaMode(hmctp, DMA_CIRCULAR) < 0){
+        status = -1;
+        goto exit;
+    }
+
+    MCTP_TxDropHeld(hmctp);
+    s->stopping = false;
+    s->pending = false;
+    s->dataBusy = false;
+    s->ctrlOffset = 0;
+    MCTP_TxStreamFill(hmctp, 0);
+    MCTP_TxStreamFill(hmctp, 1);
+
+    s->running = true;
+    if(HAL_UART_Transmit_DMA(hmctp->huart, pp->buf[0], 2 * pp->bufSize) != HAL_OK){
+        s->running = false;
+        MCTP_TxSetDmaMode(hmctp, DMA_NORMAL);
+        status = -1;
+    }
+
+exit:
+    return status;
+}
+
+/*
+ * Circular DMA is stopped by the half transfer interrupts, once all
+ * frame bytes in the ring were sent.
+ */
+int MCTP_TxStreamStop(MCTP_Handle *hmctp){
+    int status = 0;
+
+    if(!hmctp->txStream.running){
+        status = -1;
+        goto exit;
+    }
+    hmctp->txStream.stopping = true;
+
+exit:
+    return status;
+}
+
+/*
+ * Reconfigures UART TX DMA channel to <mode>, DMA_NORMAL or 
+ * DMA_CIRCULAR.
+ */
+static int MCTP_TxSetDmaMode(MCTP_Handle *hmctp, uint32_t mode){
+    int status = 0;
+    DMA_HandleTypeDef *hdmatx = hmctp->huart->hdmatx;
+
+    if(hdmatx->Init.Mode == mode){
+        goto exit;
+    }
+    hdmatx->Init.Mode = mode;
+    HAL_DMA_DeInit(hdmatx);
+    if(HAL_DMA_Init(hdmatx) != HAL_OK){
+        status = -1;
+    }
+
+exit:
+    return status;
+}
+
+/*
+ * Writes the next frame bytes to ring <half>. The control frame or 
+ * DATA frame in progress is continued first. At a frame boundary, 
+ * waiting control frames go before the DATA frame requested. The rest
+ * is filler.
+ */
+static void MCTP_TxStreamFill(MCTP_Handle *hmctp, uint8_t half){
+    MCTP_TxStream *s = &hmctp->txStream;
+    MCTP_TxCtrlQueue *q = &hmctp->txCtrl;
+    uint8_t *dst = hmctp->txPingPong.buf[half];
+    uint32_t size = hmctp->txPingPong.bufSize;
+    uint32_t written = 0;
+
+    s->halfData[half] = false;
+    while(written < size){
+        if(q->busy){
+            uint8_t slot = q->head & (TX_CTRL_QUEUE_SIZE - 1);
+            uint32_t n = q->size[slot] - s->ctrlOffset;
+            if(n > size - written){
+                n = size - written;
+            }
+            memcpy(dst + written, q->frames[slot] + s->ctrlOffset, n);
+            written += n;
+            s->ctrlOffset += n;
+            if(s->ctrlOffset == q->size[slot]){
+                s->ctrlOffset = 0;
+                MCTP_TxCtrlDone(hmctp);
+            }
+
+        }else if(s->dataBusy){
+            uint16_t n = 0;
+            uint32_t room = size - written;
+            if(MCTP_SerializeChunk(hmctp, &s->cursor, dst + written, 
+                        room > 0xFFFF? 0xFFFF : room, &n) < 0){
+                s->dataBusy = false;
+                MCTP_TxCreditRefund(hmctp, 0, s->dataCharged - s->dataWritten);
+                continue;
+            }
+            written += n;
+            s->dataWritten += n;
+            if(s->cursor.part == CHUNK_DONE){
+                s->dataBusy = false;
+                MCTP_TxCreditRefund(hmctp, 0, s->dataCharged - s->dataWritten);
+                hmctp->txStats.dataSent++;
+                hmctp->SignalCallback(SIGNAL_TX_CPLT);
+            }
+
+        }else if(q->head != q->tail){
+            if(s->pending){
+                hmctp->txStats.dataPreempted++;
+            }
+            q->busy = true;
+            continue;
+
+        }else if(s->pending){
+            s->pending = false;
+            if(MCTP_SerializeChunkStart(hmctp, &s->cursor) == 0){
+                hmctp->txSequence++;
+                s->dataBusy = true;
+                s->dataWritten = 0;
+            }else{
+                MCTP_TxCreditRefund(hmctp, 1, s->dataCharged);
+            }
+            continue;
+
+        }else{
+            memset(dst + written, FRAMETYPE_NONE, size - written);
+            break;
+        }
+        s->halfData[half] = true;
+    }
+}
+
+/*
+ * Ring <half> was just sent, and DMA moved to the other half. If that
+ * one holds only filler and nothing is waiting, every frame is on the
+ * wire and a requested stop can take place. Otherwise <half> is 
+ * refilled.
+ */
+static void MCTP_TxStreamHalfDone(MCTP_Handle *hmctp, uint8_t half){
+    MCTP_TxStream *s = &hmctp->txStream;
+    MCTP_TxCtrlQueue *q = &hmctp->txCtrl;
+
+    if(s->stopping && !s->halfData[half ^ 1] && !q->busy && !s->dataBusy &&
+            !s->pending && q->head == q->tail){
+        HAL_UART_AbortTransmit(hmctp->huart);
+        MCTP_TxSetDmaMode(hmctp, DMA_NORMAL);
+        s->running = false;
+        s->stopping = false;
+        return;
+    }
+
+    MCTP_TxStreamFill(hmctp, half);
+}
+
+/*
+ * Circular DMA was aborted. The control frame being written to the 
+ * ring is written again from its start, the DATA frame is dropped, 
+ * and DMA starts over from a refilled ring. Streaming stops if it 
+ * can't.
+ */
+static void MCTP_TxStreamRestart(MCTP_Handle *hmctp){
+    MCTP_TxStream *s = &hmctp->txStream;
+    MCTP_TxPingPong *pp = &hmctp->txPingPong;
+
+    hmctp->txCtrl.busy = false;
+    s->ctrlOffset = 0;
+    if(s->dataBusy){
+        s->dataBusy = false;
+        MCTP_TxCreditRefund(hmctp, 0, s->dataCharged - s->dataWritten);
+        hmctp->SignalCallback(SIGNAL_TX_CPLT);
+    }
+
+    MCTP_TxStreamFill(hmctp, 0);
+    MCTP_TxStreamFill(hmctp, 1);
+    if(HAL_UART_Transmit_DMA(hmctp->huart, pp->buf[0], 2 * pp->bufSize) != HAL_OK){
+        s->running = false;
+        s->stopping = false;
+        MCTP_TxSetDmaMode(hmctp, DMA_NORMAL);
+    }
+}
+
+/*
+ * First fragments are serialized here, the rest from the transmit 
+ * complete interrupt, so the caller returns at once and MCTP_Poll 
+ * keeps handling received frames during the burst.
+ */
+int MCTP_TxFragments(MCTP_Handle *hmctp, const MCTP_FragCursor *cursor){
+    int status = 0;
+    MCTP_TxBurst *b = &hmctp->txBurst;
+
+    if(!hmctp->txArena || hmctp->txStream.running || hmctp->txChain.busy || b->busy){
+        status = -1;
+        goto exit;
+    }
+    if(!hmctp->huart->hdmatx || hmctp->huart->hdmatx->Init.Mode == DMA_CIRCULAR){
+        status = -1;
+        goto exit;
+    }
+
+    /* Fragments reuse the buffer of a held DATA frame */
+    MCTP_TxDropHeld(hmctp);
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    b->cursor = *cursor;
+    b->busy = true;
+    status = MCTP_TxBurstFill(hmctp);
+    __set_PRIMASK(primask);
+
+exit:
+    return status;
+}
+
+bool MCTP_TxBurstBusy(MCTP_Handle *hmctp){
+    return hmctp->txBurst.busy;
+}
+
+void MCTP_TxBurstAbort(MCTP_Handle *hmctp){
+    hmctp->txBurst.busy = false;
+}
+
+/*
+ * Serializes fragments into the buffer not in flight while it is free,
+ * so fragment N+1 is ready when fragment N completes. A fragment that
+ * fails to serialize ends the burst. Must run with interrupts disabled
+ * or from the transmit complete interrupt.
+ */
+static int MCTP_TxBurstFill(MCTP_Handle *hmctp){
+    int status = 0;
+    MCTP_TxBurst *b = &hmctp->txBurst;
+    MCTP_TxPingPong *pp = &hmctp->txPingPong;
+
+    while(b->busy && pp->size[pp->active ^ 1] == 0){
+        uint8_t index = pp->active ^ 1;
+        uint16_t frame_size = 0;
+        if(MCTP_SerializeFragment(hmctp, &b->cursor, pp->buf[index], pp->bufSize, &frame_size) < 0){
+            b->busy = false;
+            status = -1;
+            break;
+        }
+        if(frame_size == 0){
+            /* Last fragment is queued */
+            b->busy = false;
+            break;
+        }
+        pp->size[index] = frame_size;
+        MCTP_TxSchedule(hmctp);
+    }
+
+    return status;
+}
+
+/*
+ * REQUEST starts a transfer, so credit left from the last one is 
+ * replaced.
+ */
+void MCTP_TxCreditSet(MCTP_Handle *hmctp, bool enabled, uint16_t frames, uint32_t bytes){
+    MCTP_TxCredit *c = &hmctp->txCredit;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    c->enabled = enabled;
+    c->frames = frames == CREDIT_FRAMES_UNLIMITED? UINT32_MAX : frames;
+    c->bytes = bytes == CREDIT_BYTES_UNLIMITED? UINT32_MAX : bytes;
+    __set_PRIMASK(primask);
+
+    MCTP_TxCreditRelease(hmctp);
+}
+
+void MCTP_TxCreditGrant(MCTP_Handle *hmctp, uint16_t frames, uint32_t bytes){
+    MCTP_TxCredit *c = &hmctp->txCredit;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    c->frames = MCTP_TxCreditAdd(c->frames, frames == CREDIT_FRAMES_UNLIMITED? UINT32_MAX : frames);
+    c->bytes = MCTP_TxCreditAdd(c->bytes, bytes);
+    __set_PRIMASK(primask);
+
+    MCTP_TxCreditRelease(hmctp);
+}
+
+/*
+ * Saturates one below UINT32_MAX, which stands for unlimited.
+ */
+static uint32_t MCTP_TxCreditAdd(uint32_t credit, uint32_t grant){
+    if(credit == UINT32_MAX || grant == UINT32_MAX){
+        return UINT32_MAX;
+    }
+    return UINT32_MAX - 1 - credit < grant? UINT32_MAX - 1 : credit + grant;
+}
+
+/*
+ * Takes credit for a DATA frame of <size> bytes. Returns false if 
+ * there is not enough.
+ */
+static bool MCTP_TxCreditTake(MCTP_Handle *hmctp, uint32_t size){
+    MCTP_TxCredit *c = &hmctp->txCredit;
+    bool ok = true;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if(c->enabled){
+        ok = c->frames > 0 && c->bytes >= size;
+        if(ok && c->frames != UINT32_MAX){
+            c->frames--;
+        }
+        if(ok && c->bytes != UINT32_MAX){
+            c->bytes -= size;
+        }
+    }
+    __set_PRIMASK(primask);
+
+    return ok;
+}
+
+/*
+ * Credit bytes taken by the DATA frame to serialize: its size on the
+ * wire, or the worst case with COBS until it is encoded.
+ */
+static uint32_t MCTP_TxCreditCost(MCTP_Handle *hmctp){
+    uint32_t size = MCTP_DataFrameSize(hmctp);
+    return hmctp->cobsEnabled? COBS_MAX_SIZE(size) : size;
+}
+
+/*
+ * Gives back <frames> and <bytes> of credit taken and not used.
+ */
+static void MCTP_TxCreditRefund(MCTP_Handle *hmctp, uint32_t frames, uint32_t bytes){
+    MCTP_TxCredit *c = &hmctp->txCredit;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if(c->enabled){
+        c->frames = MCTP_TxCreditAdd(c->frames, frames);
+        c->bytes = MCTP_TxCreditAdd(c->bytes, bytes);
+    }
+    __set_PRIMASK(primask);
+}
+
+/*
+ * Schedules the held frame if credit allows. Buffer holding it is 
+ * never the active one, since it was never started.
+ */
+static void MCTP_TxCreditRelease(MCTP_Handle *hmctp){
+    MCTP_TxCredit *c = &hmctp->txCredit;
+    MCTP_TxPingPong *pp = &hmctp->txPingPong;
+
+    if(!c->held || MCTP_TxReliableFull(hmctp) || !MCTP_TxCreditTake(hmctp, c->held)){
+        return;
+    }
+
+    hmctp->txSequence++;
+    MCTP_TxReliableStore(hmctp, pp->buf[pp->active ^ 1], c->held);
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    pp->size[pp->active ^ 1] = c->held;
+    c->held = 0;
+    MCTP_TxSchedule(hmctp);
+    __set_PRIMASK(primask);
+}
+
+/*
+ * Its SEQUENCE was never taken, so it goes to the next DATA frame.
+ */
+void MCTP_TxDropHeld(MCTP_Handle *hmctp){
+    if(hmctp->txCredit.held){
+        hmctp->txCredit.held = 0;
+        hmctp->txStats.dataSuppressed++;
+    }
+}
+
+/*
+ * Frames left in window from the last transfer are discarded. A
+ * retransmission in flight completes, and its slot is not reused 
+ * until then.
+ */
+int MCTP_TxReliableStart(MCTP_Handle *hmctp, uint8_t window){
+    int status = 0;
+    MCTP_TxReliable *rel = &hmctp->txReliable;
+
+    if(window > RELIABLE_MAX_WINDOW || (window && (!rel->slots || !hmctp->huart->hdmatx || !hmctp->crcEnabled))){
+        window = 0;
+        status = -1;
+    }
+
+    MCTP_TxDropHeld(hmctp);
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    rel->enabled = window != 0;
+    rel->window = window < rel->slots? window : rel->slots;
+    rel->base = 0;
+    rel->count = 0;
+    rel->sent = 0;
+    rel->acked = 0;
+    rel->pending = 0;
+    if(rel->enabled){
+        hmctp->txSequence = 0;
+    }
+    __set_PRIMASK(primask);
+
+    return status;
+}
+
+/*
+ * Frees frames acknowledged up to <next>, then marks as lost every 
+ * frame sent before the latest one acknowledged. Stale 
+ * acknowledgements, behind window, are ignored.
+ */
+void MCTP_TxReliableAck(MCTP_Handle *hmctp, uint8_t next, uint32_t sack){
+    MCTP_TxReliable *rel = &hmctp->txReliable;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint8_t acked = next - rel->base;
+    if(rel->enabled && acked <= rel->count){
+        uint32_t latest = 0;
+        bool any = false;
+
+        /* Cumulative */
+        for(int k = 0; k < acked; k++){
+            uint32_t bit = 1UL << rel->baseSlot;
+            if(rel->sent & bit){
+                latest = !any || (int32_t)(rel->order[rel->baseSlot] - latest) > 0? rel->order[rel->baseSlot] : latest;
+                any = true;
+            }
+            rel->sent &= ~bit;
+            rel->acked &= ~bit;
+            rel->pending &= ~bit;
+            rel->baseSlot = (rel->baseSlot + 1) % rel->slots;
+        }
+        rel->base = next;
+        rel->count -= acked;
+
+        /* Selective. Bit i is frame at offset i + 1 */
+        for(int i = 0; i + 1 < rel->count && i < 32; i++){
+            uint8_t slot = (rel->baseSlot + i + 1) % rel->slots;
+            uint32_t bit = 1UL << slot;
+            if(((sack >> i) & 1) && (rel->sent & bit)){
+                latest = !any || (int32_t)(rel->order[slot] - latest) > 0? rel->order[slot] : latest;
+                any = true;
+                rel->acked |= bit;
+                rel->pending &= ~bit;
+            }
+        }
+
+        /* Lost */
+        for(int k = 0; any && k < rel->count; k++){
+            uint8_t slot = (rel->baseSlot + k) % rel->slots;
+            uint32_t bit = 1UL << slot;
+            if((rel->sent & bit) && !(rel->acked & bit) && (int32_t)(rel->order[slot] - latest) < 0 &&
+                    !(rel->busy && rel->busySlot == slot)){
+                rel->pending |= bit;
+            }
+        }
+        MCTP_TxSchedule(hmctp);
+    }
+
+    __set_PRIMASK(primask);
+}
+
+/*
+ * Covers the last frames of a burst, with no later frame to reveal 
+ * their loss, and lost retransmissions.
+ */
+void MCTP_TxReliableTick(MCTP_Handle *hmctp){
+    MCTP_TxReliable *rel = &hmctp->txReliable;
+
+    if(!rel->enabled){
+        return;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t now = HAL_GetTick();
+    for(int k = 0; k < rel->count; k++){
+        uint8_t slot = (rel->baseSlot + k) % rel->slots;
+        uint32_t bit = 1UL << slot;
+        if((rel->sent & bit) && !(rel->acked & bit) && now - rel->sentTick[slot] > RELIABLE_RTO &&
+                !(rel->busy && rel->busySlot == slot)){
+            rel->pending |= bit;
+        }
+    }
+    MCTP_TxSchedule(hmctp);
+    __set_PRIMASK(primask);
+}
+
+/*
+ * The next slot may still be read by a retransmission of the frame it
+ * held.
+ */
+static bool MCTP_TxReliableFull(MCTP_Handle *hmctp){
+    MCTP_TxReliable *rel = &hmctp->txReliable;
+
+    if(!rel->enabled){
+        return false;
+    }
+    uint8_t slot = (rel->baseSlot + rel->count) % rel->slots;
+    return rel->count >= rel->window || (rel->busy && rel->busySlot == slot);
+}
+
+/*
+ * Copies the next DATA frame, of SEQUENCE base + count, to its slot.
+ * Caller checked window is not full.
+ */
+static void MCTP_TxReliableStore(MCTP_Handle *hmctp, const uint8_t *frame, uint16_t size){
+    MCTP_TxReliable *rel = &hmctp->txReliable;
+
+    if(!rel->enabled){
+        return;
+    }
+
+    uint8_t slot = (rel->baseSlot + rel->count) % rel->slots;
+    uint32_t bit = 1UL << slot;
+    memcpy(hmctp->reliableBuf + slot * rel->slotSize, frame, size);
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    rel->size[slot] = size;
+    rel->sent &= ~bit;
+    rel->acked &= ~bit;
+    rel->pending &= ~bit;
+    rel->count++;
+    __set_PRIMASK(primask);
+}
+
+/*
+ * Numbers transmission of DATA <frame> starting now, if it is in 
+ * window.
+ */
+static void MCTP_TxReliableSent(MCTP_Handle *hmctp, const uint8_t *frame){
+    MCTP_TxReliable *rel = &hmctp->txReliable;
+
+    if(!rel->enabled || MCTP_TxFrameByte(hmctp, frame, 0) != FRAMETYPE_DATA){
+        return;
+    }
+
+    uint8_t offset = MCTP_TxFrameByte(hmctp, frame, HEADER_SIZE) - rel->base;
+    if(offset < rel->count){
+        uint8_t slot = (rel->baseSlot + offset) % rel->slots;
+        rel->order[slot] = rel->nextOrder++;
+        rel->sentTick[slot] = HAL_GetTick();
+        rel->sent |= 1UL << slot;
+    }
+}
+
+/*
+ * Byte <offset> of serialized <frame>, as before COBS encoding.
+ */
+static uint8_t MCTP_TxFrameByte(MCTP_Handle *hmctp, const uint8_t *frame, uint8_t offset){
+    return hmctp->cobsEnabled? MCTP_CobsPeek(frame, offset) : frame[offset];
+}
+
+/*
+ * Starts DMA transmission of the oldest frame waiting for 
+ * retransmission. On error, frame waits for RELIABLE_RTO.
+ */
+static void MCTP_TxRetransmit(MCTP_Handle *hmctp){
+    MCTP_TxReliable *rel = &hmctp->txReliable;
+
+    for(int k = 0; k < rel->count; k++){
+        uint8_t slot = (rel->baseSlot + k) % rel->slots;
+        uint32_t bit = 1UL << slot;
+        if(!(rel->pending & bit)){
+            continue;
+        }
+
+        rel->pending &= ~bit;
+        rel->order[slot] = rel->nextOrder++;
+        rel->sentTick[slot] = HAL_GetTick();
+        rel->busy = true;
+        rel->busySlot = slot;
+        if(HAL_UART_Transmit_DMA(hmctp->huart, hmctp->reliableBuf + slot * rel->slotSize, rel->size[slot]) != HAL_OK){
+            rel->busy = false;
+        }
+        return;
+    }
+
+    /* Only slots in window may be pending */
+    rel->pending = 0;
+}
+
+/*
+ * Segments are built in handle storage, so only one chain may be in
+ * flight. Nothing else may be transmitting when it starts. Channels 
+ * dataBuf is sent as is, so frames can't be COBS encoded.
+ */
+int MCTP_TxDataSegments(MCTP_Handle *hmctp){
+    int status = 0;
+    MCTP_TxChain *chain = &hmctp->txChain;
+
+    if(!hmctp->huart->hdmatx || hmctp->huart->hdmatx->Init.Mode == DMA_CIRCULAR){
+        status = -1;
+        goto exit;
+    }
+    if(!MCTP_TxIdle(hmctp) || hmctp->txReliable.enabled || hmctp->cobsEnabled || hmctp->txBurst.busy){
+        status = -1;
+        goto exit;
+    }
+
+    MCTP_TxDropHeld(hmctp);
+    uint32_t cost = MCTP_TxCreditCost(hmctp);
+    if(!MCTP_TxCreditTake(hmctp, cost)){
+        hmctp->txStats.dataSuppressed++;
+        status = -1;
+        goto exit;
+    }
+
+    if(MCTP_SerializeSegments(hmctp, chain->meta, sizeof(chain->meta), 
+                chain->segs, 2 * MAX_CHANNELS + 2, &chain->count) < 0){
+        MCTP_TxCreditRefund(hmctp, 1, cost);
+        status = -1;
+        goto exit;
+    }
+
+    chain->next = 0;
+    chain->busy = true;
+    MCTP_TxNextSegment(hmctp);
+    if(chain->next == 1 && !chain->busy){
+        /* First segment didn't start. Nothing was sent */
+        MCTP_TxCreditRefund(hmctp, 1, cost);
+        status = -1;
+        goto exit;
+    }
+    hmctp->txSequence++;
+
+exit:
+    return status;
+}
+
+/*
+ * Starts DMA transmission of the next segment in chain. Returns 
+ * chain to idle when all segments are sent, or on error.
+ */
+static void MCTP_TxNextSegment(MCTP_Handle *hmctp){
+    MCTP_TxChain *chain = &hmctp->txChain;
+
+    if(chain->next >= chain->count){
+        chain->busy = false;
+        return;
+    }
+
+    MCTP_TxSegment *seg = &chain->segs[chain->next++];
+    if(HAL_UART_Transmit_DMA(hmctp->huart, seg->ptr, seg->size) != HAL_OK){
+        /* Drop rest of frame */
+        chain->busy = false;
+    }
+}
+
+/*
+ * Starts DMA transmission of buffer <index>.
+ */
+static void MCTP_TxStart(MCTP_Handle *hmctp, uint8_t index){
+    MCTP_TxPingPong *pp = &hmctp->txPingPong;
+
+    pp->active = index;
+    pp->busy = true;
+    MCTP_TxReliableSent(hmctp, pp->buf[index]);
+    if(HAL_UART_Transmit_DMA(hmctp->huart, pp->buf[index], pp->size[index]) != HAL_OK){
+        /* Drop frame. UART is in use by another transfer */
+        pp->size[index] = 0;
+        pp->busy = false;
+    }
+}
+
+/*
+ * Frees head of control queue and updates its statistics. A SCHEMA
+ * frame marks its version as announced once it is fully transmitted.
+ */
+static void MCTP_TxCtrlDone(MCTP_Handle *hmctp){
+    MCTP_TxCtrlQueue *q = &hmctp->txCtrl;
+    MCTP_TxStats *stats = &hmctp->txStats;
+    uint8_t slot = q->head & (TX_CTRL_QUEUE_SIZE - 1);
+
+    if(MCTP_TxFrameByte(hmctp, q->frames[slot], 0) == FRAMETYPE_SCHEMA){
+        /* Controller knows the channel list version it carries */
+        hmctp->schemaAnnounced = MCTP_TxFrameByte(hmctp, q->frames[slot], HEADER_SIZE);
+        hmctp->schemaValid = true;
+    }
+
+    uint32_t latency = HAL_GetTick() - q->queuedTick[slot];
+    stats->ctrlSent++;
+    stats->ctrlLatencySum += latency;
+    if(latency > stats->ctrlLatencyMax){
+        stats->ctrlLatencyMax = latency;
+    }
+
+    q->head++;
+    q->busy = false;
+}
+
+/*
+ * Bytes of the frame in flight already left, and the controller 
+ * resyncs on the next header. A control frame or retransmission is 
+ * sent again whole. A DATA buffer is too, if the other buffer is free,
+ * taking the place of a held frame. Otherwise it is dropped, as 
+ * sending it after the waiting one would reorder them: in reliable
+ * mode, it is then retransmitted as lost. A burst losing a fragment is
+ * stopped, since the controller drops the whole block anyway. A chain
+ * is dropped, its channels dataBuf being released.
+ */
+void MCTP_TxAbort(MCTP_Handle *hmctp){
+    MCTP_TxPingPong *pp = &hmctp->txPingPong;
+    MCTP_TxChain *chain = &hmctp->txChain;
+    MCTP_TxReliable *rel = &hmctp->txReliable;
+
+    if(hmctp->txStream.running){
+        MCTP_TxStreamRestart(hmctp);
+
+    }else if(chain->busy){
+        chain->busy = false;
+        hmctp->SignalCallback(SIGNAL_TX_CPLT);
+
+    }else if(hmctp->txCtrl.busy){
+        hmctp->txCtrl.busy = false;
+
+    }else if(rel->busy){
+        rel->busy = false;
+        rel->pending |= 1UL << rel->busySlot;
+
+    }else if(pp->busy){
+        pp->busy = false;
+        if(pp->size[pp->active ^ 1] == 0){
+            MCTP_TxDropHeld(hmctp);
+            pp->active ^= 1;
+        }else{
+            pp->size[pp->active] = 0;
+            if(hmctp->txBurst.busy){
+                pp->size[pp->active ^ 1] = 0;
+                hmctp->txBurst.busy = false;
+            }
+            hmctp->SignalCallback(SIGNAL_TX_CPLT);
+        }
+
+    }else{
+        /* Nothing was in flight */
+        return;
+    }
+
+    hmctp->txStats.aborted++;
+    MCTP_TxSchedule(hmctp);
+    MCTP_TxBurstFill(hmctp);
+}
+
+/**
+ * @brief Callback for TX complete.
+ * @note Starts next segment of a chain. Otherwise frees the control 
+ *       frame or buffer just sent, then starts the next frame, if any.
+ */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart){
+    if(huart != g_Hmctp->huart){
+        return;
+    }
+
+    if(g_Hmctp->txStream.running){
+        /* Circular DMA is back at the start of ring */
+        MCTP_TxStreamHalfDone(g_Hmctp, 1);
+        return;
+    }
+
+    MCTP_TxChain *chain = &g_Hmctp->txChain;
+    MCTP_TxPingPong *pp = &g_Hmctp->txPingPong;
+    if(chain->busy){
+        MCTP_TxNextSegment(g_Hmctp);
+        if(chain->busy){
+            return;
+        }
+        g_Hmctp->txStats.dataSent++;
+        g_Hmctp->SignalCallback(SIGNAL_TX_CPLT);
+
+    }else if(g_Hmctp->txCtrl.busy){
+        MCTP_TxCtrlDone(g_Hmctp);
+
+    }else if(g_Hmctp->txReliable.busy){
+        g_Hmctp->txReliable.busy = false;
+        g_Hmctp->txStats.dataRetransmitted++;
+
+    }else if(pp->busy){
+        pp->size[pp->active] = 0;
+        pp->busy = false;
+        g_Hmctp->txStats.dataSent++;
+        g_Hmctp->SignalCallback(SIGNAL_TX_CPLT);
+
+    }else{
+        /* Not a scheduled transfer */
+        return;
+    }
+
+    MCTP_TxSchedule(g_Hmctp);
+    MCTP_TxBurstFill(g_Hmctp);
+}
+
+/**
+ * @brief Callback for TX half complete. 
+ * @note Only used in streaming mode, to refill first half of ring.
+ */
+void HAL_UART_TxHalfCpltCallback(UART_HandleTypeDef *huart){
+    if(huart != g_Hmctp->huart || !g_Hmctp->txStream.running){
+        return;
+    }
+
+    MCTP_TxStreamHalfDone(g_Hmctp, 0);
+}
@@ -7,12 +7,12 @@ static float wav3_samples[100] = {0};
 static float wav4_samples[100] = {0};
 static float wav5_samples[100] = {0};
 
-float ch0_buf[30] = {0};
+uint8_t ch0_buf[XOR_MAX_SIZE(30)] = {0};
 float ch1_buf[30] = {0};
 float ch2_buf[30] = {0};
 float ch3_buf[30] = {0};
-float ch4_buf[30] = {0};
-float ch5_buf[30] = {0};
+int16_t ch4_buf[30] = {0};
+uint16_t ch5_buf[30] = {0};
 char ch6_buf[30] = {0};
 char ch7_buf[30] = {0};
 
@@ -24,7 +24,8 @@ char d2_str[20] = {0};
 bool sending = false;
 
 /*
- * NOTE: This function blocks MCTP communication task
+ * NOTE: This function blocks MCTP communication task. 
+ * Called from MCTP_Poll.
  */
 void mctp_sig_callback(E_MCTP_Signal sig){
     switch(sig){
@@ -41,12 +42,13 @@ void mctp_sig_callback(E_MCTP_Signal sig){
 
 void ADCdata_initChannels(MCTP_Handle *hmctp){
     /* Add Channels */
-    MCTP_EnableChannel(hmctp, 0, (uint8_t*)ch0_buf, 30*sizeof(float), DATATYPE_FLOAT32);
+    MCTP_EnableChannel(hmctp, 0, ch0_buf, sizeof(ch0_buf), DATATYPE_FLOAT32_XOR);
     MCTP_EnableChannel(hmctp, 1, (uint8_t*)ch1_buf, 30*sizeof(float), DATATYPE_FLOAT32);
     MCTP_EnableChannel(hmctp, 2, (uint8_t*)ch2_buf, 30*sizeof(float), DATATYPE_FLOAT32);
     MCTP_EnableChannel(hmctp, 3, (uint8_t*)ch3_buf, 30*sizeof(float), DATATYPE_FLOAT32);
-    MCTP_EnableChannel(hmctp, 4, (uint8_t*)ch4_buf, 30*sizeof(float), DATATYPE_FLOAT32);
-    MCTP_EnableChannel(hmctp, 5, (uint8_t*)ch5_buf, 30*sizeof(float), DATATYPE_FLOAT32);
+    MCTP_EnableChannel(hmctp, 4, (uint8_t*)ch4_buf, 30*sizeof(int16_t), DATATYPE_Q15);
+    MCTP_SetChannelScale(hmctp, 4, 5.5f, 0.0f);     /* Amplitude 5, and headroom */
+    MCTP_EnableChannel(hmctp, 5, (uint8_t*)ch5_buf, 30*sizeof(uint16_t), DATATYPE_FLOAT16);
     MCTP_EnableChannel(hmctp, 6, (uint8_t*)ch6_buf, 30*sizeof(char), DATATYPE_CHAR);
     MCTP_EnableChannel(hmctp, 7, (uint8_t*)ch7_buf, 30*sizeof(char), DATATYPE_CHAR);
 }
@@ -78,15 +80,18 @@ void ADCdata_test_send(MCTP_Handle *hmctp){
     //    }
     int frames_counter = 0;
     while(sending){
+        /* Samples are taken now. Only ms resolution in this simulation */
+        MCTP_SetTimestamp(hmctp, HAL_GetTick() * 1000);
+
         /* Append Data to channel */
         MCTP_ClearChannelData(hmctp, 6);
         MCTP_ClearChannelData(hmctp, 7);
-        MCTP_WriteChannelData(hmctp, 0, (uint8_t*)wav0_samples, 30*sizeof(float));
+        MCTP_WriteChannelXor(hmctp, 0, wav0_samples, 30);
         MCTP_WriteChannelData(hmctp, 1, (uint8_t*)wav1_samples, 30*sizeof(float));
         MCTP_WriteChannelData(hmctp, 2, (uint8_t*)wav2_samples, 30*sizeof(float));
         MCTP_WriteChannelData(hmctp, 3, (uint8_t*)wav3_samples, 30*sizeof(float));
-        MCTP_WriteChannelData(hmctp, 4, (uint8_t*)wav4_samples, 30*sizeof(float));
-        MCTP_WriteChannelData(hmctp, 5, (uint8_t*)wav5_samples, 30*sizeof(float));
+        MCTP_WriteChannelFixed(hmctp, 4, wav4_samples, 30);
+        MCTP_WriteChannelFloat16(hmctp, 5, wav5_samples, 30);
         if(frames_counter != 0 && frames_counter % 10 == 0){
             char *text_msg = "10 frames sent";
             MCTP_WriteChannelData(hmctp, 6, (uint8_t*)text_msg, strlen(text_msg));
@@ -101,7 +106,10 @@ void ADCdata_test_send(MCTP_Handle *hmctp){
         /* Simulate data acquisition delay */
         HAL_Delay(90);
         /* send */
-        MCTP_SendAll(hmctp);
+        MCTP_SendAll_DMA(hmctp);
+
+        /* Handle frames received meanwhile */
+        MCTP_Poll(hmctp);
 
         /* STOP request during delay */
         if(!sending){
@@ -41,6 +41,7 @@
 
 /* Private variables ---------------------------------------------------------*/
 UART_HandleTypeDef huart2;
+DMA_HandleTypeDef hdma_usart2_rx;
 DMA_HandleTypeDef hdma_usart2_tx;
 
 /* USER CODE BEGIN PV */
@@ -95,10 +96,23 @@ int main(void)
     MX_USART2_UART_Init();
     /* USER CODE BEGIN 2 */
 
-    MCTP_Handle hmctp;
+    static MCTP_Handle hmctp;
+    static uint8_t mctp_tx_arena[2048];
+    static uint8_t mctp_reliable_buf[4 * 1024];     /* 4 frames of half arena */
+    /* USART2 runs from PCLK1 (18 MHz) with 8x oversampling */
+    static const uint32_t mctp_baud_rates[] = {115200, 230400, 460800, 921600};
     hmctp.huart = &huart2;
     hmctp.SignalCallback = mctp_sig_callback;
     hmctp.totalChannels = 8;
+    hmctp.rxMode = RXMODE_DMA;
+    hmctp.txArena = mctp_tx_arena;
+    hmctp.txArenaSize = sizeof(mctp_tx_arena);
+    hmctp.baudRates = mctp_baud_rates;
+    hmctp.baudRatesCount = sizeof(mctp_baud_rates) / sizeof(mctp_baud_rates[0]);
+    hmctp.creditKeepLatest = true;
+    hmctp.reliableBuf = mctp_reliable_buf;
+    hmctp.reliableBufSize = sizeof(mctp_reliable_buf);
+    hmctp.crcEnabled = true;
 
     MCTP_Init(&hmctp);
     MCTP_Start(&hmctp);
@@ -112,6 +126,7 @@ int main(void)
     /* USER CODE BEGIN WHILE */
     while (1)
     {
+        MCTP_Poll(&hmctp);
         ADCdata_test_send(&hmctp);
         //
         /* USER CODE END WHILE */
@@ -211,6 +226,9 @@ static void MX_DMA_Init(void)
     __HAL_RCC_DMA1_CLK_ENABLE();
 
     /* DMA interrupt init */
+    /* DMA1_Channel6_IRQn interrupt configuration */
+    HAL_NVIC_SetPriority(DMA1_Channel6_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel6_IRQn);
     /* DMA1_Channel7_IRQn interrupt configuration */
     HAL_NVIC_SetPriority(DMA1_Channel7_IRQn, 0, 0);
     HAL_NVIC_EnableIRQ(DMA1_Channel7_IRQn);
@@ -23,6 +23,8 @@
 /* USER CODE BEGIN Includes */
 
 /* USER CODE END Includes */
+extern DMA_HandleTypeDef hdma_usart2_rx;
+
 extern DMA_HandleTypeDef hdma_usart2_tx;
 
 /* Private typedef -----------------------------------------------------------*/
@@ -110,6 +112,22 @@ void HAL_UART_MspInit(UART_HandleTypeDef* huart)
         HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
 
         /* USART2 DMA Init */
+        /* USART2_RX Init */
+        hdma_usart2_rx.Instance = DMA1_Channel6;
+        hdma_usart2_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+        hdma_usart2_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+        hdma_usart2_rx.Init.MemInc = DMA_MINC_ENABLE;
+        hdma_usart2_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+        hdma_usart2_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+        hdma_usart2_rx.Init.Mode = DMA_CIRCULAR;
+        hdma_usart2_rx.Init.Priority = DMA_PRIORITY_HIGH;
+        if (HAL_DMA_Init(&hdma_usart2_rx) != HAL_OK)
+        {
+            Error_Handler();
+        }
+
+        __HAL_LINKDMA(huart,hdmarx,hdma_usart2_rx);
+
         /* USART2_TX Init */
         hdma_usart2_tx.Instance = DMA1_Channel7;
         hdma_usart2_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
@@ -117,7 +135,7 @@ void HAL_UART_MspInit(UART_HandleTypeDef* huart)
         hdma_usart2_tx.Init.MemInc = DMA_MINC_ENABLE;
         hdma_usart2_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
         hdma_usart2_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
-        hdma_usart2_tx.Init.Mode = DMA_CIRCULAR;
+        hdma_usart2_tx.Init.Mode = DMA_NORMAL;
         hdma_usart2_tx.Init.Priority = DMA_PRIORITY_MEDIUM;
         if (HAL_DMA_Init(&hdma_usart2_tx) != HAL_OK)
         {
@@ -160,6 +178,7 @@ void HAL_UART_MspDeInit(UART_HandleTypeDef* huart)
         HAL_GPIO_DeInit(GPIOA, USART_TX_Pin|USART_RX_Pin);
 
         /* USART2 DMA DeInit */
+        HAL_DMA_DeInit(huart->hdmarx);
         HAL_DMA_DeInit(huart->hdmatx);
 
         /* USART2 interrupt DeInit */